@@ -24,6 +24,7 @@ namespace alps {
 struct DebugOptions: public Externalizable {
     std::string kDefaultLogFilename = "sample.log";
     std::string kDefaultLogLevel = "error";
+    size_t kDefaultLogQueueSize = 8192;
 
     /**
      * Constructs option values with default values
@@ -31,6 +32,9 @@ struct DebugOptions: public Externalizable {
     DebugOptions() {
         log_filename = kDefaultLogFilename;
         log_level = kDefaultLogLevel;
+        log_async = false;
+        log_queue_size = kDefaultLogQueueSize;
+        event_trace = false;
     }
 
     /** 
@@ -43,6 +47,24 @@ struct DebugOptions: public Externalizable {
      */
     std::string log_level;
 
+    /** 
+     * Hand log messages to a background thread that writes them out, so 
+     * that logging threads neither serialize on the sink nor block on I/O
+     */
+    bool log_async;
+
+    /** 
+     * Maximum number of log messages waiting for the background thread; 
+     * further messages are dropped and counted (log_async only)
+     */
+    size_t log_queue_size;
+
+    /** 
+     * Record allocator events into per-thread rings from startup (see 
+     * set_event_trace() to switch recording at runtime)
+     */
+    bool event_trace;
+
     EXTERNALIZABLE(DebugOptions)
 };
 
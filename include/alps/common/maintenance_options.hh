@@ -0,0 +1,71 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_MAINTENANCE_OPTIONS_HH_
+#define _ALPS_MAINTENANCE_OPTIONS_HH_
+
+#include "alps/common/externalizable.hh"
+
+namespace alps {
+
+struct MaintenanceOptions: public Externalizable {
+    bool kDefaultBackgroundThread = false;
+    size_t kDefaultIntervalMs = 10;
+    size_t kDefaultFreeSpaceWatermark = 10;
+    size_t kDefaultPreparedSlabs = 2;
+
+    /**
+     * Constructs option values with default values
+     */
+    MaintenanceOptions() {
+        background_thread = kDefaultBackgroundThread;
+        interval_ms = kDefaultIntervalMs;
+        free_space_watermark = kDefaultFreeSpaceWatermark;
+        prepared_slabs = kDefaultPreparedSlabs;
+    }
+
+    /** 
+     * Run a maintenance thread per open heap that does allocator 
+     * housekeeping ahead of demand instead of on the allocating threads:
+     * it leases zones, formats slabs, drains deferred frees and returns 
+     * empty slabs of per-thread heaps to the process heap
+     */
+    bool background_thread;
+
+    /** 
+     * Interval between two consecutive maintenance passes
+     */
+    size_t interval_ms;
+
+    /** 
+     * Percentage of the blocks of the zones leased by a process below 
+     * which the maintenance thread leases another zone
+     */
+    size_t free_space_watermark;
+
+    /** 
+     * Number of empty slabs the maintenance thread keeps formatted for 
+     * each size class that needed new slabs since the previous pass
+     */
+    size_t prepared_slabs;
+
+    EXTERNALIZABLE(MaintenanceOptions)
+};
+
+
+} //namespace alps
+
+#endif // _ALPS_MAINTENANCE_OPTIONS_HH_
@@ -0,0 +1,94 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_PERSIST_OPTIONS_HH_
+#define _ALPS_PERSIST_OPTIONS_HH_
+
+#include "alps/common/externalizable.hh"
+
+namespace alps {
+
+struct PersistOptions: public Externalizable {
+    std::string kDefaultDurability = "default";
+    size_t kDefaultSlabBatchSize = 32;
+    std::string kDefaultSlabMetadata = "inline";
+    std::string kDefaultFormat = "eager";
+    size_t kDefaultFormatThreads = 0;
+
+    /**
+     * Constructs option values with default values
+     */
+    PersistOptions() {
+        durability = kDefaultDurability;
+        slab_batch_size = kDefaultSlabBatchSize;
+        slab_metadata = kDefaultSlabMetadata;
+        format = kDefaultFormat;
+        format_threads = kDefaultFormatThreads;
+    }
+
+    /** 
+     * Mechanism used to make metadata updates durable: 
+     *   default    : cache line flush on non-volatile builds, none otherwise
+     *   none       : do not flush
+     *   clflushopt : clflushopt + sfence
+     *   clwb       : clwb + sfence
+     *   msync      : msync(MS_SYNC) of the dirty pages, for file mappings
+     * Cache line flush modes fall back to the best instruction the CPU 
+     * supports.
+     */
+    std::string durability;
+
+    /**
+     * Number of slab bitmap updates committed together with a single fence.
+     * Allocations are durable before they are returned; a crash may leak 
+     * up to this many reserved blocks and pending frees per slab.
+     */
+    size_t slab_batch_size;
+
+    /**
+     * Where heaps created by this process keep slab headers and bitmaps:
+     *   inline   : at the beginning of each slab, next to its blocks
+     *   separate : in a metadata area of each zone, apart from all blocks
+     * Separate metadata keeps allocator writes off the cache lines and 
+     * pages of user data at the cost of a metadata slot per zone block. 
+     * The choice is recorded in the heap when it is created.
+     */
+    std::string slab_metadata;
+
+    /**
+     * When heaps created or formatted by this process format the block 
+     * headers of their zones:
+     *   eager : right away, in parallel across zones
+     *   lazy  : when each zone is first leased
+     * Lazy formatting makes creating a large heap proportional to its 
+     * number of zones and moves the rest of the work to first use.
+     */
+    std::string format;
+
+    /**
+     * Number of threads formatting zones eagerly, split evenly among the
+     * interleave groups of the zones; 0 for one per online CPU. Each 
+     * thread runs on the node of its interleave group where possible.
+     */
+    size_t format_threads;
+
+    EXTERNALIZABLE(PersistOptions)
+};
+
+
+} //namespace alps
+
+#endif // _ALPS_PERSIST_OPTIONS_HH_
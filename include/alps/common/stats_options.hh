@@ -0,0 +1,70 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_STATS_OPTIONS_HH_
+#define _ALPS_STATS_OPTIONS_HH_
+
+#include "alps/common/externalizable.hh"
+
+namespace alps {
+
+struct StatsOptions: public Externalizable {
+    bool kDefaultExportHeapStats = false;
+    size_t kDefaultExportIntervalMs = 1000;
+    std::string kDefaultTraceDir = "";
+    bool kDefaultLockProfile = false;
+
+    /**
+     * Constructs option values with default values
+     */
+    StatsOptions() {
+        export_heap_stats = kDefaultExportHeapStats;
+        export_interval_ms = kDefaultExportIntervalMs;
+        trace_dir = kDefaultTraceDir;
+        lock_profile = kDefaultLockProfile;
+    }
+
+    /** 
+     * Publish the allocator statistics of each open heap in a shared 
+     * memory segment under /dev/shm so that external monitors (e.g. 
+     * globalheap-util top) can read them without attaching to the process
+     */
+    bool export_heap_stats;
+
+    /** 
+     * Interval between two consecutive publications of heap statistics
+     */
+    size_t export_interval_ms;
+
+    /** 
+     * Directory where each open heap records a binary trace of its 
+     * allocations for globalheap-replay. Tracing is off when empty.
+     */
+    std::string trace_dir;
+
+    /** 
+     * Count acquisitions, contended acquisitions and wait times of the 
+     * allocator locks of each process (see get_lock_profile())
+     */
+    bool lock_profile;
+
+    EXTERNALIZABLE(StatsOptions)
+};
+
+
+} //namespace alps
+
+#endif // _ALPS_STATS_OPTIONS_HH_
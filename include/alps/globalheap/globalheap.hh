@@ -24,6 +24,8 @@
 
 #include "../pegasus/pegasus.hh"
 #include "../pegasus/relocatable_region.hh"
+#include "heap_stats.hh"
+#include "lock_profile.hh"
 #include "memattrib.hh"
 
 namespace alps {
@@ -73,6 +75,47 @@ public:
      */
     static int create(const char** paths, int npaths, size_t heap_size, size_t metazone_size, GlobalHeap** heap);
 
+    /**
+     * @brief Creates a global symmetric persistent heap of size @a size 
+     * with its own block size classes.
+     *
+     * @details
+     * Small allocations are rounded up to the smallest of @a size_classes
+     * that fits. The classes are stored in the heap and used by every 
+     * process that opens it. They must be strictly increasing multiples of
+     * 8 bytes, at most 116 of them, and the largest must be between 128KB
+     * and 240KB. `globalheap-util profile-sizes` builds classes that fit 
+     * a recorded allocation profile.
+     *
+     * @param path The pathname to the region file backing the heap.
+     * @param heap_size The total size of the heap.
+     * @param metazone_size The size of each zone.
+     * @param size_classes Block sizes of the size classes, or empty for the default classes.
+     * @param[out] heap A pointer to a handle referencing the heap.
+     * @return Zero if success, or error code otherwise.
+     */
+    static int create(const char* path, size_t heap_size, size_t metazone_size, const std::vector<size_t>& size_classes, GlobalHeap** heap);
+
+    /**
+     * @brief Creates a global symmetric persistent heap of size @a size 
+     * with its own block size and size classes.
+     *
+     * @details
+     * Zones are divided into blocks of @a block_size, which is the 
+     * granularity of large allocations and of slabs. Smaller blocks waste
+     * less memory in small heaps. The block size must be a power of two 
+     * between 64KB and 4MB and at most a quarter of the metazone size.
+     *
+     * @param path The pathname to the region file backing the heap.
+     * @param heap_size The total size of the heap.
+     * @param metazone_size The size of each zone.
+     * @param block_size The size of the blocks of each zone.
+     * @param size_classes Block sizes of the size classes, or empty for the default classes.
+     * @param[out] heap A pointer to a handle referencing the heap.
+     * @return Zero if success, or error code otherwise.
+     */
+    static int create(const char* path, size_t heap_size, size_t metazone_size, size_t block_size, const std::vector<size_t>& size_classes, GlobalHeap** heap);
+
     /**
      * @brief Opens a global symmetric persistent heap and returns a handle 
      * referencing the heap.
@@ -197,6 +240,46 @@ public:
      */
     RRegion::TPtr<void> realloc(RRegion::TPtr<void> ptr, size_t size);
 
+    /**
+     * @brief Prepares the heap for a burst of @a count allocations of 
+     * @a size bytes.
+     *
+     * @details
+     * Leases zones and formats slabs ahead of time, so that the following
+     * allocations neither lease zones nor format slabs. Small blocks are 
+     * reserved as empty slabs of their size class that any thread of the 
+     * process can take. Large blocks are reserved as free space in leased
+     * zones. The reservation is a hint: the space is not set aside for the
+     * caller, and memory freed meanwhile may serve the burst first.
+     *
+     * @param size The number of bytes of each allocation.
+     * @param count The number of allocations.
+     * @return Zero if success, or -1 if the heap ran out of space.
+     */
+    int reserve(size_t size, size_t count);
+
+    /**
+     * @brief Prepares the heap for a burst of @a count allocations of 
+     * @a size bytes associated with memory attributes @a memattrib.
+     *
+     * @param size The number of bytes of each allocation.
+     * @param count The number of allocations.
+     * @param memattrib The memory attributes of the allocations.
+     * @return Zero if success, or -1 if the heap ran out of space.
+     */
+    int reserve(size_t size, size_t count, const MemAttrib& memattrib);
+
+    /**
+     * @brief Returns a snapshot of the allocator statistics counters.
+     *
+     * @details
+     * Counters are kept per thread slab heap and aggregated on demand, 
+     * so the snapshot is consistent per heap structure but not across 
+     * the whole heap. They cover allocations made by this process since
+     * the heap was opened.
+     */
+    HeapStats stats();
+
     /**
      * @brief Closes the heap.
      */
@@ -0,0 +1,84 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _ALPS_GLOBALHEAP_HEAP_STATS_HH_
+#define _ALPS_GLOBALHEAP_HEAP_STATS_HH_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+
+namespace alps {
+
+/**
+ * @brief Snapshot of the allocator statistics counters of a heap 
+ *
+ * @details
+ * Counters are maintained by the volatile allocator structures of the 
+ * calling process and are therefore reset every time the heap is opened.
+ * When the library is built without ALPS_HEAP_STATS all counters read 
+ * zero and @a enabled is false. Zone ownership and slab occupancy 
+ * (zones_owned, slab_bytes, slab_bytes_free) describe the current state 
+ * rather than count events and are reported in either build.
+ */
+struct HeapStats {
+    HeapStats();
+
+    uint64_t total_mallocs() const;
+    uint64_t total_frees() const;
+
+    /**
+     * @brief Percentage of slab space held by this process that is free 
+     */
+    double slab_fragmentation() const;
+
+    HeapStats& operator+=(const HeapStats& other);
+
+    void stream_to(std::ostream& os) const;
+
+    bool                  enabled;            // whether counters were compiled in
+    std::vector<size_t>   class_size;         // block size of each size class
+    std::vector<uint64_t> mallocs;            // small-block allocations per size class
+    std::vector<uint64_t> frees;              // small-block frees per size class
+    uint64_t              large_mallocs;      // allocations served directly as extents
+    uint64_t              large_frees;        // frees of blocks allocated as extents
+    uint64_t              slab_refills;       // slabs moved from the process to a thread slab heap
+    uint64_t              deferred_frees;     // small-block frees left to the busy owner of the slab
+    uint64_t              zone_acquisitions;  // zones leased by this process
+    uint64_t              zone_searches;      // searches for a new zone to lease (acquire_new_zone)
+    uint64_t              zone_search_ns;     // total time spent searching for new zones
+    uint64_t              lease_conflicts;    // zone leases lost to another process
+    uint64_t              extent_allocations; // extents carved out of zones (slabs and large blocks)
+    uint64_t              oom_fallbacks;      // allocations that had to extend or reuse partially-full slabs
+    uint64_t              oom_failures;       // allocations that returned the null pointer
+    uint64_t              lock_contentions;   // heap lock acquisitions that had to wait
+    uint64_t              lock_wait_ns;       // total time spent waiting on heap locks
+    uint64_t              zones_owned;        // zones currently leased by this process
+    uint64_t              slab_bytes;         // bytes held in slabs by this process
+    uint64_t              slab_bytes_free;    // free bytes within slabs held by this process
+};
+
+inline std::ostream& operator<<(std::ostream& os, const HeapStats& stats)
+{
+    stats.stream_to(os);
+    return os;
+}
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_HEAP_STATS_HH_
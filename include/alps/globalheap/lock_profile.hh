@@ -0,0 +1,88 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _ALPS_GLOBALHEAP_LOCK_PROFILE_HH_
+#define _ALPS_GLOBALHEAP_LOCK_PROFILE_HH_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace alps {
+
+/**
+ * @brief Acquisition counts and wait times of one allocator lock site
+ *
+ * @details
+ * A site covers every instance of a lock (e.g. all thread slab heap 
+ * mutexes). Bucket i of @a wait_histogram counts contended acquisitions 
+ * that waited between 2^i and 2^(i+1) nanoseconds; the last bucket also 
+ * counts longer waits.
+ */
+struct LockSiteStats {
+    static const size_t kWaitBuckets = 32;
+
+    LockSiteStats();
+
+    double contention() const;
+
+    /**
+     * @brief Upper bound of the wait time of fraction @a p of the 
+     * contended acquisitions, at histogram resolution
+     */
+    uint64_t wait_percentile_ns(double p) const;
+
+    std::string           name;
+    uint64_t              acquisitions; // all acquisitions
+    uint64_t              contended;    // acquisitions that found the lock held
+    uint64_t              wait_ns;      // total time spent waiting
+    std::vector<uint64_t> wait_histogram;
+};
+
+/**
+ * @brief Snapshot of the lock profile of the calling process
+ *
+ * @details
+ * Lock profiling is process-wide and off by default. It is turned on by 
+ * StatsOptions::lock_profile or set_lock_profile(). While it is off, 
+ * locks cost one extra relaxed load and all counters stay zero.
+ */
+struct LockProfile {
+    bool                       enabled;
+    std::vector<LockSiteStats> sites;
+
+    void stream_to(std::ostream& os) const;
+    void stream_json(std::ostream& os) const;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LockProfile& profile)
+{
+    profile.stream_to(os);
+    return os;
+}
+
+void set_lock_profile(bool on);
+
+void reset_lock_profile();
+
+void get_lock_profile(LockProfile* profile);
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_LOCK_PROFILE_HH_
@@ -19,6 +19,9 @@
 
 #include "../common/debug_options.hh"
 #include "../common/externalizable.hh"
+#include "../common/maintenance_options.hh"
+#include "../common/persist_options.hh"
+#include "../common/stats_options.hh"
 
 #include "address_space_options.hh"
 #include "lfs_options.hh"
@@ -33,6 +36,9 @@ struct PegasusOptions: public Externalizable {
     AddressSpaceOptions address_space_options;
     DebugOptions        debug_options;
     LfsOptions          lfs_options;
+    MaintenanceOptions  maintenance_options;
+    PersistOptions      persist_options;
+    StatsOptions        stats_options;
     TmpfsOptions        tmpfs_options;
 
     EXTERNALIZABLE(PegasusOptions);
@@ -17,6 +17,48 @@
 #ifndef _ALPS_COMMON_DEBUG_HH_
 #define _ALPS_COMMON_DEBUG_HH_
 
+#include <string.h>
+#include <unistd.h>
+
 #include "log.hh"
 
+namespace alps {
+
+/**
+ * @brief Crash injection for testing recovery
+ *
+ * @details
+ * A test arms a named crash point, and the process exits immediately 
+ * (without running destructors or flushing anything) the countdown-th time
+ * execution reaches that point.
+ */
+struct CrashPoint {
+    const char* name;
+    int         countdown;
+};
+
+inline CrashPoint& armed_crash_point()
+{
+    static CrashPoint crash_point = {NULL, 0};
+    return crash_point;
+}
+
+inline void arm_crash_point(const char* name, int countdown = 1)
+{
+    armed_crash_point().countdown = countdown;
+    armed_crash_point().name = name;
+}
+
+inline void crash_point(const char* name)
+{
+    CrashPoint& cp = armed_crash_point();
+    if (cp.name && strcmp(cp.name, name) == 0 && --cp.countdown == 0) {
+        _exit(0);
+    }
+}
+
+} // namespace alps
+
+#define CRASH_POINT(name) ::alps::crash_point(name)
+
 #endif // _ALPS_COMMON_DEBUG_HH_
@@ -21,6 +21,9 @@ namespace alps {
 ErrorStack DebugOptions::load(YAML::Node* node, bool ignore_missing) {
     EXTERNALIZE_LOAD_ELEMENT(node, ignore_missing, log_filename);
     EXTERNALIZE_LOAD_ELEMENT(node, ignore_missing, log_level);
+    EXTERNALIZE_LOAD_ELEMENT(node, ignore_missing, log_async);
+    EXTERNALIZE_LOAD_ELEMENT(node, ignore_missing, log_queue_size);
+    EXTERNALIZE_LOAD_ELEMENT(node, ignore_missing, event_trace);
 
     return kRetOk;
 }
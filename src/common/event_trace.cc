@@ -0,0 +1,202 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "common/event_trace.hh"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "common/log.hh"
+
+namespace alps {
+
+const size_t EventRing::kEvents;
+
+std::atomic<bool> event_trace_on(false);
+
+static uint64_t event_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+EventRing::EventRing(uint32_t thread)
+    : thread_(thread),
+      begin_(0),
+      end_(0)
+{
+    for (size_t i = 0; i < kEvents; i++) {
+        slots_[i].timestamp_ns.store(0, std::memory_order_relaxed);
+        slots_[i].thread_type.store(0, std::memory_order_relaxed);
+        slots_[i].arg0.store(0, std::memory_order_relaxed);
+        slots_[i].arg1.store(0, std::memory_order_relaxed);
+    }
+}
+
+void EventRing::record(uint16_t type, uint64_t arg0, uint64_t arg1)
+{
+    uint64_t index = end_.load(std::memory_order_relaxed);
+    Slot* slot = &slots_[index & (kEvents - 1)];
+
+    // claim the slot before overwriting it so that a concurrent snapshot
+    // that sees the new contents also sees the claim
+    begin_.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->timestamp_ns.store(event_clock_ns(), std::memory_order_relaxed);
+    slot->thread_type.store((static_cast<uint64_t>(thread_) << 16) | type, std::memory_order_relaxed);
+    slot->arg0.store(arg0, std::memory_order_relaxed);
+    slot->arg1.store(arg1, std::memory_order_relaxed);
+    end_.store(index + 1, std::memory_order_release);
+}
+
+void EventRing::snapshot(std::vector<Event>* events) const
+{
+    uint64_t end = end_.load(std::memory_order_acquire);
+    uint64_t first = end > kEvents ? end - kEvents : 0;
+    std::vector<Event> copy;
+    copy.reserve(end - first);
+    for (uint64_t index = first; index < end; index++) {
+        const Slot* slot = &slots_[index & (kEvents - 1)];
+        Event e;
+        e.timestamp_ns = slot->timestamp_ns.load(std::memory_order_relaxed);
+        uint64_t thread_type = slot->thread_type.load(std::memory_order_relaxed);
+        e.thread = thread_type >> 16;
+        e.type = thread_type & 0xffff;
+        e.reserved = 0;
+        e.arg0 = slot->arg0.load(std::memory_order_relaxed);
+        e.arg1 = slot->arg1.load(std::memory_order_relaxed);
+        copy.push_back(e);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // drop the events whose slots the owner has claimed since
+    uint64_t begin = begin_.load(std::memory_order_relaxed);
+    uint64_t valid = begin > kEvents ? begin - kEvents : 0;
+    for (uint64_t index = std::max(first, valid); index < end; index++) {
+        events->push_back(copy[index - first]);
+    }
+}
+
+
+// rings are never freed: the ring of an exited thread keeps its events
+// until a new thread reuses it
+static pthread_mutex_t event_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<EventRing*> event_rings;
+static std::vector<EventRing*> retired_event_rings;
+static uint32_t event_nthreads = 0;
+static pthread_key_t event_ring_key;
+static pthread_once_t event_ring_key_once = PTHREAD_ONCE_INIT;
+static __thread EventRing* event_ring = NULL;
+
+static void retire_event_ring(void* ring)
+{
+    pthread_mutex_lock(&event_rings_mutex);
+    retired_event_rings.push_back(static_cast<EventRing*>(ring));
+    pthread_mutex_unlock(&event_rings_mutex);
+}
+
+static void create_event_ring_key()
+{
+    pthread_key_create(&event_ring_key, retire_event_ring);
+}
+
+static EventRing* thread_event_ring()
+{
+    if (event_ring) {
+        return event_ring;
+    }
+    pthread_once(&event_ring_key_once, create_event_ring_key);
+    pthread_mutex_lock(&event_rings_mutex);
+    uint32_t thread = ++event_nthreads;
+    if (!retired_event_rings.empty()) {
+        event_ring = retired_event_rings.back();
+        retired_event_rings.pop_back();
+        event_ring->set_thread(thread);
+    } else {
+        event_ring = new EventRing(thread);
+        event_rings.push_back(event_ring);
+    }
+    pthread_mutex_unlock(&event_rings_mutex);
+    pthread_setspecific(event_ring_key, event_ring);
+    return event_ring;
+}
+
+void set_event_trace(bool on)
+{
+    event_trace_on.store(on, std::memory_order_relaxed);
+}
+
+void record_event(uint16_t type, uint64_t arg0, uint64_t arg1)
+{
+    thread_event_ring()->record(type, arg0, arg1);
+}
+
+static bool event_before(const Event& a, const Event& b)
+{
+    return a.timestamp_ns < b.timestamp_ns;
+}
+
+void collect_events(std::vector<Event>* events)
+{
+    events->clear();
+    pthread_mutex_lock(&event_rings_mutex);
+    for (size_t i = 0; i < event_rings.size(); i++) {
+        event_rings[i]->snapshot(events);
+    }
+    pthread_mutex_unlock(&event_rings_mutex);
+    // events of a ring are already in order
+    std::stable_sort(events->begin(), events->end(), event_before);
+}
+
+const char* event_type_name(uint16_t type)
+{
+    switch (type) {
+        case kEventMalloc: return "malloc";
+        case kEventFree: return "free";
+        case kEventAllocBlock: return "alloc_block";
+        case kEventFreeBlock: return "free_block";
+        case kEventAcquireSlab: return "acquire_slab";
+        case kEventAcquireZone: return "acquire_zone";
+        case kEventExtentInsert: return "extent_insert";
+        case kEventDeferFree: return "defer_free";
+        default: return "unknown";
+    }
+}
+
+void dump_events(std::ostream& os)
+{
+    std::vector<Event> events;
+    collect_events(&events);
+    for (std::vector<Event>::iterator it = events.begin(); it != events.end(); it++) {
+        os << it->timestamp_ns << " T." << it->thread << " " << event_type_name(it->type)
+           << " " << it->arg0 << " " << it->arg1 << std::endl;
+    }
+}
+
+void init_event_trace(const DebugOptions& options)
+{
+    set_event_trace(options.event_trace);
+    if (options.event_trace) {
+        LOG(info) << "Event trace: on";
+    }
+}
+
+} // namespace alps
@@ -0,0 +1,141 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_COMMON_EVENT_TRACE_HH_
+#define _ALPS_COMMON_EVENT_TRACE_HH_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <ostream>
+#include <vector>
+
+#include "alps/common/debug_options.hh"
+
+namespace alps {
+
+// allocator events
+const uint16_t kEventMalloc = 1;       // arg0: size, arg1: offset of block (0 if failed)
+const uint16_t kEventFree = 2;         // arg0: offset of block
+const uint16_t kEventAllocBlock = 3;   // arg0: slab, arg1: block index
+const uint16_t kEventFreeBlock = 4;    // arg0: slab, arg1: block index
+const uint16_t kEventAcquireSlab = 5;  // arg0: size class, arg1: slab (0 if none)
+const uint16_t kEventAcquireZone = 6;  // arg0: zone id
+const uint16_t kEventExtentInsert = 7; // arg0: start block, arg1: length in blocks
+const uint16_t kEventDeferFree = 8;    // arg0: slab, arg1: block index
+
+/**
+ * @brief An event recorded in the event trace
+ */
+struct Event {
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC
+    uint32_t thread;       // recording thread, numbered from 1 in order of first use
+    uint16_t type;
+    uint16_t reserved;
+    uint64_t arg0;
+    uint64_t arg1;
+};
+
+/**
+ * @brief Fixed-size ring of the most recent events of a single thread
+ *
+ * @details
+ * Only the owning thread records into the ring, so recording needs no
+ * lock and no atomic read-modify-write. Other threads may take a snapshot
+ * at any time; events the owner overwrites while the snapshot is being
+ * copied are detected and left out.
+ */
+class EventRing {
+public:
+    static const size_t kEvents = 4096; // must be a power of two
+
+public:
+    EventRing(uint32_t thread);
+
+    void record(uint16_t type, uint64_t arg0, uint64_t arg1);
+
+    void snapshot(std::vector<Event>* events) const;
+
+    uint32_t thread() const { return thread_; }
+    void set_thread(uint32_t thread) { thread_ = thread; }
+
+private:
+    // an event packed in words that can be copied concurrently with the owner
+    struct Slot {
+        std::atomic<uint64_t> timestamp_ns;
+        std::atomic<uint64_t> thread_type;
+        std::atomic<uint64_t> arg0;
+        std::atomic<uint64_t> arg1;
+    };
+
+    uint32_t              thread_;
+    std::atomic<uint64_t> begin_; // events claimed by the owner
+    std::atomic<uint64_t> end_;   // events completely written
+    Slot                  slots_[kEvents];
+};
+
+extern std::atomic<bool> event_trace_on;
+
+/**
+ * @brief Whether events are recorded (see DebugOptions::event_trace)
+ */
+inline bool event_trace_enabled()
+{
+    return event_trace_on.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Turn event recording on or off at runtime
+ */
+void set_event_trace(bool on);
+
+/**
+ * @brief Record an event into the ring of the calling thread
+ */
+void record_event(uint16_t type, uint64_t arg0, uint64_t arg1);
+
+/**
+ * @brief Collect the events currently held by the rings of all threads,
+ * ordered by timestamp
+ */
+void collect_events(std::vector<Event>* events);
+
+/**
+ * @brief Write the collected events to @a os, one per line
+ */
+void dump_events(std::ostream& os);
+
+const char* event_type_name(uint16_t type);
+
+void init_event_trace(const DebugOptions& options);
+
+} // namespace alps
+
+/**
+ * @brief Record an allocator event if event tracing is on
+ *
+ * @details
+ * When tracing is off the cost is a single relaxed load and a branch, so
+ * events can be left in the allocator hot paths.
+ */
+#define TRACE_EVENT(type, arg0, arg1) \
+    do { \
+        if (alps::event_trace_enabled()) { \
+            alps::record_event(type, arg0, arg1); \
+        } \
+    } while (0)
+
+#endif // _ALPS_COMMON_EVENT_TRACE_HH_
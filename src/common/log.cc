@@ -19,6 +19,7 @@
 #include <boost/log/core/core.hpp>
 #include <boost/log/expressions/formatters/date_time.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
 #include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/sources/severity_logger.hpp>
@@ -29,8 +30,14 @@
 #include <boost/utility/empty_deleter.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
 #include <ostream>
+#include <queue>
 
 #include "alps/common/debug_options.hh"
  
@@ -47,38 +54,128 @@ BOOST_LOG_ATTRIBUTE_KEYWORD(thread_id, "ThreadID", boost::log::attributes::curre
  
 boost::log::sources::severity_logger_mt<boost::log::trivial::severity_level> logger;
 
-void init_log(const DebugOptions& debug_options)
-{
-    // add attributes
-    logger.add_attribute("LineID", attrs::counter<unsigned int>(1));     // lines are sequentially numbered
-    logger.add_attribute("TimeStamp", attrs::local_clock());             // each log line gets a timestamp
-    logger.add_attribute("ThreadID", boost::log::attributes::current_thread_id()); // each log line gets a thread_id
+/**
+ * @brief Bounded queueing strategy of the asynchronous sink that drops 
+ * (and counts) records when the queue is full
+ *
+ * @details
+ * Same as boost::log::sinks::bounded_fifo_queue with drop_on_overflow, 
+ * except that the capacity is set at runtime and dropped records are 
+ * counted.
+ */
+class LogQueue {
+public:
+    void set_capacity(size_t capacity)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        capacity_ = std::max<size_t>(capacity, 1);
+    }
 
-    // construct and add a text sink
-    typedef sinks::synchronous_sink< sinks::text_ostream_backend > text_sink;
-    boost::shared_ptr< text_sink > sink = boost::make_shared< text_sink >();
+    size_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
 
-    // add a stream to write log to
-    sink->locked_backend()->add_stream(boost::make_shared< std::ofstream >(debug_options.log_filename));
+protected:
+    LogQueue()
+        : capacity_(DebugOptions().log_queue_size),
+          dropped_(0),
+          interrupted_(false)
+    { }
 
-    // add "console" output stream to our sink
-    // we have to provide an empty deleter to avoid destroying the global stream object
-    boost::shared_ptr< std::ostream > stream(&std::clog, boost::empty_deleter());
-    sink->locked_backend()->add_stream(stream);
+    template<typename ArgsT>
+    explicit LogQueue(ArgsT const&)
+        : capacity_(DebugOptions().log_queue_size),
+          dropped_(0),
+          interrupted_(false)
+    { }
 
-    // specify the format of the log message
-    boost::log::formatter formatter = expr::stream
-      << std::setw(7) << std::setfill('0') << line_id << std::setfill(' ') << " | "
-      << "T." << thread_id << " | " 
-      << expr::format_date_time(timestamp, "%Y-%m-%d, %H:%M:%S.%f") << " "
-      << "[" << boost::log::trivial::severity << "]"
-      << " - " << expr::smessage;
-    
-    sink->set_formatter(formatter);
+    void enqueue(boost::log::record_view const& rec)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        push(rec);
+    }
+
+    bool try_enqueue(boost::log::record_view const& rec)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_, boost::try_to_lock);
+        if (!lock.owns_lock()) {
+            return false;
+        }
+        push(rec);
+        return true;
+    }
+
+    bool try_dequeue_ready(boost::log::record_view& rec)
+    {
+        return try_dequeue(rec);
+    }
+
+    bool try_dequeue(boost::log::record_view& rec)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        rec.swap(queue_.front());
+        queue_.pop();
+        return true;
+    }
+
+    bool dequeue_ready(boost::log::record_view& rec)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (!interrupted_) {
+            if (!queue_.empty()) {
+                rec.swap(queue_.front());
+                queue_.pop();
+                return true;
+            }
+            cond_.wait(lock);
+        }
+        interrupted_ = false;
+        return false;
+    }
+
+    void interrupt_dequeue()
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        interrupted_ = true;
+        cond_.notify_one();
+    }
+
+private:
+    // caller holds mutex_
+    void push(boost::log::record_view const& rec)
+    {
+        if (queue_.size() >= capacity_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue_.push(rec);
+        if (queue_.size() == 1) {
+            cond_.notify_one();
+        }
+    }
+
+private:
+    boost::mutex                           mutex_;
+    boost::condition_variable              cond_;
+    std::queue<boost::log::record_view>    queue_;
+    size_t                                 capacity_;
+    std::atomic<size_t>                    dropped_;
+    bool                                   interrupted_;
+};
 
-    std::string sl_str = debug_options.log_level;
+typedef sinks::synchronous_sink< sinks::text_ostream_backend > sync_text_sink;
+typedef sinks::asynchronous_sink< sinks::text_ostream_backend, LogQueue > async_text_sink;
 
-    boost::log::trivial::severity_level sl;
+// the asynchronous sink, if any, flushed at exit
+static boost::shared_ptr< async_text_sink > async_sink;
+
+static boost::log::trivial::severity_level parse_severity_level(std::string sl_str)
+{
+    boost::log::trivial::severity_level sl = boost::log::trivial::severity_level::trace;
     std::transform(sl_str.begin(), sl_str.end(), sl_str.begin(), ::tolower);
     if (sl_str == "trace") {
       sl = boost::log::trivial::severity_level::trace;
@@ -107,10 +204,81 @@ void init_log(const DebugOptions& debug_options)
             sl = static_cast<boost::log::trivial::severity_level>(il);
         }
     }
-    sink->set_filter(severity >= sl);
+    return sl;
+}
+
+template<typename SinkT>
+static void setup_sink(boost::shared_ptr<SinkT> sink, const DebugOptions& debug_options)
+{
+    // add a stream to write log to
+    sink->locked_backend()->add_stream(boost::make_shared< std::ofstream >(debug_options.log_filename));
+
+    // add "console" output stream to our sink
+    // we have to provide an empty deleter to avoid destroying the global stream object
+    boost::shared_ptr< std::ostream > stream(&std::clog, boost::empty_deleter());
+    sink->locked_backend()->add_stream(stream);
+
+    // specify the format of the log message
+    boost::log::formatter formatter = expr::stream
+      << std::setw(7) << std::setfill('0') << line_id << std::setfill(' ') << " | "
+      << "T." << thread_id << " | " 
+      << expr::format_date_time(timestamp, "%Y-%m-%d, %H:%M:%S.%f") << " "
+      << "[" << boost::log::trivial::severity << "]"
+      << " - " << expr::smessage;
+    
+    sink->set_formatter(formatter);
+
+    sink->set_filter(severity >= parse_severity_level(debug_options.log_level));
 
     // register the sink in the logging core
     boost::log::core::get()->add_sink(sink);
 }
 
+static void stop_async_log()
+{
+    flush_log();
+    async_sink->stop();
+    async_sink->flush();
+}
+
+void init_log(const DebugOptions& debug_options)
+{
+    // add attributes
+    logger.add_attribute("LineID", attrs::counter<unsigned int>(1));     // lines are sequentially numbered
+    logger.add_attribute("TimeStamp", attrs::local_clock());             // each log line gets a timestamp
+    logger.add_attribute("ThreadID", boost::log::attributes::current_thread_id()); // each log line gets a thread_id
+
+    if (debug_options.log_async) {
+        // construct a text sink whose records are written by a dedicated thread
+        async_sink = boost::make_shared< async_text_sink >();
+        async_sink->set_capacity(debug_options.log_queue_size);
+        setup_sink(async_sink, debug_options);
+        std::atexit(stop_async_log);
+    } else {
+        // construct and add a text sink
+        setup_sink(boost::make_shared< sync_text_sink >(), debug_options);
+    }
+}
+
+void flush_log()
+{
+    if (!async_sink) {
+        return;
+    }
+    // drain the queue before reporting drops so that the report fits in it
+    async_sink->flush();
+    static std::atomic<size_t> reported(0);
+    size_t dropped = async_sink->dropped();
+    size_t prev = reported.exchange(dropped);
+    if (dropped > prev) {
+        LOG(error) << "Dropped " << dropped - prev << " log messages: log queue full";
+        async_sink->flush();
+    }
+}
+
+size_t log_messages_dropped()
+{
+    return async_sink ? async_sink->dropped() : 0;
+}
+
 } // namespace alps
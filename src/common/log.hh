@@ -38,7 +38,27 @@
 // just log messages with severity >= SEVERITY_THRESHOLD are written
 #define SEVERITY_THRESHOLD logging::trivial::warning
  
-#define LOG(severity) BOOST_LOG_SEV(logger, boost::log::trivial::severity) << "(" << __FILE__ << ", " << __LINE__ << ") "
+// numeric severity levels for compile-time filtering, in the order of
+// boost::log::trivial::severity_level
+#define ALPS_LOG_LEVEL_trace   0
+#define ALPS_LOG_LEVEL_debug   1
+#define ALPS_LOG_LEVEL_info    2
+#define ALPS_LOG_LEVEL_warning 3
+#define ALPS_LOG_LEVEL_error   4
+#define ALPS_LOG_LEVEL_fatal   5
+
+// log statements below this severity compile to nothing: neither the 
+// logger nor the streamed arguments are evaluated (see ALPS_LOG_MIN_LEVEL 
+// in CMakeLists.txt)
+#ifndef ALPS_LOG_MIN_LEVEL
+#define ALPS_LOG_MIN_LEVEL ALPS_LOG_LEVEL_trace
+#endif
+
+#define LOG_ENABLED(severity) (ALPS_LOG_LEVEL_##severity >= ALPS_LOG_MIN_LEVEL)
+
+#define LOG(severity) \
+    if (!LOG_ENABLED(severity)) { } else \
+    BOOST_LOG_SEV(logger, boost::log::trivial::severity) << "(" << __FILE__ << ", " << __LINE__ << ") "
 //#define LOG(severity) BOOST_LOG_SEV(logger, boost::log::trivial::severity) << "(" << __FILE__ << ", " << __LINE__ << ", T." << pthread_self() << ") "
 
 namespace alps {
@@ -47,6 +67,17 @@ extern boost::log::sources::severity_logger_mt<boost::log::trivial::severity_lev
 
 void init_log(const DebugOptions& options);
 
+/**
+ * @brief Write out all log messages still queued for the asynchronous sink
+ */
+void flush_log();
+
+/**
+ * @brief Number of log messages the asynchronous sink dropped because its
+ * queue was full
+ */
+size_t log_messages_dropped();
+
 } // namespace alps
 
 #endif // _ALPS_COMMON_LOG_H_
@@ -0,0 +1,45 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/maintenance.hh"
+
+#include <algorithm>
+
+#include "common/log.hh"
+
+namespace alps {
+
+bool heap_maintenance = MaintenanceOptions().background_thread;
+
+size_t heap_maintenance_interval_ms = MaintenanceOptions().interval_ms;
+
+size_t heap_free_space_watermark = MaintenanceOptions().free_space_watermark;
+
+size_t heap_prepared_slabs = MaintenanceOptions().prepared_slabs;
+
+void init_maintenance(const MaintenanceOptions& options)
+{
+    heap_maintenance = options.background_thread;
+    heap_maintenance_interval_ms = std::max<size_t>(options.interval_ms, 1);
+    heap_free_space_watermark = std::min<size_t>(options.free_space_watermark, 100);
+    heap_prepared_slabs = options.prepared_slabs;
+    LOG(info) << "Heap maintenance thread: " << (heap_maintenance ? "on" : "off")
+              << " interval: " << heap_maintenance_interval_ms << "ms"
+              << " free space watermark: " << heap_free_space_watermark << "%"
+              << " prepared slabs: " << heap_prepared_slabs;
+}
+
+} // namespace alps
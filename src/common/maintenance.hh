@@ -0,0 +1,54 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_COMMON_MAINTENANCE_HH_
+#define _ALPS_COMMON_MAINTENANCE_HH_
+
+#include <stddef.h>
+
+#include "alps/common/maintenance_options.hh"
+
+namespace alps {
+
+/**
+ * @brief Whether open heaps run a background maintenance thread
+ * (see MaintenanceOptions::background_thread)
+ */
+extern bool heap_maintenance;
+
+/**
+ * @brief Interval between maintenance passes
+ * (see MaintenanceOptions::interval_ms)
+ */
+extern size_t heap_maintenance_interval_ms;
+
+/**
+ * @brief Percentage of free blocks in leased zones below which maintenance
+ * leases another zone (see MaintenanceOptions::free_space_watermark)
+ */
+extern size_t heap_free_space_watermark;
+
+/**
+ * @brief Number of formatted empty slabs kept per hot size class
+ * (see MaintenanceOptions::prepared_slabs)
+ */
+extern size_t heap_prepared_slabs;
+
+void init_maintenance(const MaintenanceOptions& options);
+
+} // namespace alps
+
+#endif // _ALPS_COMMON_MAINTENANCE_HH_
@@ -177,22 +177,18 @@ ErrorCode os_filesize(int fd, loff_t* size)
 
 int os_write_zeros(int descriptor, off_t offset, size_t amount) 
 {
-    int ret;
     char buffer[1024*1024];
     memset(&buffer, 0, sizeof(buffer));
 
-    if (offset > 0) {
-        if ((ret = lseek(descriptor, offset, SEEK_SET) < 0)) {
-            return ret;
-        }
-    }
+    // positional writes so that threads can zero parts of the same file
     while (amount > 0) {
-        ssize_t written = write(descriptor, buffer, 
-                                amount>sizeof(buffer) ? sizeof(buffer) : amount);
+        ssize_t written = pwrite(descriptor, buffer, 
+                                 amount>sizeof(buffer) ? sizeof(buffer) : amount, offset);
         if (written < 0) {
             return -1;
         }
         amount -= written;
+        offset += written;
     }
 
     return 0;
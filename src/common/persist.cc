@@ -0,0 +1,214 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/persist.hh"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "common/log.hh"
+
+namespace alps {
+
+static DurabilityMode default_durability_mode();
+
+DurabilityMode durability_mode = default_durability_mode();
+
+size_t slab_batch_size = PersistOptions().slab_batch_size;
+
+bool slab_metadata_separate = false;
+bool format_lazy = false;
+size_t format_threads = 0;
+
+static bool cpuid_leaf7_ebx(unsigned int bit)
+{
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, 0) < 7) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1U << bit)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_has_clflushopt()
+{
+    return cpuid_leaf7_ebx(23);
+}
+
+bool cpu_has_clwb()
+{
+    return cpuid_leaf7_ebx(24);
+}
+
+static DurabilityMode best_cacheline_flush()
+{
+#if defined(__x86_64__)
+    if (cpu_has_clwb()) {
+        return kDurabilityClwb;
+    }
+    if (cpu_has_clflushopt()) {
+        return kDurabilityClflushopt;
+    }
+    return kDurabilityClflush;
+#else
+    return kDurabilityNone;
+#endif
+}
+
+static DurabilityMode default_durability_mode()
+{
+#ifdef __ARCH_NON_VOLATILE__
+    return best_cacheline_flush();
+#else
+    return kDurabilityNone;
+#endif
+}
+
+struct DurabilityModeName {
+    DurabilityMode mode;
+    const char*    name;
+};
+
+static const DurabilityModeName durability_mode_names[] = {
+    { kDurabilityNone, "none" },
+    { kDurabilityClflush, "clflush" },
+    { kDurabilityClflushopt, "clflushopt" },
+    { kDurabilityClwb, "clwb" },
+    { kDurabilityMsync, "msync" }
+};
+
+int durability_mode_from_string(const std::string& name, DurabilityMode* mode)
+{
+    if (name == "default") {
+        *mode = default_durability_mode();
+        return 0;
+    }
+    for (auto& n: durability_mode_names) {
+        if (name == n.name) {
+            *mode = n.mode;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* durability_mode_to_string(DurabilityMode mode)
+{
+    for (auto& n: durability_mode_names) {
+        if (mode == n.mode) {
+            return n.name;
+        }
+    }
+    return "unknown";
+}
+
+DurabilityMode set_durability_mode(DurabilityMode mode)
+{
+    DurabilityMode selected = mode;
+    if (selected == kDurabilityClwb && !cpu_has_clwb()) {
+        selected = kDurabilityClflushopt;
+    }
+    if (selected == kDurabilityClflushopt && !cpu_has_clflushopt()) {
+        selected = kDurabilityClflush;
+    }
+#if !defined(__x86_64__)
+    if (selected == kDurabilityClflush) {
+        selected = kDurabilityNone;
+    }
+#endif
+    if (selected != mode) {
+        LOG(warning) << "Durability mode " << durability_mode_to_string(mode) 
+                     << " not supported by CPU, falling back to " 
+                     << durability_mode_to_string(selected);
+    }
+    durability_mode = selected;
+    return selected;
+}
+
+void init_persist(const PersistOptions& options)
+{
+    DurabilityMode mode;
+    if (durability_mode_from_string(options.durability, &mode) != 0) {
+        LOG(error) << "Unknown durability mode: " << options.durability 
+                   << ", using default";
+        mode = default_durability_mode();
+    }
+    set_durability_mode(mode);
+    slab_batch_size = std::max<size_t>(options.slab_batch_size, 1);
+    if (options.slab_metadata == "separate") {
+        slab_metadata_separate = true;
+    } else if (options.slab_metadata == "inline") {
+        slab_metadata_separate = false;
+    } else {
+        LOG(error) << "Unknown slab metadata placement: " << options.slab_metadata 
+                   << ", using inline";
+        slab_metadata_separate = false;
+    }
+    if (options.format == "lazy") {
+        format_lazy = true;
+    } else if (options.format == "eager") {
+        format_lazy = false;
+    } else {
+        LOG(error) << "Unknown format mode: " << options.format 
+                   << ", using eager";
+        format_lazy = false;
+    }
+    format_threads = options.format_threads;
+    LOG(info) << "Durability mode: " << durability_mode_to_string(durability_mode)
+              << " slab batch size: " << slab_batch_size
+              << " slab metadata: " << (slab_metadata_separate ? "separate" : "inline")
+              << " format: " << (format_lazy ? "lazy" : "eager");
+}
+
+void durability_msync(const uintptr_t* lines, size_t nlines)
+{
+    static const uintptr_t page_mask = ~(uintptr_t(sysconf(_SC_PAGESIZE)) - 1);
+    static const uintptr_t page_size = ~page_mask + 1;
+
+    std::vector<uintptr_t> pages(nlines);
+    for (size_t i = 0; i < nlines; i++) {
+        pages[i] = lines[i] & page_mask;
+    }
+    std::sort(pages.begin(), pages.end());
+
+    // coalesce adjacent pages into ranges and sync each range once
+    size_t i = 0;
+    while (i < pages.size()) {
+        uintptr_t start = pages[i];
+        uintptr_t end = start + page_size;
+        for (i++; i < pages.size() && pages[i] <= end; i++) {
+            end = pages[i] + page_size;
+        }
+        if (msync(reinterpret_cast<void*>(start), end - start, MS_SYNC) != 0) {
+            LOG(error) << "msync failed: " << strerror(errno);
+        }
+    }
+}
+
+} // namespace alps
@@ -0,0 +1,148 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_COMMON_PERSIST_HH_
+#define _ALPS_COMMON_PERSIST_HH_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "alps/common/assorted_func.hh"
+#include "alps/common/persist_options.hh"
+
+namespace alps {
+
+/**
+ * @brief Mechanisms for making stores durable, selected at runtime
+ */
+enum DurabilityMode {
+    kDurabilityNone = 0,
+    kDurabilityClflush,
+    kDurabilityClflushopt,
+    kDurabilityClwb,
+    kDurabilityMsync
+};
+
+extern DurabilityMode durability_mode;
+
+/**
+ * @brief Number of slab bitmap updates committed with a single fence
+ * (see PersistOptions::slab_batch_size)
+ */
+extern size_t slab_batch_size;
+
+/**
+ * @brief Whether heaps created by this process keep slab metadata apart 
+ * from slab blocks (see PersistOptions::slab_metadata)
+ */
+extern bool slab_metadata_separate;
+
+/**
+ * @brief Whether heaps created or formatted by this process format block
+ * headers when zones are first leased (see PersistOptions::format)
+ */
+extern bool format_lazy;
+
+/**
+ * @brief Number of threads formatting zones eagerly, 0 for one per online
+ * CPU (see PersistOptions::format_threads)
+ */
+extern size_t format_threads;
+
+bool cpu_has_clflushopt();
+bool cpu_has_clwb();
+
+/**
+ * @brief Parse a durability mode name (see PersistOptions::durability)
+ *
+ * @return 0 on success, -1 if the name is not a known mode
+ */
+int durability_mode_from_string(const std::string& name, DurabilityMode* mode);
+
+const char* durability_mode_to_string(DurabilityMode mode);
+
+/**
+ * @brief Select the durability mode, falling back to the best cache line 
+ * flush instruction supported by the CPU
+ *
+ * @return the mode actually selected
+ */
+DurabilityMode set_durability_mode(DurabilityMode mode);
+
+void init_persist(const PersistOptions& options);
+
+/**
+ * @brief Synchronously write back the pages covering a set of cache lines
+ */
+void durability_msync(const uintptr_t* lines, size_t nlines);
+
+inline void durability_flush_line(uintptr_t line)
+{
+#if defined(__x86_64__)
+    volatile char* p = reinterpret_cast<volatile char*>(line);
+    switch (durability_mode) {
+        case kDurabilityClwb:
+            // clwb encoded as 66 xsaveopt for older assemblers
+            asm volatile(".byte 0x66; xsaveopt %0" : "+m" (*p));
+            break;
+        case kDurabilityClflushopt:
+            // clflushopt encoded as 66 clflush for older assemblers
+            asm volatile(".byte 0x66; clflush %0" : "+m" (*p));
+            break;
+        case kDurabilityClflush:
+            asm volatile("clflush %0" : "+m" (*p));
+            break;
+        default:
+            break;
+    }
+#endif
+}
+
+inline void durability_flush_lines(const uintptr_t* lines, size_t nlines)
+{
+    if (durability_mode == kDurabilityNone) {
+        return;
+    }
+    if (durability_mode == kDurabilityMsync) {
+        durability_msync(lines, nlines);
+        return;
+    }
+    for (size_t i = 0; i < nlines; i++) {
+        durability_flush_line(lines[i]);
+    }
+}
+
+inline void durability_fence()
+{
+#if defined(__x86_64__)
+    switch (durability_mode) {
+        case kDurabilityClwb:
+        case kDurabilityClflushopt:
+        case kDurabilityClflush:
+            asm volatile("sfence" ::: "memory");
+            break;
+        default:
+            // msync(MS_SYNC) returns after the write back completes
+            break;
+    }
+#endif
+}
+
+} // namespace alps
+
+#endif // _ALPS_COMMON_PERSIST_HH_
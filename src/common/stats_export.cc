@@ -0,0 +1,46 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/stats_export.hh"
+
+#include <algorithm>
+
+#include "common/log.hh"
+
+namespace alps {
+
+bool heap_stats_export = StatsOptions().export_heap_stats;
+
+size_t heap_stats_export_interval_ms = StatsOptions().export_interval_ms;
+
+std::string heap_trace_dir = StatsOptions().trace_dir;
+
+bool heap_lock_profile = StatsOptions().lock_profile;
+
+void init_stats_export(const StatsOptions& options)
+{
+    heap_stats_export = options.export_heap_stats;
+    heap_stats_export_interval_ms = std::max<size_t>(options.export_interval_ms, 1);
+    LOG(info) << "Heap statistics export: " << (heap_stats_export ? "on" : "off")
+              << " interval: " << heap_stats_export_interval_ms << "ms";
+    heap_trace_dir = options.trace_dir;
+    if (!heap_trace_dir.empty()) {
+        LOG(info) << "Heap allocation traces: " << heap_trace_dir;
+    }
+    heap_lock_profile = options.lock_profile;
+}
+
+} // namespace alps
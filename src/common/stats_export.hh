@@ -0,0 +1,55 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_COMMON_STATS_EXPORT_HH_
+#define _ALPS_COMMON_STATS_EXPORT_HH_
+
+#include <stddef.h>
+#include <string>
+
+#include "alps/common/stats_options.hh"
+
+namespace alps {
+
+/**
+ * @brief Whether open heaps publish their statistics in shared memory
+ * (see StatsOptions::export_heap_stats)
+ */
+extern bool heap_stats_export;
+
+/**
+ * @brief Publication interval of exported heap statistics
+ * (see StatsOptions::export_interval_ms)
+ */
+extern size_t heap_stats_export_interval_ms;
+
+/**
+ * @brief Directory where open heaps record allocation traces, empty if
+ * tracing is off (see StatsOptions::trace_dir)
+ */
+extern std::string heap_trace_dir;
+
+/**
+ * @brief Whether allocator locks are profiled from startup 
+ * (see StatsOptions::lock_profile)
+ */
+extern bool heap_lock_profile;
+
+void init_stats_export(const StatsOptions& options);
+
+} // namespace alps
+
+#endif // _ALPS_COMMON_STATS_EXPORT_HH_
@@ -18,6 +18,7 @@
 #define _ALPS_BITMAP_HH_
 
 #include <stdint.h>
+#include <string.h>
 
 
 struct BitMap {
@@ -69,6 +70,29 @@ struct BitMap {
     bool is_set(int bit_index) {
         return (bv_[elt(bit_index)] & mask(bit_index)) != 0;
     }
+
+    /**
+     * @brief Count the bits set among the first @a bitmap_len bits, a 
+     * 64-bit word at a time
+     */
+    size_t count(size_t bitmap_len) {
+        size_t cnt = 0;
+        size_t nbytes = bitmap_len / kEntrySize;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= nbytes; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, &bv_[i], sizeof(word));
+            cnt += __builtin_popcountll(word);
+        }
+        for (; i < nbytes; i++) {
+            cnt += __builtin_popcount(bv_[i]);
+        }
+        size_t tail = bitmap_len % kEntrySize;
+        if (tail) {
+            cnt += __builtin_popcount(bv_[nbytes] & ((1U << tail) - 1));
+        }
+        return cnt;
+    }
 };
 
 #endif // _ALPS_BITMAP_HH_
@@ -27,6 +27,7 @@ namespace alps {
 
 ExtentHeap::ExtentHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation)
     : ZoneHeap(nvheap, generation),
+      block_size_(nvheap->block_size()),
       last_alloc_zone_(NULL) 
 { 
     assert(pthread_mutex_init(&mutex_, 0) == 0);
@@ -34,6 +35,7 @@ ExtentHeap::ExtentHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation)
 
 ExtentHeap::ExtentHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation, const MemAttrib& memattrib)
     : ZoneHeap(nvheap, generation, memattrib),
+      block_size_(nvheap->block_size()),
       last_alloc_zone_(NULL) 
 { 
     assert(pthread_mutex_init(&mutex_, 0) == 0);
@@ -74,9 +76,32 @@ ErrorCode ExtentHeap::alloc_extent(size_t size_nblocks, Zone* zone_hint, RRegion
 
 void ExtentHeap::free(Zone* zone, RRegion::TPtr<void> nvex)
 {
-    pthread_mutex_lock(&mutex_);
+    stats_mutex_lock(&mutex_, &stats_, kLockSiteExtentHeap);
     zone->free_extent(nvex);
+    HEAP_STATS(stats_.large_frees++);
     pthread_mutex_unlock(&mutex_);
 }
 
+void ExtentHeap::space(size_t* free_nblocks, size_t* total_nblocks)
+{
+    *free_nblocks = 0;
+    *total_nblocks = 0;
+    stats_mutex_lock(&mutex_, &stats_, kLockSiteExtentHeap);
+    rwlock_.lock_read();
+    for (ZoneSet::iterator it = zones_.begin(); it != zones_.end(); it++) {
+        *free_nblocks += (*it)->fsmap()->nblocks();
+        *total_nblocks += (*it)->nvzone()->nblocks();
+    }
+    rwlock_.unlock_read();
+    pthread_mutex_unlock(&mutex_);
+}
+
+void ExtentHeap::stats(HeapStats* stats)
+{
+    stats_mutex_lock(&mutex_, &stats_, kLockSiteExtentHeap);
+    stats_.add_to(stats);
+    pthread_mutex_unlock(&mutex_);
+    ZoneHeap::stats(stats);
+}
+
 } // namespace alps
@@ -67,6 +67,26 @@ public:
      * 
      */ 
     template<typename T> int more_space(int nzones, T callback);
+
+    /**
+     * @brief Add the statistics counters of this heap and its zone heap 
+     * to @a stats 
+     */
+    void stats(HeapStats* stats);
+
+    /**
+     * @brief Count the free blocks and all blocks of the zones this heap 
+     * owns
+     */
+    void space(size_t* free_nblocks, size_t* total_nblocks);
+
+    /**
+     * @brief Return the size of the blocks extents are made of
+     */
+    size_t block_size() const
+    {
+        return block_size_;
+    }
     
 private:
     /**
@@ -81,7 +101,9 @@ private:
 
 private:
     pthread_mutex_t  mutex_;
+    size_t           block_size_; // block size of the heap, same in all zones
     Zone*            last_alloc_zone_; // zone that served the latest allocation request
+    StatsCounters    stats_; // updated under mutex_
 };
 
 template<typename T> 
@@ -115,10 +137,10 @@ ErrorCode ExtentHeap::malloc(size_t size_bytes, bool can_extend, T callback, RRe
 
     LOG(info) << "malloc";
 
-    pthread_mutex_lock(&mutex_);
+    stats_mutex_lock(&mutex_, &stats_, kLockSiteExtentHeap);
 
     // round up to next multiple of block_size
-    size_t size_nblocks = size_bytes / nvZone::block_size() + (size_bytes % nvZone::block_size() ? 1: 0);
+    size_t size_nblocks = size_bytes / block_size_ + (size_bytes % block_size_ ? 1: 0);
 
     // ALLOCATION POLICY: 
     // Try to allocate from zones that the extent-heap already owns. 
@@ -142,6 +164,7 @@ ErrorCode ExtentHeap::malloc(size_t size_bytes, bool can_extend, T callback, RRe
         }
     }
     if (rc == kErrorCodeOk) {
+        HEAP_STATS(stats_.extent_allocations++);
         last_alloc_zone_ = zone;
     }
     pthread_mutex_unlock(&mutex_);
@@ -164,7 +187,7 @@ inline RRegion::TPtr<void> ExtentHeap::malloc(size_t size_bytes)
 template<typename T>
 void ExtentHeap::free(RRegion::TPtr<void> nvex, T callback)
 {
-    pthread_mutex_lock(&mutex_);
+    stats_mutex_lock(&mutex_, &stats_, kLockSiteExtentHeap);
 
     // find the extent's zone
     size_t metazone_size = nvheap_->metazone_size();
@@ -172,6 +195,7 @@ void ExtentHeap::free(RRegion::TPtr<void> nvex, T callback)
     Zone* zone = acquire_zone(zone_id, callback);
     if (zone) {
         zone->free_extent(nvex);
+        HEAP_STATS(stats_.large_frees++);
     } else {
         LOG(error) << "Attempt to free unknown address: " << nvex << std::endl;
     }
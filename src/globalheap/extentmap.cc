@@ -24,6 +24,7 @@
 #include "alps/common/error_code.hh"
 
 #include "common/debug.hh"
+#include "common/event_trace.hh"
 #include "extent.hh"
 
 namespace alps {
@@ -86,6 +87,7 @@ std::pair<ExtentMap::MapAddr::iterator, Extent*> ExtentMap::next_addr(const Exte
 void ExtentMap::insert(const Extent& e) 
 {
     LOG(info) << "INSERT: " << e;
+    TRACE_EVENT(kEventExtentInsert, e.start(), e.len());
 
     MapAddr::iterator it_hint = map_addr_.lower_bound(e.start());
 
@@ -68,6 +68,18 @@ public:
      */
     size_t size() const { return map_addr_.size();  }
 
+    /**
+     * @brief Returns the total length of the extents indexed by this ExtentMap
+     */
+    size_t nblocks() const 
+    {
+        size_t nblocks = 0;
+        for (MapAddr::const_iterator it = map_addr_.begin(); it != map_addr_.end(); it++) {
+            nblocks += it->second->len();
+        }
+        return nblocks;
+    }
+
     /**
      * @brief Stream the list of extents ordered by start address to os 
      */
@@ -66,6 +66,27 @@ int GlobalHeap::create(const char** paths, int npaths, size_t heap_size, size_t
     return 0;
 }
 
+int GlobalHeap::create(const char* path, size_t heap_size, size_t metazone_size, const std::vector<size_t>& size_classes, GlobalHeap** heap)
+{
+    return create(path, heap_size, metazone_size, BLOCK_SIZE, size_classes, heap);
+}
+
+int GlobalHeap::create(const char* path, size_t heap_size, size_t metazone_size, size_t block_size, const std::vector<size_t>& size_classes, GlobalHeap** heap)
+{
+    int ret;
+    GlobalHeapInternal* iheap;
+    std::vector<boost::filesystem::path> paths{boost::filesystem::path(path)};
+
+    if ((ret = GlobalHeapInternal::create(paths, heap_size, metazone_size, block_size, size_classes, &iheap)) != 0) {
+        return ret;
+    }
+    
+    GlobalHeap* gh = new GlobalHeap(iheap);
+    *heap = gh;
+
+    return 0;
+}
+
 int GlobalHeap::open(const char* path, GlobalHeap** heap)
 {
     int ret;
@@ -161,6 +182,21 @@ RRegion::TPtr<void> GlobalHeap::realloc(RRegion::TPtr<void> ptr, size_t size)
     return globalheap_internal_->realloc(ptr, size);
 }
 
+int GlobalHeap::reserve(size_t size, size_t count)
+{
+    return globalheap_internal_->reserve(size, count);
+}
+
+int GlobalHeap::reserve(size_t size, size_t count, const MemAttrib& memattrib)
+{
+    return globalheap_internal_->reserve(size, count, memattrib);
+}
+
+HeapStats GlobalHeap::stats()
+{
+    return globalheap_internal_->stats();
+}
+
 RRegion* GlobalHeap::region()
 {
     return globalheap_internal_->region();
@@ -19,8 +19,11 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <numa.h>
+#include <algorithm>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <map>
 #include <assert.h>
 
 #include "alps/common/assert_nd.hh"
@@ -28,13 +31,21 @@
 #include "alps/pegasus/relocatable_region.hh"
 
 #include "common/debug.hh"
+#include "common/event_trace.hh"
+#include "common/maintenance.hh"
+#include "common/persist.hh"
+#include "common/stats_export.hh"
 #include "pegasus/region_file.hh"
 #include "globalheap/extentheap.hh"
 #include "globalheap/helper.hh"
 #include "globalheap/layout.hh"
+#include "globalheap/lock_profile.hh"
+#include "globalheap/maintainer.hh"
 #include "globalheap/lease.hh"
 #include "globalheap/process_slab_heap.hh"
+#include "globalheap/stats_segment.hh"
 #include "globalheap/thread_slab_heap.hh"
+#include "globalheap/trace.hh"
 
 
 namespace alps {
@@ -54,7 +65,10 @@ std::string paths_to_string(const std::vector<boost::filesystem::path>& pathname
 GlobalHeapInternal::GlobalHeapInternal(const std::vector<boost::filesystem::path>& pathnames, RRegion* region, RRegion::TPtr<nvHeap> nvheap)
     : pathnames_(pathnames),
       region_(region),
-      nvheap_(nvheap)
+      nvheap_(nvheap),
+      stats_publisher_(NULL),
+      trace_recorder_(NULL),
+      maintainer_(NULL)
 { 
     size_ = nvheap->size();
 }
@@ -98,14 +112,30 @@ void store_ig(RRegion* region, RRegion::TPtr<nvHeap> nvheap)
 }
 
 int GlobalHeapInternal::create(const std::vector<boost::filesystem::path>& pathnames, size_t heap_size, size_t metazone_size, GlobalHeapInternal** heap)
+{
+    return GlobalHeapInternal::create(pathnames, heap_size, metazone_size, BLOCK_SIZE, std::vector<size_t>(), heap);
+}
+
+int GlobalHeapInternal::create(const std::vector<boost::filesystem::path>& pathnames, size_t heap_size, size_t metazone_size, size_t block_size, const std::vector<size_t>& size_classes, GlobalHeapInternal** heap)
 {
     RRegion* region;
+    SizeClassTable table;
 
-    LOG(info) << "Create heap path: " << paths_to_string(pathnames) << " size: "<< heap_size << " metazone_size: " << metazone_size;
+    LOG(info) << "Create heap path: " << paths_to_string(pathnames) << " size: "<< heap_size << " metazone_size: " << metazone_size << " block_size: " << block_size
+              << " separate_slab_meta: " << slab_metadata_separate;
 
+    // no size classes means the default ones
+    if (!size_classes.empty() && table.set(size_classes) != 0) {
+        return -1;
+    }
+    if (!nvHeap::valid_block_size(block_size, metazone_size)) {
+        return -1;
+    }
     COERCE_ERROR_CODE(create_region(pathnames, heap_size, metazone_size));
     COERCE_ERROR_CODE(map_region(pathnames, &region));
-    RRegion::TPtr<nvHeap> nvheap = nvHeap::make(region->base<nvHeap>(0x0), heap_size, metazone_size);
+    // zone block headers are formatted below, once zones know their 
+    // interleave group 
+    RRegion::TPtr<nvHeap> nvheap = nvHeap::make(region->base<nvHeap>(0x0), heap_size, metazone_size, table, block_size, slab_metadata_separate, true);
 
     if (nvheap == null_ptr) {
         return -1;
@@ -113,6 +143,7 @@ int GlobalHeapInternal::create(const std::vector<boost::filesystem::path>& pathn
 
     // store interleave-group information into each zone
     store_ig(region, nvheap);
+    format_blocks(nvheap);
 
     // TODO: just for TM: persist heap metadata
 
@@ -158,7 +189,11 @@ int GlobalHeapInternal::open(const std::vector<boost::filesystem::path>& pathnam
     LOG(info) << "Opened heap path: " << paths_to_string(pathnames) << " size: " << nvheap->size();
 
     GlobalHeapInternal* gh = new GlobalHeapInternal(pathnames, region, nvheap);
-    ASSERT_ND(gh->init() == 0);
+    if (gh->init() != 0) {
+        delete gh;
+        assert(kErrorCodeOk == Pegasus::address_space()->unmap(region));
+        return -1;
+    }
     *heap = gh;
 
     return 0;
@@ -238,6 +273,7 @@ int GlobalHeapInternal::format(const std::vector<boost::filesystem::path>& pathn
             return ret;
         }
     }
+    format_blocks(nvheap);
 
     assert(kErrorCodeOk == Pegasus::address_space()->unmap(region));
     return 0;
@@ -253,14 +289,17 @@ int GlobalHeapInternal::format_instance(const std::vector<boost::filesystem::pat
     COERCE_ERROR_CODE(map_region(pathnames, &region));
     RRegion::TPtr<nvHeap> nvheap = region->base<nvHeap>(0x0);
 
+    std::vector<ZoneId> zone_ids;
     for (size_t zid=0; zid<nvheap->nzones(); zid++) {
         if (instance_id == nvheap->zone(zid)->header.lease.lock_status()) {
             if ((ret = format_zone(nvheap, zid, false)) != 0) {
                 assert(kErrorCodeOk == Pegasus::address_space()->unmap(region));
                 return ret;
             }
+            zone_ids.push_back(zid);
         }
     }
+    format_blocks(nvheap, zone_ids);
 
     assert(kErrorCodeOk == Pegasus::address_space()->unmap(region));
     return 0;
@@ -290,6 +329,7 @@ int GlobalHeapInternal::format(const std::vector<boost::filesystem::path>& pathn
             return ret;
         }
     }
+    format_blocks(nvheap, zone_ids);
 
     assert(kErrorCodeOk == Pegasus::address_space()->unmap(region));
     return 0;
@@ -299,22 +339,105 @@ int GlobalHeapInternal::format_zone(RRegion::TPtr<nvHeap> nvheap, ZoneId zone_id
 {
     LOG(info) << "Format heap zone: " << zone_id;
 
+    // formatting keeps the block size, the slab metadata placement and 
+    // the size classes the heap was created with
+    size_t block_log2size = nvheap->block_log2size();
+    bool separate_slab_meta = nvheap->separate_slab_meta();
     if (format_heap_header) {
         size_t heapsize = nvheap->size();
         size_t metazone_log2size = nvheap->metazone_log2size();
-        nvHeapHeader::make(&nvheap->metazone(zone_id)->heapheader, heapsize, metazone_log2size); 
+        SizeClassTable size_classes;
+        if (nvheap->header()->load_size_classes(&size_classes) != 0) {
+            LOG(error) << "Corrupt size classes in heap header";
+            return -1;
+        }
+        nvHeapHeader::make(&nvheap->metazone(zone_id)->heapheader, heapsize, metazone_log2size, block_log2size, separate_slab_meta, size_classes); 
     }
-    size_t metazone_size = nvheap->metazone_size();
+    // block headers are formatted by format_blocks() 
     size_t metazone_log2size = nvheap->metazone_log2size();
-    nvZone::make(nvheap->zone(zone_id), metazone_size, metazone_log2size); 
+    nvZone::make(nvheap->zone(zone_id), nvMetaZone::zone_size(metazone_log2size), metazone_log2size, block_log2size, 
+                 separate_slab_meta, true); 
 
     return 0;
 }
 
+static void format_blocks_thread(RRegion::TPtr<nvHeap> nvheap, InterleaveGroup ig, 
+                                 const std::vector<ZoneId>* zone_ids, std::atomic<size_t>* next)
+{
+    // interleave groups of tmpfs heaps are NUMA nodes; on other 
+    // topologies the thread may just run anywhere
+    if (numa_available() >= 0 && ig <= numa_max_node()) {
+        numa_run_on_node(ig);
+    }
+    for (size_t i; (i = next->fetch_add(1)) < zone_ids->size(); ) {
+        nvheap->zone((*zone_ids)[i])->format_blocks();
+    }
+}
+
+void GlobalHeapInternal::format_blocks(RRegion::TPtr<nvHeap> nvheap, const std::vector<ZoneId>& zone_ids)
+{
+    if (format_lazy) {
+        LOG(info) << "Defer formatting " << zone_ids.size() << " zones to first lease";
+        return;
+    }
+
+    // zones are formatted by threads running near their memory
+    std::map<InterleaveGroup, std::vector<ZoneId> > groups;
+    for (std::vector<ZoneId>::const_iterator it = zone_ids.begin(); it != zone_ids.end(); it++) {
+        groups[nvheap->zone(*it)->header.ig].push_back(*it);
+    }
+    if (groups.empty()) {
+        return;
+    }
+    size_t nthreads = format_threads ? format_threads : std::thread::hardware_concurrency();
+    size_t group_nthreads = std::max<size_t>(nthreads / groups.size(), 1);
+
+    LOG(info) << "Format " << zone_ids.size() << " zones with " << group_nthreads 
+              << " threads per interleave group";
+
+    std::vector<std::atomic<size_t> > next(groups.size());
+    std::vector<std::thread> threads;
+    size_t g = 0;
+    for (std::map<InterleaveGroup, std::vector<ZoneId> >::iterator it = groups.begin(); it != groups.end(); it++, g++) {
+        next[g] = 0;
+        for (size_t i = 0; i < std::min(group_nthreads, it->second.size()); i++) {
+            threads.push_back(std::thread(format_blocks_thread, nvheap, it->first, &it->second, &next[g]));
+        }
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+}
+
+void GlobalHeapInternal::format_blocks(RRegion::TPtr<nvHeap> nvheap)
+{
+    std::vector<ZoneId> zone_ids;
+    for (size_t zid=0; zid<nvheap->nzones(); zid++) {
+        zone_ids.push_back(zid);
+    }
+    format_blocks(nvheap, zone_ids);
+}
+
 int GlobalHeapInternal::close()
 {
     LOG(info) << "Close heap path: " << paths_to_string(pathnames_);
 
+    if (maintainer_) {
+        maintainer_->teardown();
+        delete maintainer_;
+        maintainer_ = NULL;
+    }
+
+    if (stats_publisher_) {
+        stats_publisher_->teardown();
+        delete stats_publisher_;
+        stats_publisher_ = NULL;
+    }
+    if (trace_recorder_) {
+        trace_recorder_->teardown();
+        delete trace_recorder_;
+        trace_recorder_ = NULL;
+    }
     assert(teardown() == 0);
     assert(kErrorCodeOk == Pegasus::address_space()->unmap(region_));
     assert(kErrorCodeOk == region_->file()->close());
@@ -323,10 +446,40 @@ int GlobalHeapInternal::close()
 
 int GlobalHeapInternal::init()
 {
+    if (nvheap_->header()->load_size_classes(&size_classes_) != 0) {
+        LOG(error) << "Corrupt size classes in heap header: " << paths_to_string(pathnames_);
+        return -1;
+    }
     if (Pegasus::topology_factory()->construct(pathnames_[0], &topology_) != kErrorCodeOk) {
         return -1;
     }
     generation_ = nvheap_->header()->lease_superblock.incr_generation();
+    if (heap_stats_export) {
+        StatsPublisher* publisher = new StatsPublisher(this, stats_heap_path(pathnames_), generation_, heap_stats_export_interval_ms);
+        if (publisher->init() != 0) {
+            // monitoring is best effort and must not prevent using the heap
+            LOG(warning) << "Cannot export statistics of heap: " << paths_to_string(pathnames_);
+            delete publisher;
+        } else {
+            stats_publisher_ = publisher;
+        }
+    }
+    if (!heap_trace_dir.empty()) {
+        TraceRecorder* recorder = new TraceRecorder(heap_trace_dir, generation_, size_, nvheap_->metazone_size());
+        if (recorder->init() != 0) {
+            LOG(warning) << "Cannot trace allocations of heap: " << paths_to_string(pathnames_);
+            delete recorder;
+        } else {
+            trace_recorder_ = recorder;
+        }
+    }
+    if (heap_lock_profile) {
+        set_lock_profile(true);
+    }
+    if (heap_maintenance) {
+        maintainer_ = new HeapMaintainer(this, heap_maintenance_interval_ms, heap_free_space_watermark, heap_prepared_slabs);
+        maintainer_->init();
+    }
     return 0;
 }
 
@@ -343,6 +496,37 @@ int GlobalHeapInternal::teardown()
     return 0;
 }
 
+HeapStats GlobalHeapInternal::stats()
+{
+    HeapStats stats;
+
+    std::fill(stats.class_size.begin(), stats.class_size.end(), 0);
+    for (int i = 0; i < size_classes_.nclasses(); i++) {
+        stats.class_size[i] = size_classes_.size_from_class(i);
+    }
+    memattrib_heaps_.lock_read();
+    for (MemAttribAllocators<MemAttribHeap>::iterator it = memattrib_heaps_.begin();
+         it != memattrib_heaps_.end();
+         it++) 
+    {
+        it->second->stats(&stats);
+    }
+    memattrib_heaps_.unlock_read();
+    return stats;
+}
+
+void GlobalHeapInternal::maintain(size_t free_space_watermark, size_t prepared_slabs)
+{
+    memattrib_heaps_.lock_read();
+    for (MemAttribAllocators<MemAttribHeap>::iterator it = memattrib_heaps_.begin();
+         it != memattrib_heaps_.end();
+         it++) 
+    {
+        it->second->maintain(free_space_watermark, prepared_slabs);
+    }
+    memattrib_heaps_.unlock_read();
+}
+
 GlobalHeapInternal::InstanceId GlobalHeapInternal::instance()
 {
     return generation_;
@@ -358,7 +542,7 @@ MemAttribHeap* GlobalHeapInternal::find_or_bind(const MemAttrib& memattrib)
         // make sure no one else added the memory attrib in the meantime
         heap = memattrib_heaps_.find(memattrib);
         if (!heap) {
-            heap = new MemAttribHeap(nvheap_, generation_, memattrib);
+            heap = new MemAttribHeap(nvheap_, generation_, memattrib, &size_classes_);
             if (heap->init() != kErrorCodeOk) {
                 delete heap;
                 memattrib_heaps_.unlock_write();
@@ -387,15 +571,33 @@ RRegion::TPtr<void> GlobalHeapInternal::malloc(size_t size)
     {
         MemAttrib memattrib(ig);
         RRegion::TPtr<void> tptr;
-        if ((tptr = malloc(size, memattrib)) != null_ptr) {
+        if ((tptr = heap_malloc(size, memattrib)) != null_ptr) {
             LOG(info) << "Allocated block ptr: " << tptr << " size: " << size;
+            TRACE_EVENT(kEventMalloc, size, tptr.offset());
+            if (trace_recorder_) {
+                trace_recorder_->record(TraceRecord::kOpMalloc, TraceRecord::kAnyIg, size, tptr);
+            }
             return tptr;
         }
     }
+    if (trace_recorder_) {
+        trace_recorder_->record(TraceRecord::kOpMalloc, TraceRecord::kAnyIg, size, null_ptr);
+    }
+    TRACE_EVENT(kEventMalloc, size, 0);
     return null_ptr;
 }
 
 RRegion::TPtr<void> GlobalHeapInternal::malloc(size_t size, const MemAttrib& memattrib)
+{
+    RRegion::TPtr<void> tptr = heap_malloc(size, memattrib);
+    TRACE_EVENT(kEventMalloc, size, tptr == null_ptr ? 0 : tptr.offset());
+    if (trace_recorder_) {
+        trace_recorder_->record(TraceRecord::kOpMalloc, memattrib.ig, size, tptr);
+    }
+    return tptr;
+}
+
+RRegion::TPtr<void> GlobalHeapInternal::heap_malloc(size_t size, const MemAttrib& memattrib)
 {
     LOG(info) << "Allocate block size: " << size << " " << memattrib;
 
@@ -413,11 +615,34 @@ void GlobalHeapInternal::free(RRegion::TPtr<void> ptr)
 
     LOG(info) << "Free ptr: " << ptr << " zone: " << nvZone::zone_id(nvheap_, nvzone) << " nvzone: " << nvzone << " " << memattrib;
 
+    // record before the block can be handed out again
+    TRACE_EVENT(kEventFree, ptr.offset(), 0);
+    if (trace_recorder_) {
+        trace_recorder_->record(TraceRecord::kOpFree, TraceRecord::kAnyIg, 0, ptr);
+    }
+
     MemAttribHeap* heap = find_or_bind(memattrib);
     assert(heap != NULL);
     return heap->free(ptr);
 }
 
+int GlobalHeapInternal::reserve(size_t size, size_t count)
+{
+    // malloc prefers the nearest interleave group
+    return reserve(size, count, MemAttrib(topology_->nearest_ig()));
+}
+
+int GlobalHeapInternal::reserve(size_t size, size_t count, const MemAttrib& memattrib)
+{
+    LOG(info) << "Reserve block size: " << size << " count: " << count << " " << memattrib;
+
+    MemAttribHeap* heap = find_or_bind(memattrib);
+    if (!heap) {
+        return -1;
+    }
+    return heap->reserve(size, count);
+}
+
 RRegion::TPtr<void> GlobalHeapInternal::realloc(RRegion::TPtr<void> ptr, size_t size)
 {
     RRegion::TPtr<nvZone> nvzone = nvheap_->zone(ptr);
@@ -429,8 +654,14 @@ RRegion::TPtr<void> GlobalHeapInternal::realloc(RRegion::TPtr<void> ptr, size_t
 
     LOG(info) << "Realloc ptr: " << ptr << " zone: " << nvZone::zone_id(nvheap_, nvzone) << " " << memattrib << " new_size: " << size;
     RRegion::TPtr<void> new_ptr = heap->malloc(size);
+    if (trace_recorder_) {
+        trace_recorder_->record(TraceRecord::kOpMalloc, memattrib.ig, size, new_ptr);
+    }
     if (new_ptr != null_ptr) {
         memcpy(new_ptr.get(), ptr.get(), size);
+        if (trace_recorder_) {
+            trace_recorder_->record(TraceRecord::kOpFree, TraceRecord::kAnyIg, 0, ptr);
+        }
         heap->free(ptr);
     }
     return new_ptr;
@@ -24,6 +24,7 @@
 
 #include "alps/pegasus/pegasus.hh"
 #include "alps/pegasus/relocatable_region.hh"
+#include "alps/globalheap/heap_stats.hh"
 #include "alps/globalheap/memattrib.hh"
 
 #include "pegasus/topology.hh"
@@ -34,6 +35,11 @@
 
 namespace alps {
 
+// forward declarations
+class HeapMaintainer;
+class StatsPublisher;
+class TraceRecorder;
+
 typedef size_t ZoneId;
 
 
@@ -57,6 +63,7 @@ public:
 
     static int create(const boost::filesystem::path& pathname, size_t heap_size, size_t metazone_size, GlobalHeapInternal** heap);
     static int create(const std::vector<boost::filesystem::path>& pathnames, size_t heap_size, size_t metazone_size, GlobalHeapInternal** heap);
+    static int create(const std::vector<boost::filesystem::path>& pathnames, size_t heap_size, size_t metazone_size, size_t block_size, const std::vector<size_t>& size_classes, GlobalHeapInternal** heap);
     static int open(const boost::filesystem::path& pathname, GlobalHeapInternal** heap);
     static int open(const std::vector<boost::filesystem::path>& pathnames, GlobalHeapInternal** heap);
     static int format(const boost::filesystem::path& pathname);
@@ -76,7 +83,16 @@ public:
     RRegion::TPtr<void> malloc(size_t size, const MemAttrib& memattrib);
     void free(RRegion::TPtr<void> ptr);
     RRegion::TPtr<void> realloc(RRegion::TPtr<void> ptr, size_t size);
+    int reserve(size_t size, size_t count);
+    int reserve(size_t size, size_t count, const MemAttrib& memattrib);
+    HeapStats stats();
     int close();
+
+    /**
+     * @brief Do allocator housekeeping for all memory attributes in use
+     * (see MemAttribHeap::maintain)
+     */
+    void maintain(size_t free_space_watermark, size_t prepared_slabs);
     
     size_t size()
     {
@@ -91,11 +107,42 @@ public:
         return region_;
     }
 
+    const SizeClassTable& size_classes() {
+        return size_classes_;
+    }
+
+    /**
+     * @brief Returns the publisher of the statistics of this heap instance,
+     * or NULL if statistics are not exported (see StatsOptions)
+     */
+    StatsPublisher* stats_publisher() {
+        return stats_publisher_;
+    }
+
+    /**
+     * @brief Returns the recorder of the allocation trace of this heap 
+     * instance, or NULL if allocations are not traced (see StatsOptions)
+     */
+    TraceRecorder* trace_recorder() {
+        return trace_recorder_;
+    }
+
+    /**
+     * @brief Returns the background maintenance thread of this heap 
+     * instance, or NULL if there is none (see MaintenanceOptions)
+     */
+    HeapMaintainer* maintainer() {
+        return maintainer_;
+    }
+
 private:
     GlobalHeapInternal(const std::vector<boost::filesystem::path>& pathnames, RRegion* region, RRegion::TPtr<nvHeap> nvheap);
     static int format_zone(RRegion::TPtr<nvHeap> nvheap, ZoneId zone_id, bool format_heap_header);
+    static void format_blocks(RRegion::TPtr<nvHeap> nvheap, const std::vector<ZoneId>& zone_ids);
+    static void format_blocks(RRegion::TPtr<nvHeap> nvheap);
     int teardown();
     MemAttribHeap* find_or_bind(const MemAttrib& memattrib);
+    RRegion::TPtr<void> heap_malloc(size_t size, const MemAttrib& memattrib);
 
 protected:
 
@@ -103,9 +150,13 @@ protected:
     RRegion*                              region_;
     RRegion::TPtr<nvHeap>                 nvheap_;
     size_t                                size_;
+    SizeClassTable                        size_classes_;
     Generation                            generation_;
     MemAttribAllocators<MemAttribHeap>    memattrib_heaps_;
     Topology*                             topology_;
+    StatsPublisher*                       stats_publisher_;
+    TraceRecorder*                        trace_recorder_;
+    HeapMaintainer*                       maintainer_;
 };
 
 
@@ -29,6 +29,14 @@ size_t find_extent(RRegion::TPtr<nvZone> nvzone, size_t start, size_t end, Exten
     size_t ext_start = start;
     size_t ext_end = start;
 
+    // block headers of a format-pending zone are not formatted yet but 
+    // all its blocks are free
+    if (nvzone->format_pending()) {
+        *extent_is_free = start < end;
+        *extent = Extent(start, end - start);
+        return start;
+    }
+
     *extent_is_free = false;
     for (i=start; i<end; i++) {
         RRegion::TPtr<nvBlockHeader> bh = nvzone->block_header(i);
@@ -25,15 +25,18 @@
 #include "common/debug.hh"
 #include "globalheap/lease.hh"
 #include "globalheap/persist.hh"
+#include "globalheap/size_class_table.hh"
 
 namespace alps {
 
-#define BLOCK_LOG2SIZE 18                         /* 256 kilobytes */
+#define BLOCK_LOG2SIZE 18                         /* 256 kilobytes, default block size */
 #define BLOCK_SIZE ((size_t) 1 << BLOCK_LOG2SIZE)  
+#define MIN_BLOCK_LOG2SIZE 16                     /* 64 kilobytes */
+#define MAX_BLOCK_LOG2SIZE 22                     /* 4 megabytes */
 
 
 struct nvBlock {
-    uint8_t data[BLOCK_SIZE];
+    uint8_t data[0]; // nvZoneHeader::blocksize bytes
 };
 
 struct nvBlockHeader {
@@ -44,11 +47,19 @@ struct nvBlockHeader {
         kBlockTypeExtentRun = 3,   // run block of an extent 
     };
 
-    static RRegion::TPtr<nvBlockHeader> make(RRegion::TPtr<nvBlockHeader> header, uint16_t primary_type)
+    static RRegion::TPtr<nvBlockHeader> make(RRegion::TPtr<nvBlockHeader> header, uint16_t primary_type, PersistContext& ctx)
     {
         header->primary_type = kBlockTypeFree;
         header->secondary_type = 0;
-        persist((void*)&header, sizeof(nvBlockHeader));
+        ctx.add(header.get(), sizeof(nvBlockHeader));
+        return header;
+    }
+
+    static RRegion::TPtr<nvBlockHeader> make(RRegion::TPtr<nvBlockHeader> header, uint16_t primary_type)
+    {
+        PersistContext ctx;
+        make(header, primary_type, ctx);
+        ctx.commit();
         return header;
     }
 
@@ -70,20 +81,26 @@ struct nvExtentHeader: public nvBlockHeader {
 
     void mark_alloc(uint32_t nblocks)
     {
+        PersistContext ctx;
         size = nblocks;
         nvBlockHeader* this_bh = reinterpret_cast<nvBlockHeader*>(this);
         for (uint32_t i=1; i<nblocks; i++) {
             nvBlockHeader* bh = this_bh+i;
             bh->primary_type = nvBlockHeader::kBlockTypeExtentRun;
-            persist((void*) &bh->primary_type, sizeof(bh->primary_type));
+            ctx.add(&bh->primary_type, sizeof(bh->primary_type));
         }
+        // Run headers must be durable before the linearization point.
+        // Consecutive headers share cache lines so this costs one flush 
+        // per cache line and a single fence.
+        ctx.commit();
 
         // Linearization point (with respect to failures)
         // 
         // Persisting the primary_type of the first block is a single atomic 
         // step that identifies the block group as an extent run.
         this_bh->primary_type = nvBlockHeader::kBlockTypeExtentFirst;
-        persist((void*) &this_bh->primary_type, sizeof(this_bh->primary_type));
+        ctx.add(this_bh, sizeof(nvBlockHeader));
+        ctx.commit();
     }
 
     void mark_free()
@@ -110,7 +127,11 @@ struct nvZoneHeader {
     uint64_t     blocks_per_zone;
     Zone*        zone; // pointer to the zone's volatile descriptor for quick lookup
     uint8_t      ig; // interleave group
-    uint8_t      reserved[23];
+    uint8_t      format_pending; // 1 if block headers are formatted when the zone is first leased
+    uint8_t      reserved0[2];
+    uint32_t     slab_meta_size;   // size of the per-block slab metadata slots, 0 if slab headers precede their blocks
+    uint64_t     slab_meta_offset; // offset of the slab metadata slots in the zone payload
+    uint8_t      reserved[8];
     // second cacheline
     struct Lease lease; // must be cache aligned
 };
@@ -118,43 +139,101 @@ struct nvZoneHeader {
 static_assert(sizeof(nvZoneHeader) == 128, "nvZoneHeader must be multiple of cache-line size");
 
 struct nvZone {
-    static RRegion::TPtr<nvZone> make(RRegion::TPtr<nvZone> nvzone, size_t zone_size, size_t metazone_log2size)
+    /**
+     * @brief Return the size of the slab metadata slot of each block of 
+     * @a block_size
+     *
+     * @details
+     * A slot holds the bitmap of a slab of blocks of the smallest size 
+     * class spanning the block, and one cache line for the slab header 
+     * fields. A slab spanning several blocks uses the slots of all of them.
+     */
+    static size_t slab_meta_slot_size(size_t block_size)
     {
+        return block_size / (8 * SizeClassTable::kAlignment) + kCacheLineSize;
+    }
+
+    /**
+     * @brief Format the zone header of @a nvzone
+     *
+     * @details
+     * Block headers are formatted too unless @a lazy_format, in which case
+     * the zone is marked format-pending and format_blocks() must run 
+     * before the block headers are read. Lazy formatting makes formatting 
+     * a large heap proportional to its number of zones instead of its 
+     * number of blocks.
+     */
+    static RRegion::TPtr<nvZone> make(RRegion::TPtr<nvZone> nvzone, size_t zone_size, size_t metazone_log2size, size_t block_log2size, 
+                                      bool separate_slab_meta, bool lazy_format = false)
+    {
+        size_t block_size = 1LLU << block_log2size;
+        size_t slab_meta_size = separate_slab_meta ? slab_meta_slot_size(block_size) : 0;
         // Calculate number of blocks that can fit in the zone and set 
         // the block_header and block pointers accordingly.
         // The first block must be aligned at cache-line multiple so that it
-        // doesn't share a cacheline with the last block-header. 
+        // doesn't share a cacheline with the last block-header or slab 
+        // metadata slot. 
         size_t effective_zone_size = zone_size - sizeof(nvZone);
-        size_t max_nblocks = effective_zone_size / (sizeof(nvBlockHeader) + BLOCK_SIZE); 
+        size_t max_nblocks = effective_zone_size / (sizeof(nvBlockHeader) + slab_meta_size + block_size); 
         // Adjust (reduce) number of blocks to accomodate extra space needed
         // for alignment.
         size_t block_headers_aligned_total_size = round_up(max_nblocks * sizeof(nvBlockHeader), kCacheLineSize);
-        size_t blocks_total_size = effective_zone_size - block_headers_aligned_total_size;
-        size_t _nblocks = blocks_total_size / BLOCK_SIZE;
+        size_t slab_meta_total_size = max_nblocks * slab_meta_size;
+        size_t blocks_total_size = effective_zone_size - block_headers_aligned_total_size - slab_meta_total_size;
+        size_t _nblocks = blocks_total_size / block_size;
+
+        assert((sizeof(nvZone) + (sizeof(nvBlockHeader) + slab_meta_size + block_size) * _nblocks <= zone_size)); 
 
-        assert((sizeof(nvZone) + (sizeof(nvBlockHeader) + BLOCK_SIZE) * _nblocks <= zone_size)); 
+        PersistContext ctx;
 
         // Set and persist header fields
         nvzone->header.metazone_log2size = uint32_t(metazone_log2size);
         nvzone->header.zone_size = zone_size;
-        nvzone->header.blocksize = BLOCK_SIZE;
+        nvzone->header.blocksize = block_size;
         nvzone->header.blocks_per_zone = _nblocks;
+        nvzone->header.slab_meta_size = slab_meta_size;
+        nvzone->header.slab_meta_offset = block_headers_aligned_total_size;
+        nvzone->header.format_pending = 1;
         Lease::make(&nvzone->header.lease);
-        persist((void*)&nvzone->header, sizeof(nvzone->header));
+        ctx.add(&nvzone->header, sizeof(nvzone->header));
 
         nvzone->block_headers = static_cast<RRegion::TPtr<nvBlockHeader>>((nvBlockHeader*) &nvzone->payload[0]);
-        nvzone->blocks = static_cast<RRegion::TPtr<nvBlock>>((nvBlock*)&nvzone->payload[block_headers_aligned_total_size]);
-        persist((void*)&nvzone->block_headers, sizeof(nvzone->block_headers));
-        persist((void*)&nvzone->blocks, sizeof(nvzone->blocks));
-
-        // Format block headers
-        RRegion::TPtr<nvBlockHeader> tblhdr = static_cast<RRegion::TPtr<nvBlockHeader>>(nvzone->block_headers);
-        for (size_t i=0; i<nvzone->header.blocks_per_zone; i++) {
-            nvBlockHeader::make(tblhdr+i, nvBlockHeader::kBlockTypeFree);
-        } 
+        nvzone->blocks = static_cast<RRegion::TPtr<nvBlock>>((nvBlock*)&nvzone->payload[block_headers_aligned_total_size + slab_meta_total_size]);
+        ctx.add(&nvzone->block_headers, sizeof(nvzone->block_headers));
+        ctx.add(&nvzone->blocks, sizeof(nvzone->blocks));
+        ctx.commit();
+
+        if (!lazy_format) {
+            nvzone->format_blocks();
+        }
         return nvzone;
     }
 
+    /**
+     * @brief Format the block headers of a format-pending zone
+     *
+     * @details
+     * Block headers are durable before the zone stops being 
+     * format-pending, so a crash in between only repeats the formatting.
+     */
+    void format_blocks()
+    {
+        PersistContext ctx;
+        RRegion::TPtr<nvBlockHeader> tblhdr = static_cast<RRegion::TPtr<nvBlockHeader>>(block_headers);
+        for (size_t i=0; i<header.blocks_per_zone; i++) {
+            nvBlockHeader::make(tblhdr+i, nvBlockHeader::kBlockTypeFree, ctx);
+        } 
+        ctx.commit();
+        header.format_pending = 0;
+        ctx.add(&header.format_pending, sizeof(header.format_pending));
+        ctx.commit();
+    }
+
+    bool format_pending()
+    {
+        return header.format_pending != 0;
+    }
+
     static size_t zone_id(RRegion::TPtr<nvHeap> nvheap, RRegion::TPtr<nvZone> nvzone)
     {
         // operands are of different types so we cast them to a common type 
@@ -167,18 +246,44 @@ struct nvZone {
         // some ugly casting to get the char pointer
         RRegion::TPtr<nvBlock> _tptr = (RRegion::TPtr<nvBlock>) blocks;
         RRegion::TPtr<char> tptr = (RRegion::TPtr<char>) _tptr;
-        size_t offset = idx << BLOCK_LOG2SIZE;
+        size_t offset = idx << block_log2size();
         return static_cast<RRegion::TPtr<struct nvBlock>>(tptr + offset);
     }
 
+    /**
+     * @brief Return the index of the block containing @a ptr
+     */
+    size_t block_id(RRegion::TPtr<void> ptr)
+    {
+        return (RRegion::TPtr<char>(ptr) - RRegion::TPtr<char>(block(0))) >> block_log2size();
+    }
+
     RRegion::TPtr<nvBlockHeader> block_header(int idx)
     {
         return block_headers+idx;
     }
 
-    static size_t block_size() 
+    bool separate_slab_meta()
+    {
+        return header.slab_meta_size != 0;
+    }
+
+    /**
+     * @brief Return the slab metadata slot of block @a idx
+     */
+    RRegion::TPtr<void> slab_meta(size_t idx)
+    {
+        return RRegion::TPtr<void>(static_cast<void*>(&payload[header.slab_meta_offset + idx * header.slab_meta_size]));
+    }
+
+    size_t block_size() 
     {
-        return BLOCK_SIZE;
+        return header.blocksize;
+    }
+
+    size_t block_log2size()
+    {
+        return __builtin_ctzll(header.blocksize);
     }
 
     size_t nblocks()
@@ -198,41 +303,84 @@ struct nvZone {
 
 
 struct nvHeapHeader {
-    static RRegion::TPtr<nvHeapHeader> make(RRegion::TPtr<nvHeapHeader> header, size_t heap_size, size_t metazone_log2size)
+    static RRegion::TPtr<nvHeapHeader> make(RRegion::TPtr<nvHeapHeader> header, size_t heap_size, size_t metazone_log2size, 
+                                            size_t block_log2size, bool separate_slab_meta, const SizeClassTable& size_classes)
     {
         LeaseSuperblock::make(&header->lease_superblock);
         header->heap_size = heap_size;
         header->metazone_log2size = metazone_log2size;
-        persist((void*) &header, sizeof(nvHeapHeader));
+        header->block_log2size = block_log2size;
+        header->separate_slab_meta = separate_slab_meta;
+        header->nsizeclasses = size_classes.is_default() ? 0 : size_classes.nclasses();
+        for (uint32_t i=0; i<header->nsizeclasses; i++) {
+            header->size_classes[i] = size_classes.size_from_class(i);
+        }
+        persist((void*) header.get(), sizeof(nvHeapHeader));
         return header;
     }
 
+    /**
+     * @brief Load the size classes of the heap into @a table
+     *
+     * @details
+     * A header without size classes predates per-heap size classes and 
+     * gets the default ones.
+     */
+    int load_size_classes(SizeClassTable* table)
+    {
+        if (nsizeclasses == 0) {
+            *table = default_size_classes;
+            return 0;
+        }
+        if (nsizeclasses > static_cast<uint32_t>(kSizeClasses)) {
+            return -1;
+        }
+        return table->set(std::vector<size_t>(size_classes, size_classes + nsizeclasses));
+    }
+
+    /**
+     * @brief Return the log2 of the block size of the zones of the heap
+     */
+    size_t zone_block_log2size()
+    {
+        // headers that predate per-heap block sizes have zero here
+        return block_log2size ? block_log2size : BLOCK_LOG2SIZE;
+    }
+
     // first cacheline
     uint64_t            heap_size;
     uint64_t            metazone_log2size;
-    uint8_t             reserved0[48];
+    uint32_t            block_log2size; // 0 for the default block size
+    uint32_t            separate_slab_meta; // 1 if slab headers live in per-zone metadata areas
+    uint8_t             reserved0[40];
     // second cacheline
     LeaseSuperblock     lease_superblock; // must be cache aligned
     // third cacheline
     RRegion::PPtr<void> root;
     uint64_t            checksum;
-    uint8_t             reserved1[880];
+    uint32_t            nsizeclasses; // 0 for the default size classes
+    uint32_t            size_classes[kSizeClasses];
+    uint8_t             reserved1[880 - 4 - 4*kSizeClasses];
 };
 
 static_assert(sizeof(nvHeapHeader) == 1024, "nvHeapHeader does not have expected size");
 
 struct nvMetaZone {
-    static RRegion::TPtr<nvMetaZone> make(RRegion::TPtr<nvMetaZone> nvmetazone, size_t heap_size, size_t metazone_log2size)
+    static RRegion::TPtr<nvMetaZone> make(RRegion::TPtr<nvMetaZone> nvmetazone, size_t heap_size, size_t metazone_log2size, 
+                                          size_t block_log2size, bool separate_slab_meta, const SizeClassTable& size_classes,
+                                          bool lazy_format = false)
     {
-        size_t metazone_size = 1LLU << metazone_log2size;
-        size_t zone_size = metazone_size - sizeof(nvMetaZone); 
-
-        nvHeapHeader::make(&nvmetazone->heapheader, heap_size, metazone_log2size);
-        nvZone::make(nvmetazone->zone(), zone_size, metazone_log2size); 
+        nvHeapHeader::make(&nvmetazone->heapheader, heap_size, metazone_log2size, block_log2size, separate_slab_meta, size_classes);
+        nvZone::make(nvmetazone->zone(), zone_size(metazone_log2size), metazone_log2size, block_log2size, separate_slab_meta, lazy_format); 
 
         return nvmetazone;
     }
 
+    static size_t zone_size(size_t metazone_log2size)
+    {
+        return (1LLU << metazone_log2size) - sizeof(nvMetaZone);
+    }
+
     RRegion::TPtr<struct nvZone> zone()
     {
         return static_cast<RRegion::TPtr<struct nvZone>>((nvZone*)&payload[0]);
@@ -256,7 +404,10 @@ struct nvMetaZone {
  *     to failures.
  */
 struct nvHeap {
-    static RRegion::TPtr<nvHeap> make(RRegion::TPtr<nvHeap> nvheap, size_t heap_size, size_t metazone_size)
+    static RRegion::TPtr<nvHeap> make(RRegion::TPtr<nvHeap> nvheap, size_t heap_size, size_t metazone_size, 
+                                      const SizeClassTable& size_classes = default_size_classes,
+                                      size_t block_size = BLOCK_SIZE, bool separate_slab_meta = false,
+                                      bool lazy_format = false)
     {
         LOG(info) << "Make heap layout: " << nvheap << " size: " << heap_size << " metazone_size: " << metazone_size;
 
@@ -268,16 +419,35 @@ struct nvHeap {
             LOG(error) << "Heap size must be multiple of metazone size.";
             return null_ptr;
         }
+        if (!valid_block_size(block_size, metazone_size)) {
+            return null_ptr;
+        }
 
         size_t metazone_log2size = log2(metazone_size);
+        size_t block_log2size = log2(block_size);
         size_t nmetazones = heap_size / metazone_size;
         for (size_t zid=0; zid<nmetazones; zid++) {
             RRegion::TPtr<struct nvMetaZone> mz = metazone(nvheap, zid, metazone_log2size);
-            nvMetaZone::make(mz, heap_size, metazone_log2size);
+            nvMetaZone::make(mz, heap_size, metazone_log2size, block_log2size, separate_slab_meta, size_classes, lazy_format);
         }
         return nvheap;    
     }
 
+    static bool valid_block_size(size_t block_size, size_t metazone_size)
+    {
+        if (!is_power_of_two(block_size) || 
+            block_size < (1LLU << MIN_BLOCK_LOG2SIZE) || block_size > (1LLU << MAX_BLOCK_LOG2SIZE)) 
+        {
+            LOG(error) << "Block size must be a power of two between 64KB and 4MB.";
+            return false;
+        }
+        if (block_size > metazone_size / 4) {
+            LOG(error) << "Block size must be at most a quarter of metazone size.";
+            return false;
+        }
+        return true;
+    }
+
     static RRegion::TPtr<struct nvMetaZone> metazone0(RRegion::TPtr<nvHeap> nvheap)
     {
         return static_cast<RRegion::TPtr<nvMetaZone>>(nvheap);
@@ -346,6 +516,18 @@ struct nvHeap {
         return metazone(0)->heapheader.metazone_log2size;
     }
 
+    size_t block_log2size() {
+        return metazone(0)->heapheader.zone_block_log2size();
+    }
+
+    size_t block_size() {
+        return 1LLU << block_log2size();
+    }
+
+    bool separate_slab_meta() {
+        return metazone(0)->heapheader.separate_slab_meta != 0;
+    }
+
     size_t nzones() {
         return size() / metazone_size();
     }
@@ -0,0 +1,199 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "globalheap/lock_profile.hh"
+
+#include <iomanip>
+
+namespace alps {
+
+const size_t LockSiteStats::kWaitBuckets;
+
+std::atomic<bool> lock_profile_on(false);
+
+static const char* lock_site_names[kLockSites] = {
+    "thread_slab_heap",
+    "process_slab_heap",
+    "extent_heap",
+    "zone_heap.read",
+    "zone_heap.write",
+    "memattrib.read",
+    "memattrib.write",
+    "slab_owner"
+};
+
+/**
+ * @brief Lock profile counters of one shard
+ *
+ * @details
+ * Each thread counts into one of several shards, assigned round-robin on 
+ * first use, so that threads profiling the same lock site do not bounce 
+ * the same cache line.
+ */
+struct LockProfileShard {
+    struct Site {
+        std::atomic<uint64_t> acquisitions;
+        std::atomic<uint64_t> contended;
+        std::atomic<uint64_t> wait_ns;
+        std::atomic<uint64_t> wait_histogram[LockSiteStats::kWaitBuckets];
+    };
+
+    Site sites[kLockSites];
+} __attribute__((aligned(64)));
+
+static const size_t kLockProfileShards = 16;
+static LockProfileShard lock_profile_shards[kLockProfileShards];
+static std::atomic<size_t> lock_profile_nthreads(0);
+static __thread LockProfileShard* lock_profile_shard = NULL;
+
+static size_t wait_bucket(uint64_t wait_ns)
+{
+    size_t b = 0;
+    while (wait_ns > 1 && b < LockSiteStats::kWaitBuckets - 1) {
+        wait_ns >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void lock_profile_record(LockSite site, bool contended, uint64_t wait_ns)
+{
+    if (!lock_profile_shard) {
+        lock_profile_shard = &lock_profile_shards[lock_profile_nthreads++ % kLockProfileShards];
+    }
+    LockProfileShard::Site* s = &lock_profile_shard->sites[site];
+    s->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended) {
+        s->contended.fetch_add(1, std::memory_order_relaxed);
+        s->wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+        s->wait_histogram[wait_bucket(wait_ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void set_lock_profile(bool on)
+{
+    lock_profile_on.store(on, std::memory_order_relaxed);
+}
+
+void reset_lock_profile()
+{
+    for (size_t i = 0; i < kLockProfileShards; i++) {
+        for (int j = 0; j < kLockSites; j++) {
+            LockProfileShard::Site* s = &lock_profile_shards[i].sites[j];
+            s->acquisitions.store(0, std::memory_order_relaxed);
+            s->contended.store(0, std::memory_order_relaxed);
+            s->wait_ns.store(0, std::memory_order_relaxed);
+            for (size_t b = 0; b < LockSiteStats::kWaitBuckets; b++) {
+                s->wait_histogram[b].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void get_lock_profile(LockProfile* profile)
+{
+    profile->enabled = lock_profile_enabled();
+    profile->sites.clear();
+    for (int j = 0; j < kLockSites; j++) {
+        LockSiteStats stats;
+        stats.name = lock_site_names[j];
+        for (size_t i = 0; i < kLockProfileShards; i++) {
+            LockProfileShard::Site* s = &lock_profile_shards[i].sites[j];
+            stats.acquisitions += s->acquisitions.load(std::memory_order_relaxed);
+            stats.contended += s->contended.load(std::memory_order_relaxed);
+            stats.wait_ns += s->wait_ns.load(std::memory_order_relaxed);
+            for (size_t b = 0; b < LockSiteStats::kWaitBuckets; b++) {
+                stats.wait_histogram[b] += s->wait_histogram[b].load(std::memory_order_relaxed);
+            }
+        }
+        profile->sites.push_back(stats);
+    }
+}
+
+
+LockSiteStats::LockSiteStats()
+    : acquisitions(0),
+      contended(0),
+      wait_ns(0),
+      wait_histogram(kWaitBuckets, 0)
+{ }
+
+double LockSiteStats::contention() const
+{
+    return acquisitions ? 100.0 * contended / acquisitions : 0;
+}
+
+uint64_t LockSiteStats::wait_percentile_ns(double p) const
+{
+    uint64_t n = 0;
+    for (size_t b = 0; b < wait_histogram.size(); b++) {
+        n += wait_histogram[b];
+        if (n > 0 && n >= p * contended) {
+            return 2ULL << b;
+        }
+    }
+    return 0;
+}
+
+void LockProfile::stream_to(std::ostream& os) const
+{
+    if (!enabled) {
+        os << "lock profile disabled (see StatsOptions::lock_profile)" << std::endl;
+        return;
+    }
+    os << std::left << std::setw(20) << "lock" << std::right
+       << std::setw(14) << "acquisitions"
+       << std::setw(12) << "contended"
+       << std::setw(10) << "cont%"
+       << std::setw(16) << "wait_ns"
+       << std::setw(12) << "wait p50"
+       << std::setw(12) << "p99" << std::endl;
+    for (size_t i = 0; i < sites.size(); i++) {
+        const LockSiteStats& s = sites[i];
+        if (s.acquisitions == 0) {
+            continue;
+        }
+        os << std::left << std::setw(20) << s.name << std::right
+           << std::setw(14) << s.acquisitions
+           << std::setw(12) << s.contended
+           << std::setw(10) << std::fixed << std::setprecision(2) << s.contention()
+           << std::setw(16) << s.wait_ns
+           << std::setw(12) << s.wait_percentile_ns(0.5)
+           << std::setw(12) << s.wait_percentile_ns(0.99) << std::endl;
+    }
+}
+
+void LockProfile::stream_json(std::ostream& os) const
+{
+    os << "[";
+    for (size_t i = 0; i < sites.size(); i++) {
+        const LockSiteStats& s = sites[i];
+        os << (i == 0 ? "" : ", ");
+        os << "{\"lock\": \"" << s.name << "\"";
+        os << ", \"acquisitions\": " << s.acquisitions;
+        os << ", \"contended\": " << s.contended;
+        os << ", \"wait_ns\": " << s.wait_ns;
+        os << ", \"wait_histogram\": [";
+        for (size_t b = 0; b < s.wait_histogram.size(); b++) {
+            os << (b == 0 ? "" : ", ") << s.wait_histogram[b];
+        }
+        os << "]}";
+    }
+    os << "]";
+}
+
+} // namespace alps
@@ -0,0 +1,59 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _ALPS_GLOBALHEAP_LOCK_PROFILE_INTERNAL_HH_
+#define _ALPS_GLOBALHEAP_LOCK_PROFILE_INTERNAL_HH_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "alps/globalheap/lock_profile.hh"
+
+namespace alps {
+
+/**
+ * @brief Allocator lock sites reported by the lock profile
+ */
+enum LockSite {
+    kLockSiteThreadSlabHeap = 0,  // ThreadSlabHeap mutex
+    kLockSiteProcessSlabHeap,     // ProcessSlabHeap mutex
+    kLockSiteExtentHeap,          // ExtentHeap mutex
+    kLockSiteZoneHeapRead,        // ZoneHeap reader-writer lock, shared
+    kLockSiteZoneHeapWrite,       // ZoneHeap reader-writer lock, exclusive
+    kLockSiteMemAttribRead,       // memory attribute index lock, shared
+    kLockSiteMemAttribWrite,      // memory attribute index lock, exclusive
+    kLockSiteSlabOwner,           // trying the owner of a slab on a free; contended if deferred
+    kLockSites
+};
+
+extern std::atomic<bool> lock_profile_on;
+
+inline bool lock_profile_enabled()
+{
+    return lock_profile_on.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Count an acquisition of @a site that waited @a wait_ns if 
+ * @a contended
+ */
+void lock_profile_record(LockSite site, bool contended, uint64_t wait_ns);
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_LOCK_PROFILE_INTERNAL_HH_
@@ -0,0 +1,70 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "globalheap/maintainer.hh"
+
+#include <chrono>
+
+#include "common/log.hh"
+#include "globalheap/globalheap_internal.hh"
+
+namespace alps {
+
+HeapMaintainer::HeapMaintainer(GlobalHeapInternal* heap, size_t interval_ms, size_t free_space_watermark, size_t prepared_slabs)
+    : heap_(heap),
+      interval_ms_(interval_ms),
+      free_space_watermark_(free_space_watermark),
+      prepared_slabs_(prepared_slabs),
+      stop_(false)
+{ }
+
+int HeapMaintainer::init()
+{
+    LOG(info) << "Starting heap maintenance thread, interval: " << interval_ms_ << "ms";
+
+    thread_ = std::thread(&HeapMaintainer::run, this);
+    return 0;
+}
+
+int HeapMaintainer::teardown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    return 0;
+}
+
+void HeapMaintainer::maintain()
+{
+    heap_->maintain(free_space_watermark_, prepared_slabs_);
+}
+
+void HeapMaintainer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cond_.wait_for(lock, std::chrono::milliseconds(interval_ms_), [this] { return stop_; })) {
+        lock.unlock();
+        maintain();
+        lock.lock();
+    }
+}
+
+} // namespace alps
@@ -0,0 +1,71 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_GLOBALHEAP_MAINTAINER_HH_
+#define _ALPS_GLOBALHEAP_MAINTAINER_HH_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace alps {
+
+// forward declarations
+class GlobalHeapInternal;
+
+/**
+ * @brief Background thread that does the allocator housekeeping of a 
+ * heap instance ahead of demand (see MaintenanceOptions)
+ *
+ * @details
+ * Every interval the thread drains deferred frees, returns empty slabs 
+ * that per-thread slab heaps do not need to the process slab heap, leases
+ * a zone when free space in the leased zones drops below the watermark, 
+ * and formats slabs for the size classes that recently needed new ones, 
+ * so that allocating threads rarely lease zones or format slabs 
+ * themselves.
+ */
+class HeapMaintainer {
+public:
+    HeapMaintainer(GlobalHeapInternal* heap, size_t interval_ms, size_t free_space_watermark, size_t prepared_slabs);
+
+    int init();
+    int teardown();
+
+    /**
+     * @brief Run a single maintenance pass
+     */
+    void maintain();
+
+private:
+    void run();
+
+private:
+    GlobalHeapInternal*     heap_;
+    size_t                  interval_ms_;
+    size_t                  free_space_watermark_;
+    size_t                  prepared_slabs_;
+    std::thread             thread_;
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    bool                    stop_;
+};
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_MAINTAINER_HH_
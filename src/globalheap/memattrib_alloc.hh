@@ -17,6 +17,7 @@
 #ifndef _ALPS_GLOBALHEAP_MEMORY_ATTRIBUTE_ALLOCATOR_HH_
 #define _ALPS_GLOBALHEAP_MEMORY_ATTRIBUTE_ALLOCATOR_HH_
 
+#include <atomic>
 #include <map>
 
 #include "alps/globalheap/memattrib.hh"
@@ -58,13 +59,17 @@ private:
 private:
     ReaderWriterLock rwlock_;
     AllocatorIndex   allocators_; // index of memory-attribute to associated allocator
-    MemAttrib        last_used_memattrib_; // hint to last used memory attribute
-    AllocatorT*      last_used_allocator_; // hint to last used allocator
+
+    // hint to the last used index entry; readers update it concurrently, 
+    // so it points to an entry, which is never removed, rather than 
+    // caching the attribute and allocator separately
+    std::atomic<typename AllocatorIndex::value_type*> last_used_;
 };
 
 template<typename AllocatorT>
 MemAttribAllocators<AllocatorT>::MemAttribAllocators()
-    : last_used_allocator_(NULL)
+    : rwlock_(kLockSiteMemAttribRead, kLockSiteMemAttribWrite),
+      last_used_(NULL)
 { 
 
 }
@@ -72,26 +77,24 @@ MemAttribAllocators<AllocatorT>::MemAttribAllocators()
 template<typename AllocatorT>
 AllocatorT* MemAttribAllocators<AllocatorT>::find(const MemAttrib& memattrib)
 {
-    if (memattrib == last_used_memattrib_) {
-        return last_used_allocator_;
+    typename AllocatorIndex::value_type* last_used = last_used_.load(std::memory_order_relaxed);
+    if (last_used && memattrib == last_used->first) {
+        return last_used->second;
     }
 
     typename AllocatorIndex::iterator it = allocators_.find(memattrib);
     if (it == allocators_.end()) {
         return NULL;
     }
-    last_used_memattrib_ = memattrib;
-    last_used_allocator_ = it->second;
-    return last_used_allocator_;
+    last_used_.store(&*it, std::memory_order_relaxed);
+    return it->second;
 }
 
 template<typename AllocatorT>
 void MemAttribAllocators<AllocatorT>::bind(const MemAttrib& memattrib, AllocatorT* allocator)
 {
-    allocators_.insert(AllocatorIndexPair(memattrib, allocator));
-
-    last_used_memattrib_ = memattrib;
-    last_used_allocator_ = allocator;
+    typename AllocatorIndex::iterator it = allocators_.insert(AllocatorIndexPair(memattrib, allocator)).first;
+    last_used_.store(&*it, std::memory_order_relaxed);
 }
 
 
@@ -29,7 +29,7 @@ ErrorCode MemAttribHeap::init()
 {
     extentheap_ = new ExtentHeap(nvheap_, generation_, memattrib_);
     COERCE_ERROR(extentheap_->init());
-    process_slab_heap_ = new ProcessSlabHeap(extentheap_);
+    process_slab_heap_ = new ProcessSlabHeap(extentheap_, size_classes_);
     ASSERT_ND(extentheap_ != NULL);
     ASSERT_ND(process_slab_heap_ != NULL);
 
@@ -43,6 +43,16 @@ ErrorCode MemAttribHeap::init()
 
 ErrorCode MemAttribHeap::teardown()
 {
+    // Commit outstanding slab bitmap updates before giving up the zones 
+    for (int i=0; i<kMaxThreadSlabHeaps; i++) {
+        thread_slab_heaps_[i]->lock();
+        thread_slab_heaps_[i]->flush();
+        thread_slab_heaps_[i]->unlock();
+    }
+    process_slab_heap_->lock();
+    process_slab_heap_->flush();
+    process_slab_heap_->unlock();
+
     COERCE_ERROR(extentheap_->teardown());
     delete extentheap_;
     return kErrorCodeOk;
@@ -54,12 +64,54 @@ ThreadSlabHeap* MemAttribHeap::thread_slab_heap()
     return thread_slab_heaps_[idx];
 }
 
+void MemAttribHeap::stats(HeapStats* stats)
+{
+    for (int i=0; i<kMaxThreadSlabHeaps; i++) {
+        thread_slab_heaps_[i]->lock();
+        thread_slab_heaps_[i]->stats(stats);
+        thread_slab_heaps_[i]->unlock();
+    }
+    process_slab_heap_->lock();
+    process_slab_heap_->stats(stats);
+    process_slab_heap_->unlock();
+    extentheap_->stats(stats);
+}
+
+void MemAttribHeap::maintain(size_t free_space_watermark, size_t prepared_slabs)
+{
+    std::vector<Slab*> slabs;
+    for (int i=0; i<kMaxThreadSlabHeaps; i++) {
+        ThreadSlabHeap* theap = thread_slab_heaps_[i];
+        if (!theap->try_lock()) {
+            continue;
+        }
+        theap->drain_deferred_frees();
+        slabs.clear();
+        theap->release_empty_slabs(kThreadEmptySlabs, &slabs);
+        if (!slabs.empty()) {
+            // thread slab heaps are locked before the process slab heap
+            process_slab_heap_->lock();
+            for (size_t j=0; j<slabs.size(); j++) {
+                process_slab_heap_->insert_slab(slabs[j], slabs[j]->sizeclass());
+            }
+            process_slab_heap_->unlock();
+        }
+        theap->unlock();
+    }
+    process_slab_heap_->lock();
+    process_slab_heap_->drain_deferred_frees();
+    process_slab_heap_->unlock();
+
+    process_slab_heap_->reserve_zones(free_space_watermark);
+    process_slab_heap_->prepare_slabs(prepared_slabs);
+}
+
 RRegion::TPtr<void> MemAttribHeap::malloc(size_t size)
 {
     LOG(info) << "Allocate block size: " << size;
 
     // large block
-    if (size > slab_size/2) {
+    if (size > SizeClassTable::kMaxSmallSize) {
         return process_slab_heap_->malloc(size);
     }
 
@@ -68,6 +120,16 @@ RRegion::TPtr<void> MemAttribHeap::malloc(size_t size)
     return theap->malloc(size);
 }
 
+int MemAttribHeap::reserve(size_t size, size_t count)
+{
+    LOG(info) << "Reserve blocks size: " << size << " count: " << count;
+
+    if (size > SizeClassTable::kMaxSmallSize) {
+        return process_slab_heap_->reserve_extents(size, count);
+    }
+    return process_slab_heap_->reserve_blocks(size_classes_->sizeclass(size), count);
+}
+
 void MemAttribHeap::free(RRegion::TPtr<void> ptr)
 {
     LOG(info) << "Free block ptr: " << ptr;
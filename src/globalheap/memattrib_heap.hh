@@ -21,6 +21,7 @@
 
 #include "alps/common/error_code.hh"
 #include "alps/pegasus/relocatable_region.hh"
+#include "alps/globalheap/heap_stats.hh"
 #include "alps/globalheap/memattrib.hh"
 
 #include "globalheap/layout.hh"
@@ -36,26 +37,54 @@ class ThreadSlabHeap;
 class MemAttribHeap {
 public:
     const int kMaxThreadSlabHeaps = 32;
+    const size_t kThreadEmptySlabs = 1; // empty slabs a thread slab heap keeps for itself
 
 public:
-    MemAttribHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation, const MemAttrib& memattrib)
+    MemAttribHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation, const MemAttrib& memattrib, 
+                  const SizeClassTable* size_classes)
         : nvheap_(nvheap),
           generation_(generation),
-          memattrib_(memattrib)
+          memattrib_(memattrib),
+          size_classes_(size_classes)
     { }
 
     RRegion::TPtr<void> malloc(size_t size);
     void free(RRegion::TPtr<void> ptr);
 
+    /**
+     * @brief Lease zones and format slabs ahead of @a count allocations 
+     * of @a size bytes
+     */
+    int reserve(size_t size, size_t count);
+
     ErrorCode init();
     ErrorCode teardown();
 
     ThreadSlabHeap* thread_slab_heap();
 
+    /**
+     * @brief Aggregate the statistics counters of all slab heaps and the 
+     * extent heap into @a stats
+     */
+    void stats(HeapStats* stats);
+
+    /**
+     * @brief Do allocator housekeeping ahead of demand: drain deferred 
+     * frees, return surplus empty slabs of thread slab heaps to the 
+     * process slab heap, lease a zone when less than @a free_space_watermark
+     * percent of leased blocks are free, and format @a prepared_slabs 
+     * slabs for each hot size class
+     *
+     * @details
+     * Thread slab heaps that are busy are skipped until the next call.
+     */
+    void maintain(size_t free_space_watermark, size_t prepared_slabs);
+
 private:
     RRegion::TPtr<nvHeap>        nvheap_;
     Generation                   generation_;
     MemAttrib                    memattrib_;
+    const SizeClassTable*        size_classes_;
     ExtentHeap*                  extentheap_;
     ProcessSlabHeap*             process_slab_heap_;
     std::vector<ThreadSlabHeap*> thread_slab_heaps_;
@@ -17,49 +17,191 @@
 #ifndef _ALPS_GLOBALHEAP_NVSLAB_HH_
 #define _ALPS_GLOBALHEAP_NVSLAB_HH_
 
+#include <stddef.h>
+
 #include "alps/common/assorted_func.hh"
 #include "alps/pegasus/relocatable_region.hh"
 
+#include "common/debug.hh"
 #include "globalheap/bitmap.hh"
 #include "globalheap/layout.hh"
 #include "globalheap/size_class.hh"
+#include "globalheap/size_class_table.hh"
 
 namespace alps {
 
 // forward declarations
 class Slab;
 
+// size of single-block slabs, which is all slabs formatted before 
+// multi-block slabs
 static size_t slab_size = 256*1024LLU;
 
+// whether new slabs are colored (see nvSlabHeader::make)
+extern bool slab_coloring;
+
 /**
  * @brief Variable-size slab header
+ *
+ * @details
+ * The block bitmap is a durable superset of the allocated blocks: a block's
+ * bit is persisted before the block is handed out, while clearing a bit on 
+ * free is persisted lazily in batches (see Slab). The state field tells 
+ * recovery whether the bitmap may contain such stale bits (kSlabStateDirty)
+ * or whether the slab was in the middle of being reformatted 
+ * (kSlabStateFormatting).
+ *
+ * The header normally precedes the blocks of the slab. In heaps with 
+ * separate slab metadata it lives in the metadata slot of the first block
+ * of the slab instead (see nvZone::slab_meta), so that allocator writes 
+ * never share cache lines or pages with user data. Such a header has a 
+ * zero header_size and a Blocks locator between its fixed part and the 
+ * bitmap.
  */
 struct nvSlabHeader {
+    enum {
+        kSlabStateClean = 0,
+        kSlabStateDirty = 1,
+        kSlabStateFormatting = 2
+    };
+
+    /**
+     * @brief Location of the blocks of a slab with a separate header
+     */
+    struct Blocks {
+        int64_t  offset;   // offset of the slab's extent from the header
+        uint32_t color;    // offset of block 0 from the start of the extent
+        uint32_t reserved;
+    };
+
     // When adding a member field, ensure method size_of() includes that field too
     uint32_t header_size;
     uint16_t sizeclass;
+    uint8_t  state;
+    uint8_t  slab_log2size; // 0 in slabs formatted before multi-block slabs, which span slab_size
     uint32_t nblocks;
+    uint32_t block_size; // 0 in slabs formatted before per-heap size classes
     Slab*    slab; // pointer to the slab's volatile descriptor for quick lookup
     BitMap   block_map; // variable size structure
 
     // total size of the fixed part of the header
     static size_t size_of() {
-        return sizeof(header_size) + sizeof(sizeclass) + sizeof(nblocks) + sizeof(Slab*);
+        return offsetof(nvSlabHeader, block_map);
     }
 
-    static RRegion::TPtr<nvSlabHeader> make(RRegion::TPtr<nvSlabHeader> header, size_t slab_size, int sizeclass)
+    /**
+     * @brief Format header fields and block bitmap, adding the written 
+     * cache lines to ctx without committing them
+     */
+    static RRegion::TPtr<nvSlabHeader> make(RRegion::TPtr<nvSlabHeader> header, size_t slab_size, int sizeclass, size_t block_size, PersistContext& ctx)
     {
-        size_t block_size = size_from_class(sizeclass);
+        assert(is_power_of_two(slab_size));
         size_t nblocks = max_nblocks(slab_size, block_size);
         size_t header_sz = size_of() + BitMap::size_of(nblocks);
         header->sizeclass = sizeclass;
+        header->slab_log2size = __builtin_ctzll(slab_size);
+        header->block_size = block_size;
         header->header_size = align<size_t, kCacheLineSize>(header_sz);
         // Adjust (reduce) number of blocks to accomodate extra space needed 
         // for roundup
         header->nblocks = (slab_size - header->header_size) / block_size;
+        // The color offset is part of header_size, so it needs no 
+        // separate field
+        header->header_size += color(header.offset(), slab_size, slab_size - header->header_size - header->nblocks * block_size);
         BitMap::make(nblocks, &header->block_map);
-        persist((void*)&header, sizeof(nvSlabHeader));
-        persist((void*)&header->block_map, BitMap::size_of(nblocks));
+        ctx.add(header.get(), size_of());
+        ctx.add(&header->block_map, BitMap::size_of(nblocks));
+        return header;
+    }
+
+    /**
+     * @brief Format a header kept apart from the slab's blocks, which start
+     * at @a start, adding the written cache lines to ctx without 
+     * committing them
+     */
+    static RRegion::TPtr<nvSlabHeader> make_separate(RRegion::TPtr<nvSlabHeader> header, RRegion::TPtr<void> start, 
+                                                     size_t slab_size, int sizeclass, size_t block_size, PersistContext& ctx)
+    {
+        assert(is_power_of_two(slab_size));
+        assert(RRegion::TPtr<char>(start) - RRegion::TPtr<char>(header) > 0);
+        size_t nblocks = slab_size / block_size;
+        header->header_size = 0;
+        header->sizeclass = sizeclass;
+        header->slab_log2size = __builtin_ctzll(slab_size);
+        header->block_size = block_size;
+        header->nblocks = nblocks;
+        header->blocks()->offset = RRegion::TPtr<char>(start) - RRegion::TPtr<char>(header);
+        header->blocks()->color = color(start.offset(), slab_size, slab_size - nblocks * block_size);
+        BitMap::make(nblocks, header->bitmap());
+        ctx.add(header.get(), size_of() + sizeof(Blocks));
+        ctx.add(header->bitmap(), BitMap::size_of(nblocks));
+        return header;
+    }
+
+    /**
+     * @brief Format a header again for another size class, keeping it 
+     * where it is with respect to the slab's blocks
+     */
+    static RRegion::TPtr<nvSlabHeader> remake(RRegion::TPtr<nvSlabHeader> header, size_t slab_size, int sizeclass, size_t block_size, PersistContext& ctx)
+    {
+        if (header->separate()) {
+            return make_separate(header, header->start(), slab_size, sizeclass, block_size, ctx);
+        }
+        return make(header, slab_size, sizeclass, block_size, ctx);
+    }
+
+    /**
+     * @brief Return the offset of block 0 from the start of a slab at 
+     * region offset @a start_offset
+     *
+     * @details
+     * Slabs are colored: block 0 is offset by a number of cache lines 
+     * taken from the @a slack after the last block, varying with the 
+     * position of the slab so that the first blocks of neighbouring slabs
+     * do not map to the same cache sets.
+     */
+    static size_t color(uint64_t start_offset, size_t slab_size, size_t slack)
+    {
+        if (!slab_coloring) {
+            return 0;
+        }
+        size_t ncolors = slack / kCacheLineSize + 1;
+        return (start_offset / slab_size) % ncolors * kCacheLineSize;
+    }
+
+    bool separate() {
+        return header_size == 0;
+    }
+
+    Blocks* blocks() {
+        return reinterpret_cast<Blocks*>(&block_map);
+    }
+
+    BitMap* bitmap() {
+        return separate() ? reinterpret_cast<BitMap*>(&block_map.bv_[sizeof(Blocks)]) : &block_map;
+    }
+
+    // offset of the slab's extent from the header
+    int64_t start_offset() {
+        return separate() ? blocks()->offset : 0;
+    }
+
+    RRegion::TPtr<void> start() {
+        RRegion::TPtr<char> base = static_cast<RRegion::TPtr<char>>((char*)this);
+        return RRegion::TPtr<void>(base + start_offset());
+    }
+
+    // offset of block 0 from the header
+    size_t block0_offset() {
+        return separate() ? blocks()->offset + blocks()->color : header_size;
+    }
+
+    static RRegion::TPtr<nvSlabHeader> make(RRegion::TPtr<nvSlabHeader> header, size_t slab_size, int sizeclass, size_t block_size)
+    {
+        PersistContext ctx;
+        header->state = kSlabStateClean;
+        make(header, slab_size, sizeclass, block_size, ctx);
+        ctx.commit();
         return header;
     }
 
@@ -83,21 +225,101 @@ struct nvSlabHeader {
 };
 
 // Slab
-// A slab comprises a header followed by a number of blocks. 
+// A slab comprises a header followed by a number of blocks. It spans one
+// or more zone blocks (a power of two of them), enough to hold 
+// kMinBlocks blocks of its size class where possible. In zones with 
+// separate slab metadata the header lives in the zone's metadata area 
+// and the blocks start at the beginning of the extent. An nvSlab pointer
+// always points to the header.
 struct nvSlab
 {
+    static const size_t kMinBlocks = 8;
+    static const size_t kMaxSize = 2*1024*1024LLU;
+
     nvSlabHeader header;    // Variable-size header
 
-    static RRegion::TPtr<nvSlab> make(RRegion::TPtr<nvSlab> nvslab, int sizeclass)
+    /**
+     * @brief Return the size of a slab of blocks of @a block_size built 
+     * from zone blocks of @a zone_block_size
+     */
+    static size_t size_for(size_t zone_block_size, size_t block_size)
+    {
+        size_t size = zone_block_size;
+        while (size < kMaxSize && nvSlabHeader::max_nblocks(size, block_size) < kMinBlocks) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    static RRegion::TPtr<nvSlab> make(RRegion::TPtr<nvSlab> nvslab, size_t size, int sizeclass, 
+                                      const SizeClassTable& size_classes = default_size_classes)
     {
-        nvSlabHeader::make(&nvslab->header, slab_size, sizeclass);
-        assert(nvslab->block_offset(nvslab->nblocks()) <= slab_size);
+        nvSlabHeader::make(&nvslab->header, size, sizeclass, size_classes.size_from_class(sizeclass));
+        assert(nvslab->block_offset(nvslab->nblocks()) <= size);
         return nvslab;
     }
 
-    static RRegion::TPtr<nvSlab> make(RRegion::TPtr<nvExtentHeader> nvexheader, RRegion::TPtr<nvSlab> nvslab, int sizeclass)
+    static RRegion::TPtr<nvSlab> make(RRegion::TPtr<nvSlab> nvslab, int sizeclass, 
+                                      const SizeClassTable& size_classes = default_size_classes)
     {
-        RRegion::TPtr<nvSlab> _nvslab = make(nvslab, sizeclass);
+        return make(nvslab, slab_size, sizeclass, size_classes);
+    }
+
+    /**
+     * @brief Reformat a slab that is already linked into the heap as a slab
+     *
+     * @details
+     * The slab keeps its size. It is marked as formatting before any field
+     * changes so that a crash in the middle leaves a slab that recover() 
+     * reformats.
+     */
+    static RRegion::TPtr<nvSlab> remake(RRegion::TPtr<nvSlab> nvslab, int sizeclass, const SizeClassTable& size_classes)
+    {
+        PersistContext ctx;
+        size_t size = nvslab->size();
+        nvslab->header.state = nvSlabHeader::kSlabStateFormatting;
+        ctx.add(&nvslab->header, nvSlabHeader::size_of());
+        ctx.commit();
+        CRASH_POINT("slab_remake");
+        nvSlabHeader::remake(&nvslab->header, size, sizeclass, size_classes.size_from_class(sizeclass), ctx);
+        ctx.commit();
+        nvslab->header.state = nvSlabHeader::kSlabStateClean;
+        ctx.add(&nvslab->header, nvSlabHeader::size_of());
+        ctx.commit();
+        assert(nvslab->block_offset(nvslab->nblocks()) - nvslab->header.start_offset() <= size);
+        return nvslab;
+    }
+
+    /**
+     * @brief Return the slab of the extent starting at block @a idx of 
+     * zone @a nvzone
+     */
+    static RRegion::TPtr<nvSlab> at(RRegion::TPtr<nvZone> nvzone, size_t idx)
+    {
+        if (nvzone->separate_slab_meta()) {
+            return RRegion::TPtr<nvSlab>(nvzone->slab_meta(idx));
+        }
+        return RRegion::TPtr<nvSlab>(nvzone->block(idx));
+    }
+
+    /**
+     * @brief Turn the extent starting at block @a idx of zone @a nvzone 
+     * into a slab of @a size bytes
+     */
+    static RRegion::TPtr<nvSlab> make(RRegion::TPtr<nvZone> nvzone, size_t idx, size_t size, int sizeclass, 
+                                      const SizeClassTable& size_classes)
+    {
+        RRegion::TPtr<nvSlab> _nvslab = at(nvzone, idx);
+        if (nvzone->separate_slab_meta()) {
+            PersistContext ctx;
+            _nvslab->header.state = nvSlabHeader::kSlabStateClean;
+            nvSlabHeader::make_separate(&_nvslab->header, RRegion::TPtr<void>(nvzone->block(idx)), size, sizeclass, 
+                                        size_classes.size_from_class(sizeclass), ctx);
+            ctx.commit();
+        } else {
+            make(_nvslab, size, sizeclass, size_classes);
+        }
+        RRegion::TPtr<nvExtentHeader> nvexheader = static_cast<RRegion::TPtr<nvExtentHeader>>(nvzone->block_header(idx));
 
         // Linearization point (with respect to failures)
         // 
@@ -110,16 +332,23 @@ struct nvSlab
         return _nvslab;
     }
 
+    size_t size() { return header.slab_log2size ? 1LLU << header.slab_log2size : slab_size; }
     size_t nblocks() { return header.nblocks; }
     size_t sizeclass() { return header.sizeclass; }
-    size_t block_size() { return size_from_class(header.sizeclass); }
+    size_t block_size() { return header.block_size ? header.block_size : size_from_class(header.sizeclass); }
     
     size_t block_offset(int id) 
     {
-        size_t offset_0 = header.size();
+        size_t offset_0 = header.block0_offset();
         return offset_0 + id * block_size();
     }
 
+    // bytes of the slab's extent that hold neither blocks nor the header
+    size_t slack()
+    {
+        return size() - (block_offset(nblocks()) - header.start_offset());
+    }
+
     RRegion::TPtr<void> block(size_t block_id)
     {
         RRegion::TPtr<char> base = static_cast<RRegion::TPtr<char>>((char*)&header);   
@@ -136,17 +365,17 @@ struct nvSlab
     bool is_free(size_t block_idx) 
     {
         assert(block_idx < nblocks());
-        return !header.block_map.is_set(block_idx);
+        return !header.bitmap()->is_set(block_idx);
     }
 
     void set_alloc(size_t block_idx)
     {
-        header.block_map.set(block_idx);
+        header.bitmap()->set(block_idx);
     }
 
     void set_free(size_t block_idx)
     {
-        header.block_map.clear(block_idx);
+        header.bitmap()->clear(block_idx);
     }
 
     void set_slab(Slab* slab)
@@ -154,13 +383,80 @@ struct nvSlab
         header.slab = slab;
     }
 
-    size_t nblocks_free() 
+    int state() 
     {
-        size_t cnt=0; 
-        for (size_t i=0; i<nblocks(); i++) {
-            cnt = is_free(i) ? cnt + 1: cnt;
+        return header.state;
+    }
+
+    /**
+     * @brief Mark the slab as possibly having stale bitmap bits
+     */
+    void mark_dirty(PersistContext& ctx)
+    {
+        if (header.state != nvSlabHeader::kSlabStateDirty) {
+            header.state = nvSlabHeader::kSlabStateDirty;
+            ctx.add(&header, nvSlabHeader::size_of());
+            ctx.commit();
+        }
+    }
+
+    /**
+     * @brief Mark the slab bitmap as exact after all its updates have 
+     * been committed
+     */
+    void mark_clean(PersistContext& ctx)
+    {
+        if (header.state != nvSlabHeader::kSlabStateClean) {
+            header.state = nvSlabHeader::kSlabStateClean;
+            ctx.add(&header, nvSlabHeader::size_of());
+            ctx.commit();
+        }
+    }
+
+    /**
+     * @brief Add the bitmap entry tracking a block to a persistence context
+     */
+    void persist_block_state(size_t block_idx, PersistContext& ctx)
+    {
+        BitMap* bitmap = header.bitmap();
+        ctx.add(&bitmap->bv_[bitmap->elt(block_idx)], 1);
+    }
+
+    /**
+     * @brief Bring a slab left behind by a crash back to a consistent state
+     *
+     * @details
+     * A slab caught in the middle of reformatting was empty, so it is 
+     * formatted again with a class of @a size_classes. A dirty slab keeps its allocated bits, which are a 
+     * superset of the blocks handed out, so no allocation is lost; bits 
+     * outside the valid block range are cleared. 
+     *
+     * @return number of allocated blocks in the recovered slab
+     */
+    size_t recover(const SizeClassTable& size_classes)
+    {
+        PersistContext ctx;
+        if (header.state == nvSlabHeader::kSlabStateFormatting) {
+            int szclass = header.sizeclass < size_classes.nclasses() ? header.sizeclass : 0;
+            nvSlabHeader::remake(&header, size(), szclass, size_classes.size_from_class(szclass), ctx);
+            ctx.commit();
+        } else if (header.state == nvSlabHeader::kSlabStateDirty) {
+            size_t bitmap_nblocks = BitMap::size_of(nblocks()) * BitMap::kEntrySize;
+            for (size_t i=nblocks(); i<bitmap_nblocks; i++) {
+                if (header.bitmap()->is_set(i)) {
+                    header.bitmap()->clear(i);
+                    persist_block_state(i, ctx);
+                }
+            }
+            ctx.commit();
         }
-        return cnt;
+        mark_clean(ctx);
+        return nblocks() - nblocks_free();
+    }
+
+    size_t nblocks_free() 
+    {
+        return nblocks() - header.bitmap()->count(nblocks());
     }
 };
 
@@ -17,21 +17,153 @@
 #ifndef _ALPS_PERSIST_HH_
 #define _ALPS_PERSIST_HH_
 
-#ifdef __ARCH_NON_VOLATILE__
-#include <libpmem.h>
+#include <stddef.h>
+#include <stdint.h>
 
-static inline void persist(void *addr, size_t len)
+#include "alps/common/assorted_func.hh"
+
+#include "common/persist.hh"
+
+namespace alps {
+
+/**
+ * @brief Per-thread counters of persistence primitives issued
+ *
+ * @details
+ * Counters are maintained in all durability modes so that the number of 
+ * flushes and fences an operation would issue on non-volatile memory can be
+ * measured on volatile memory too.
+ */
+struct PersistCounters {
+    uint64_t ops;     // number of persist operations (persist() calls and context commits)
+    uint64_t flushes; // number of cache lines written back
+    uint64_t fences;  // number of store fences
+
+    void reset() {
+        ops = 0;
+        flushes = 0;
+        fences = 0;
+    }
+};
+
+inline PersistCounters& persist_counters()
 {
-    pmem_persist(addr, len);
+    static __thread PersistCounters counters = {0, 0, 0};
+    return counters;
 }
 
-#else
-static inline void persist(void *addr, size_t len)
+/**
+ * @brief Write back cache lines without ordering them, using the 
+ * durability mode selected at runtime
+ */
+inline void persist_flush_lines(const uintptr_t* lines, size_t nlines)
+{
+    durability_flush_lines(lines, nlines);
+    persist_counters().flushes += nlines;
+}
+
+/**
+ * @brief Order all previously issued write backs
+ */
+inline void persist_fence()
 {
-    // do nothing
-    return;
+    durability_fence();
+    persist_counters().fences++;
 }
 
-#endif
+/**
+ * @brief Collects the cache lines dirtied by a single allocator operation
+ * and makes them durable with a single fence.
+ *
+ * @details
+ * Cache lines are deduplicated as they are added so that adjacent fields
+ * sharing a cache line (e.g. consecutive block headers) are written back
+ * once, and in msync mode lines sharing a page are synced once. Lines are written back when the context runs out of slots or at
+ * commit(), but only commit() orders them, so a caller that needs an
+ * ordering point (e.g. before a linearization point) must commit.
+ * A commit with nothing pending elides the fence.
+ */
+class PersistContext {
+public:
+    static const size_t kMaxLines = 64;
+
+    PersistContext()
+        : nlines_(0),
+          nflushed_(0)
+    { }
+
+    ~PersistContext()
+    {
+        commit();
+    }
+
+    void add(const void* addr, size_t len)
+    {
+        if (len == 0) {
+            return;
+        }
+        uintptr_t first = line_of(reinterpret_cast<uintptr_t>(addr));
+        uintptr_t last = line_of(reinterpret_cast<uintptr_t>(addr) + len - 1);
+        for (uintptr_t line = first; line <= last; line += kCacheLineSize) {
+            add_line(line);
+        }
+    }
+
+    void commit()
+    {
+        flush_pending();
+        if (nflushed_ == 0) {
+            return;
+        }
+        persist_fence();
+        persist_counters().ops++;
+        nflushed_ = 0;
+    }
+
+    size_t pending() const { return nlines_; }
+
+private:
+    static uintptr_t line_of(uintptr_t addr)
+    {
+        return addr & ~(uintptr_t(kCacheLineSize) - 1);
+    }
+
+    void add_line(uintptr_t line)
+    {
+        // scan backwards as consecutive adds usually hit the most recent line
+        for (size_t i = nlines_; i > 0; i--) {
+            if (lines_[i-1] == line) {
+                return;
+            }
+        }
+        if (nlines_ == kMaxLines) {
+            flush_pending();
+        }
+        lines_[nlines_++] = line;
+    }
+
+    void flush_pending()
+    {
+        persist_flush_lines(lines_, nlines_);
+        nflushed_ += nlines_;
+        nlines_ = 0;
+    }
+
+    uintptr_t lines_[kMaxLines];
+    size_t    nlines_;
+    size_t    nflushed_;
+};
+
+} // namespace alps
+
+/**
+ * @brief Write back and order a single range
+ */
+static inline void persist(void *addr, size_t len)
+{
+    alps::PersistContext ctx;
+    ctx.add(addr, len);
+    ctx.commit();
+}
 
 #endif // _ALPS_PERSIST_HH_
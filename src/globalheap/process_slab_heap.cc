@@ -16,14 +16,35 @@
 
 #include "alps/common/error_code.hh"
 
+#include "common/event_trace.hh"
+
 #include "globalheap/process_slab_heap.hh"
 
 namespace alps {
 
-Slab* ProcessSlabHeap::acquire_slab(int szclass)
+Slab* ProcessSlabHeap::make_slab(int szclass, bool can_extend)
 {
     RRegion::TPtr<nvExtentHeader> nvexheader;
     RRegion::TPtr<void>           nvex;
+    ErrorCode                     rc;
+    size_t                        size = slab_size_for(szclass);
+
+    assert(extentheap_);
+    if (can_extend) {
+        rc = extentheap_->malloc(size, true, InsertSlabFunctor(this), &nvexheader, &nvex);
+    } else {
+        rc = extentheap_->malloc(size, false, NullEnumerateFunctor(), &nvexheader, &nvex);
+    }
+    if (rc != kErrorCodeOk) {
+        return NULL;
+    }
+    RRegion::TPtr<nvZone> nvzone = extentheap_->nvzone(nvex);
+    RRegion::TPtr<nvSlab> nvslab = nvSlab::make(nvzone, nvzone->block_id(nvex), size, szclass, *size_classes_);
+    return new Slab(nvslab, size_classes_);
+}
+
+Slab* ProcessSlabHeap::acquire_slab(int szclass, SlabHeap* owner)
+{
     Slab*                         slab;
     int                           retries = 1;
     
@@ -31,6 +52,8 @@ Slab* ProcessSlabHeap::acquire_slab(int szclass)
 
     lock();
     LOG(info) << "acquire_slab: locked";
+    drain_deferred_frees();
+    new_slabs_[szclass]++;
 
     // If there is no available slab and extentheap has no space left then retry 
     // a few times to extend the extentheap's size and reuse partially-full slabs 
@@ -39,33 +62,147 @@ Slab* ProcessSlabHeap::acquire_slab(int szclass)
         slab = find_slab(szclass);
         if (slab) {
             remove_slab(slab);
+            slab->set_owner(owner);
             LOG(info) << "acquire_slab: unlock slab: " << slab;
             unlock();
+            TRACE_EVENT(kEventAcquireSlab, szclass, slab->nvslab().offset());
             return slab;
         }
-        assert(extentheap_);
-        if (extentheap_->malloc(slab_size, false, NullEnumerateFunctor(), &nvexheader, &nvex) == kErrorCodeOk) {
-            RRegion::TPtr<nvSlab> nvslab = nvSlab::make(nvexheader, nvex, szclass);
-            slab = new Slab(nvslab);
+        if ((slab = make_slab(szclass, false)) != NULL) {
+            slab->set_owner(owner);
             LOG(info) << "acquire_slab: unlock 2";
             unlock();
+            TRACE_EVENT(kEventAcquireSlab, szclass, slab->nvslab().offset());
             return slab;
         }
+        HEAP_STATS(stats_.oom_fallbacks++);
         extentheap_->more_space(1, InsertSlabFunctor(this));
     }
     // No partially full slabs; try to allocate a new slab
-    ErrorCode rc = extentheap_->malloc(slab_size, true, InsertSlabFunctor(this), &nvexheader, &nvex); 
-    if (rc != kErrorCodeOk) {
-        slab = NULL;
+    if ((slab = make_slab(szclass, true)) == NULL) {
+        HEAP_STATS(stats_.oom_failures++);
     } else {
-        RRegion::TPtr<nvSlab> nvslab = nvSlab::make(nvexheader, nvex, szclass);
-        slab = new Slab(nvslab);
+        slab->set_owner(owner);
     }
     LOG(info) << "acquire_slab: unlock 3: slab=" << slab;
     unlock();
+    TRACE_EVENT(kEventAcquireSlab, szclass, slab ? slab->nvslab().offset() : 0);
     return slab;
 }
 
+int ProcessSlabHeap::reserve_zones(size_t watermark)
+{
+    size_t free_nblocks;
+    size_t total_nblocks;
+
+    extentheap_->space(&free_nblocks, &total_nblocks);
+    if (free_nblocks * 100 >= watermark * total_nblocks) {
+        return 0;
+    }
+    lock();
+    int nzones = extentheap_->more_space(1, InsertSlabFunctor(this));
+    unlock();
+    return nzones;
+}
+
+size_t ProcessSlabHeap::prepare_slabs(size_t nslabs)
+{
+    std::vector<int> szclasses;
+
+    // Find out how many slabs each hot class lacks
+    lock();
+    for (int c=0; c<size_classes_->nclasses(); c++) {
+        if (new_slabs_[c] == 0) {
+            continue;
+        }
+        new_slabs_[c] = 0;
+        size_t nready = 0;
+        ready_slabs(c, &nready);
+        for (; nready < nslabs; nready++) {
+            szclasses.push_back(c);
+        }
+    }
+    unlock();
+
+    // Format the slabs without holding the lock. A slab formatted but not
+    // inserted yet is found by recovery like any other slab.
+    std::vector<Slab*> slabs;
+    for (size_t i=0; i<szclasses.size(); i++) {
+        Slab* slab = make_slab(szclasses[i], false);
+        if (!slab) {
+            break;
+        }
+        slabs.push_back(slab);
+    }
+
+    lock();
+    for (size_t i=0; i<slabs.size(); i++) {
+        insert_slab(slabs[i], slabs[i]->sizeclass());
+    }
+    unlock();
+    return slabs.size();
+}
+
+size_t ProcessSlabHeap::ready_slabs(int szclass, size_t* nslabs)
+{
+    size_t size = slab_size_for(szclass);
+    size_t nblocks = 0;
+    *nslabs = 0;
+    for (SlabList::iterator it = empty_slabs_.begin(); it != empty_slabs_.end(); it++) {
+        if ((*it)->sizeclass() == szclass && (*it)->nvslab()->size() == size) {
+            nblocks += (*it)->nblocks();
+            (*nslabs)++;
+        }
+    }
+    return nblocks;
+}
+
+int ProcessSlabHeap::reserve_blocks(int szclass, size_t nblocks)
+{
+    int rc = 0;
+    size_t nslabs;
+
+    lock();
+    drain_deferred_frees();
+    size_t nready = ready_slabs(szclass, &nslabs);
+    while (nready < nblocks) {
+        Slab* slab = make_slab(szclass, true);
+        if (!slab) {
+            HEAP_STATS(stats_.oom_failures++);
+            rc = -1;
+            break;
+        }
+        insert_slab(slab, szclass);
+        nready += slab->nblocks();
+    }
+    unlock();
+    return rc;
+}
+
+int ProcessSlabHeap::reserve_extents(size_t size, size_t count)
+{
+    size_t block_size = extentheap_->block_size();
+    size_t nblocks = count * ((size + block_size - 1) / block_size);
+    int rc = 0;
+
+    lock();
+    for (;;) {
+        size_t free_nblocks;
+        size_t total_nblocks;
+        extentheap_->space(&free_nblocks, &total_nblocks);
+        if (free_nblocks >= nblocks) {
+            break;
+        }
+        if (extentheap_->more_space(1, InsertSlabFunctor(this)) == 0) {
+            HEAP_STATS(stats_.oom_failures++);
+            rc = -1;
+            break;
+        }
+    }
+    unlock();
+    return rc;
+}
+
 RRegion::TPtr<void> ProcessSlabHeap::malloc(size_t size)
 {
     RRegion::TPtr<nvExtentHeader> nvexheader;
@@ -73,8 +210,11 @@ RRegion::TPtr<void> ProcessSlabHeap::malloc(size_t size)
 
     lock();
     if (extentheap_->malloc(size, true, InsertSlabFunctor(this), &nvexheader, &nvex) != kErrorCodeOk) {
+        HEAP_STATS(stats_.oom_failures++);
         nvex = null_ptr;
-    } 
+    } else {
+        HEAP_STATS(stats_.large_mallocs++);
+    }
     unlock();
     return nvex;
 }
@@ -92,32 +232,47 @@ void ProcessSlabHeap::free(RRegion::TPtr<void> ptr)
 
     // Check if this is a pointer to a large block: a large block is 
     // allocated directly as an extent and therefore it is aligned at 
-    // at a multiple of block size
+    // the first block of the extent. The first small block of a slab may
+    // be aligned there too when the slab header lives in the zone's 
+    // metadata area, so the extent must also not be a slab.
     RRegion::TPtr<nvBlock> nvzone_blocks = nvzone->block(0);
-    if ((RRegion::TPtr<char>(ptr) - (RRegion::TPtr<char>(nvzone_blocks))) % BLOCK_SIZE == 0) {
+    size_t block_id = nvzone->block_id(ptr);
+    if ((RRegion::TPtr<char>(ptr) - (RRegion::TPtr<char>(nvzone_blocks))) % nvzone->block_size() == 0 &&
+        nvzone->block_header(block_id)->primary_type == nvBlockHeader::kBlockTypeExtentFirst &&
+        nvzone->block_header(block_id)->secondary_type != nvExtentHeader::kExtentTypeSlab) 
+    {
         return extentheap_->free(zone, ptr);
     }
 
-    // This is a pointer to a small block; locate the nvslab/slab 
-    size_t block_id = (RRegion::TPtr<char>(ptr) - RRegion::TPtr<char>(nvzone_blocks)) / BLOCK_SIZE;
-    RRegion::TPtr<nvBlock> nvblock = nvzone->block(block_id);
-    RRegion::TPtr<nvSlab> nvslab = static_cast<RRegion::TPtr<nvSlab> >(nvblock);
+    // This is a pointer to a small block; locate the nvslab/slab at the 
+    // first block of the slab's extent
+    while (nvzone->block_header(block_id)->primary_type == nvBlockHeader::kBlockTypeExtentRun) {
+        block_id--;
+    }
+    RRegion::TPtr<nvSlab> nvslab = nvSlab::at(nvzone, block_id);
     Slab* slab = nvslab->header.slab;
 
-    // Expect this to finish after a few iterations as a slab that is 
-    // being moved between two slab-heaps eventually ends up in a single
-    // slabheap
-    for (;;) {
-        SlabHeap* owner = slab->owner();
-        if (owner) {
-            owner->lock();
-            if (owner == slab->owner()) {
-                owner->free_block(slab, ptr);
-                owner->unlock();
-                break;
-            }
-            owner->unlock();
+    // Free directly if the owner is idle; otherwise leave the free to the
+    // owner rather than wait for it. The owner cannot change while we hold 
+    // its lock, as slabs move between heaps under the lock of their owner.
+    SlabHeap* owner = slab->owner();
+    bool direct = owner->try_lock();
+    if (direct) {
+        if (owner == slab->owner()) {
+            owner->drain_deferred_frees();
+            owner->free_block(slab, ptr);
+        } else {
+            direct = false;
         }
+        owner->unlock();
+    }
+    if (!direct && slab->defer_free(ptr)) {
+        // if the slab moves before the owner drains it, the owner passes
+        // it on to the new one
+        slab->owner()->queue_deferred(slab);
+    }
+    if (lock_profile_enabled()) {
+        lock_profile_record(kLockSiteSlabOwner, !direct, 0);
     }
 }
 
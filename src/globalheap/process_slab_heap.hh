@@ -32,16 +32,74 @@ namespace alps {
 class ProcessSlabHeap: public SlabHeap 
 {
 public:
-    ProcessSlabHeap(ExtentHeap* extentheap)
-        : SlabHeap(extentheap)
-    { }
+    ProcessSlabHeap(ExtentHeap* extentheap, const SizeClassTable* size_classes = &default_size_classes)
+        : SlabHeap(extentheap, kLockSiteProcessSlabHeap, size_classes)
+    { 
+        for (int i=0; i<kSizeClasses; i++) {
+            new_slabs_[i] = 0;
+        }
+    }
 
     /**
      * @brief Returns a slab that supports sizeclass \a szclass.
+     *
+     * @details
+     * The slab is handed to slab heap \a owner, which the caller has 
+     * locked and must insert the slab into.
      */
-    Slab* acquire_slab(int szclass);
+    Slab* acquire_slab(int szclass, SlabHeap* owner);
     RRegion::TPtr<void> malloc(size_t size);
     void free(RRegion::TPtr<void> ptr);
+
+    /**
+     * @brief Lease another zone if less than @a watermark percent of the 
+     * blocks of the zones already leased are free
+     *
+     * @return number of zones leased
+     */
+    int reserve_zones(size_t watermark);
+
+    /**
+     * @brief Format empty slabs from leased zones so that each size class 
+     * that was handed a slab since the previous call has @a nslabs of 
+     * them ready
+     *
+     * @return number of slabs formatted
+     */
+    size_t prepare_slabs(size_t nslabs);
+
+    /**
+     * @brief Make sure empty slabs formatted for size class @a szclass 
+     * hold at least @a nblocks blocks, leasing zones as needed
+     *
+     * @return zero if success, or -1 if the heap ran out of space
+     */
+    int reserve_blocks(int szclass, size_t nblocks);
+
+    /**
+     * @brief Lease zones until the leased zones have free space for 
+     * @a count extents of @a size bytes
+     *
+     * @return zero if success, or -1 if the heap ran out of space
+     */
+    int reserve_extents(size_t size, size_t count);
+
+private:
+    /**
+     * @brief Format a new slab of size class @a szclass from a free 
+     * extent, leasing a zone if @a can_extend, in which case the caller 
+     * must hold the lock
+     */
+    Slab* make_slab(int szclass, bool can_extend);
+
+    /**
+     * @brief Count the empty slabs formatted for size class @a szclass 
+     * into @a nslabs and return their blocks
+     */
+    size_t ready_slabs(int szclass, size_t* nslabs);
+
+private:
+    size_t new_slabs_[kSizeClasses]; // slabs handed out per class since the last prepare_slabs
 };
 
 } // namespace alps
@@ -0,0 +1,337 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file replay.cc
+ *
+ * @brief Replays an allocation trace recorded by a heap instance (see
+ * StatsOptions::trace_dir) against a fresh heap.
+ *
+ * @details
+ * Each traced thread is replayed by its own thread. In timed mode every
+ * operation is issued at the same offset from the start of the replay as
+ * it was from the start of the trace, which reproduces the original
+ * interleaving of threads. In fast mode threads issue their operations
+ * back to back. In both modes a free of a block allocated by another
+ * thread waits until that thread has replayed the allocation.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include "alps/common/assorted_func.hh"
+#include "alps/pegasus/pegasus.hh"
+
+#include "globalheap/globalheap_internal.hh"
+#include "globalheap/trace.hh"
+
+using namespace alps;
+
+#define PROGNAME argv[0]
+
+struct ReplayOp {
+    static const size_t kNoBlock = SIZE_MAX;
+
+    uint64_t timestamp_ns;
+    uint16_t op;
+    uint16_t ig;
+    uint64_t size;
+    size_t   block; // index of the replayed block the operation allocates or frees
+};
+
+/**
+ * @brief Addresses of the blocks allocated by the replay, indexed by block
+ */
+class ReplayBlocks {
+public:
+    static const uint64_t kPending = 0;
+    static const uint64_t kFailed = 1;
+
+public:
+    ReplayBlocks(size_t nblocks)
+        : blocks_(nblocks)
+    {
+        for (size_t i=0; i<nblocks; i++) {
+            blocks_[i] = kPending;
+        }
+    }
+
+    void set(size_t block, RRegion::TPtr<void> ptr)
+    {
+        blocks_[block].store(ptr == null_ptr ? kFailed : reinterpret_cast<uint64_t>(ptr.get()),
+                             std::memory_order_release);
+    }
+
+    // waits for the thread that allocates the block
+    uint64_t get(size_t block)
+    {
+        uint64_t vaddr;
+        while ((vaddr = blocks_[block].load(std::memory_order_acquire)) == kPending) {
+            std::this_thread::yield();
+        }
+        return vaddr;
+    }
+
+private:
+    std::vector<std::atomic<uint64_t> > blocks_;
+};
+
+struct ReplayResult {
+    size_t mallocs;
+    size_t frees;
+    size_t failed_mallocs;
+};
+
+/**
+ * @brief Split the trace into per-thread operation sequences and match
+ * every free with the allocation of the block it frees
+ *
+ * @details
+ * Frees of blocks allocated before the trace started have no match and
+ * are dropped.
+ */
+size_t prepare_replay(const std::vector<TraceRecord>& records,
+                      std::vector<std::vector<ReplayOp> >* threads,
+                      size_t* unmatched_frees)
+{
+    std::map<uint32_t, size_t> thread_index;
+    std::unordered_map<uint64_t, size_t> live;
+    size_t nblocks = 0;
+
+    *unmatched_frees = 0;
+    for (std::vector<TraceRecord>::const_iterator it = records.begin(); it != records.end(); it++) {
+        ReplayOp op;
+        op.timestamp_ns = it->timestamp_ns;
+        op.op = it->op;
+        op.ig = it->ig;
+        op.size = it->size;
+        op.block = ReplayOp::kNoBlock;
+        if (it->op == TraceRecord::kOpMalloc) {
+            if (it->offset != 0) {
+                op.block = nblocks++;
+                live[it->offset] = op.block;
+            }
+        } else if (it->op == TraceRecord::kOpFree) {
+            std::unordered_map<uint64_t, size_t>::iterator l = live.find(it->offset);
+            if (l == live.end()) {
+                (*unmatched_frees)++;
+                continue;
+            }
+            op.block = l->second;
+            live.erase(l);
+        } else {
+            continue;
+        }
+        if (thread_index.find(it->thread) == thread_index.end()) {
+            thread_index[it->thread] = threads->size();
+            threads->push_back(std::vector<ReplayOp>());
+        }
+        (*threads)[thread_index[it->thread]].push_back(op);
+    }
+    return nblocks;
+}
+
+void replay_thread(GlobalHeapInternal* heap, const std::vector<ReplayOp>* ops, ReplayBlocks* blocks,
+                   bool timed, std::chrono::steady_clock::time_point start, ReplayResult* result)
+{
+    result->mallocs = 0;
+    result->frees = 0;
+    result->failed_mallocs = 0;
+    for (std::vector<ReplayOp>::const_iterator it = ops->begin(); it != ops->end(); it++) {
+        if (timed) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(it->timestamp_ns));
+        }
+        if (it->op == TraceRecord::kOpMalloc) {
+            RRegion::TPtr<void> ptr = null_ptr;
+            if (it->ig != TraceRecord::kAnyIg) {
+                ptr = heap->malloc(it->size, MemAttrib(it->ig));
+            }
+            if (ptr == null_ptr) {
+                // the replay heap may not have the interleave group of the traced heap
+                ptr = heap->malloc(it->size);
+            }
+            if (ptr == null_ptr) {
+                result->failed_mallocs++;
+            }
+            if (it->block != ReplayOp::kNoBlock) {
+                blocks->set(it->block, ptr);
+            }
+            result->mallocs++;
+        } else {
+            uint64_t vaddr = blocks->get(it->block);
+            if (vaddr != ReplayBlocks::kFailed) {
+                heap->free(RRegion::TPtr<void>(reinterpret_cast<void*>(vaddr)));
+                result->frees++;
+            }
+        }
+    }
+}
+
+int replay_trace(std::string trace_path, std::string heap_path, size_t heap_size, size_t metazone_size, bool timed, bool keep)
+{
+    TraceHeader header;
+    std::vector<TraceRecord> records;
+    if (read_trace(trace_path, &header, &records) != 0) {
+        std::cout << "ERROR: Cannot read trace " << trace_path << std::endl;
+        return -1;
+    }
+    if (boost::filesystem::exists(heap_path)) {
+        std::cout << "ERROR: Heap " << heap_path << " already exists!" << std::endl;
+        return -1;
+    }
+
+    std::vector<std::vector<ReplayOp> > threads;
+    size_t unmatched_frees;
+    size_t nblocks = prepare_replay(records, &threads, &unmatched_frees);
+    ReplayBlocks blocks(nblocks);
+
+    GlobalHeapInternal* heap;
+    if (GlobalHeapInternal::create(heap_path.c_str(), heap_size ? heap_size : header.heap_size,
+                                   metazone_size ? metazone_size : header.metazone_size, &heap) != 0)
+    {
+        std::cout << "ERROR: Cannot create heap " << heap_path << std::endl;
+        return -1;
+    }
+
+    std::vector<ReplayResult> results(threads.size());
+    std::vector<std::thread> replayers;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i=0; i<threads.size(); i++) {
+        replayers.push_back(std::thread(replay_thread, heap, &threads[i], &blocks, timed, start, &results[i]));
+    }
+    for (auto& t: replayers) {
+        t.join();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ReplayResult total = {0, 0, 0};
+    for (auto& r: results) {
+        total.mallocs += r.mallocs;
+        total.frees += r.frees;
+        total.failed_mallocs += r.failed_mallocs;
+    }
+    double trace_secs = records.empty() ? 0 : records.back().timestamp_ns / 1e9;
+
+    std::cout << "trace: " << trace_path << " (pid " << header.pid << ", generation " << header.generation << ")" << std::endl;
+    std::cout << "records: " << records.size() << std::endl;
+    std::cout << "threads: " << threads.size() << std::endl;
+    std::cout << "unmatched_frees: " << unmatched_frees << std::endl;
+    std::cout << "mallocs: " << total.mallocs << std::endl;
+    std::cout << "frees: " << total.frees << std::endl;
+    std::cout << "failed_mallocs: " << total.failed_mallocs << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "trace_secs: " << trace_secs << std::endl;
+    std::cout << "replay_secs: " << secs << std::endl;
+    std::cout << std::setprecision(0);
+    std::cout << "ops/s: " << (total.mallocs + total.frees) / secs << std::endl;
+    std::cout << heap->stats();
+
+    heap->close();
+    if (!keep) {
+        boost::filesystem::remove(heap_path);
+        boost::filesystem::remove(heap_path + ".xattr");
+    }
+    return 0;
+}
+
+int usage(std::string progname, boost::program_options::options_description desc, int rc = 0)
+{
+    std::cerr << "Usage: " << progname << " [options] trace" << std::endl
+              << desc << std::endl;
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    std::string progname = PROGNAME;
+    po::options_description desc("Options");
+
+    try
+    {
+        desc.add_options()
+            ("help", "Print help messages")
+            ("config", po::value<std::string>(), "File to load Alps/Pegasus configuration options from")
+            ("log_level", po::value<std::string>()->default_value("warning"), "Log messages at or above this level: INFO, WARNING, ERROR, and FATAL")
+            ("trace", po::value<std::string>()->required(), "Trace file to replay")
+            ("heappath", po::value<std::string>()->required(), "Path of the fresh heap to replay against (must not exist)")
+            ("size", po::value<std::string>(), "Heap size in bytes (default: size of the traced heap)")
+            ("metazone_size", po::value<std::string>(), "Metazone size in bytes (default: metazone size of the traced heap)")
+            ("mode", po::value<std::string>()->default_value("timed"), "Replay mode: timed (original interleaving) or fast (as fast as possible)")
+            ("keep", "Keep the heap after the replay");
+
+        po::positional_options_description positionalOptions;
+        positionalOptions.add("trace", 1);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positionalOptions).run(), vm);
+        if (vm.count("help")) {
+            return usage(progname, desc);
+        }
+        po::notify(vm);
+
+        std::string mode = vm["mode"].as<std::string>();
+        if (mode != "timed" && mode != "fast") {
+            std::cerr << "ERROR: Unknown replay mode " << mode << std::endl;
+            return usage(progname, desc, -1);
+        }
+
+        // Initialize Pegasus
+        PegasusOptions pgopt;
+        const char* config_file = NULL;
+        if (vm.count("config")) {
+            config_file = vm["config"].as<std::string>().c_str();
+        }
+        Pegasus::load_options(config_file, true, true, &pgopt);
+        std::string log_level = vm["log_level"].as<std::string>();
+        std::transform(log_level.begin(), log_level.end(), log_level.begin(), ::tolower);
+        pgopt.debug_options.log_level = log_level;
+        // do not trace the replay itself
+        pgopt.stats_options.trace_dir = "";
+        Pegasus::init(pgopt);
+
+        size_t heap_size = vm.count("size") ? string_to_size(vm["size"].as<std::string>()) : 0;
+        size_t metazone_size = vm.count("metazone_size") ? string_to_size(vm["metazone_size"].as<std::string>()) : 0;
+        if (replay_trace(vm["trace"].as<std::string>(), vm["heappath"].as<std::string>(),
+                         heap_size, metazone_size, mode == "timed", vm.count("keep") > 0) != 0)
+        {
+            return -1;
+        }
+    }
+    catch(po::error& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Unhandled Exception reached the top of main: "
+                  << e.what() << ", application will now exit" << std::endl;
+        return usage(progname, desc, -1);
+    }
+    return 0;
+}
@@ -18,54 +18,155 @@
 #define _ALPS_RWLOCK_HH_
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 
-namespace alps {
+#include <atomic>
+
+#include "globalheap/stats.hh"
 
-#define NUM_MUTEX 8
+namespace alps {
 
+/**
+ * @brief Reader-writer lock with distributed reader indicators and writer 
+ * preference
+ *
+ * @details
+ * Each reader announces itself by incrementing one of kReaderSlots 
+ * counters, picked by thread and padded to a cache line, so that readers 
+ * do not share cache lines unless more than kReaderSlots threads use the 
+ * lock. A reader that finds a writer active withdraws and waits for the 
+ * writer on writer_mutex_; new readers therefore cannot starve a writer.
+ * A writer serializes with other writers on writer_mutex_, raises 
+ * writer_ and waits for every slot to drain. 
+ *
+ * This is the reader indicator scheme of BRAVO without the underlying 
+ * lock: writers are rare here (zone acquisition and heap binding) while 
+ * readers sit on every allocation, so readers always take the 
+ * distributed path and writers always pay for the scan. The lock is not 
+ * recursive.
+ */
 class ReaderWriterLock {
 public:
-    ReaderWriterLock()
+    static const int kReaderSlots = 64;
+
+public:
+    ReaderWriterLock(LockSite read_site, LockSite write_site)
+        : writer_(false),
+          read_site_(read_site),
+          write_site_(write_site)
     {
-        for (int i=0; i<NUM_MUTEX; i++) {
-            pthread_mutex_init(&mutex_[i], NULL);
+        pthread_mutex_init(&writer_mutex_, NULL);
+        for (int i=0; i<kReaderSlots; i++) {
+            readers_[i].count.store(0, std::memory_order_relaxed);
         }
     }
 
-
     void lock_read();
     void lock_write();
     void unlock_read();
     void unlock_write();
 
 private:
-    pthread_mutex_t mutex_[NUM_MUTEX];
+    // padded rather than aligned as the lock is embedded in heap-allocated
+    // structures, which operator new does not align beyond 16 bytes
+    struct ReaderSlot {
+        std::atomic<uint64_t> count;
+        char                  pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static int reader_slot();
+
+    bool try_lock_read(ReaderSlot* slot);
+
+private:
+    ReaderSlot        readers_[kReaderSlots];
+    std::atomic<bool> writer_;       // a writer holds or waits for the lock
+    pthread_mutex_t   writer_mutex_; // serializes writers; readers wait on it for the writer
+    LockSite          read_site_;    // lock profile sites
+    LockSite          write_site_;
 };
 
+/**
+ * @brief Reader slot of the calling thread, assigned round-robin on first
+ * use and shared by all locks
+ */
+inline int ReaderWriterLock::reader_slot()
+{
+    static std::atomic<int> nthreads(0);
+    static __thread int slot = -1;
+    if (slot < 0) {
+        slot = nthreads++ % kReaderSlots;
+    }
+    return slot;
+}
+
+inline bool ReaderWriterLock::try_lock_read(ReaderSlot* slot)
+{
+    // pairs with the store of writer_ and the scan of the slots in 
+    // lock_write: either the writer sees our count or we see writer_
+    slot->count.fetch_add(1, std::memory_order_seq_cst);
+    if (!writer_.load(std::memory_order_seq_cst)) {
+        return true;
+    }
+    slot->count.fetch_sub(1, std::memory_order_release);
+    return false;
+}
+
 inline void ReaderWriterLock::lock_read()
 {
-    int i = pthread_self() % NUM_MUTEX;
-    pthread_mutex_lock(&mutex_[i]);
+    ReaderSlot* slot = &readers_[reader_slot()];
+    bool profile = lock_profile_enabled();
+
+    if (try_lock_read(slot)) {
+        if (profile) {
+            lock_profile_record(read_site_, false, 0);
+        }
+        return;
+    }
+    uint64_t start = profile ? stats_clock_ns() : 0;
+    do {
+        // block until the writer is done
+        pthread_mutex_lock(&writer_mutex_);
+        pthread_mutex_unlock(&writer_mutex_);
+    } while (!try_lock_read(slot));
+    if (profile) {
+        lock_profile_record(read_site_, true, stats_clock_ns() - start);
+    }
 }
 
 inline void ReaderWriterLock::unlock_read()
 {
-    int i = pthread_self() % NUM_MUTEX;
-    pthread_mutex_unlock(&mutex_[i]);
+    readers_[reader_slot()].count.fetch_sub(1, std::memory_order_release);
 }
 
 inline void ReaderWriterLock::lock_write()
 {
-    for (int i=0; i<NUM_MUTEX; i++) {
-        pthread_mutex_lock(&mutex_[i]);
+    bool profile = lock_profile_enabled();
+    uint64_t start = 0;
+
+    if (pthread_mutex_trylock(&writer_mutex_) != 0) {
+        start = profile ? stats_clock_ns() : 1;
+        pthread_mutex_lock(&writer_mutex_);
+    }
+    writer_.store(true, std::memory_order_seq_cst);
+    for (int i=0; i<kReaderSlots; i++) {
+        while (readers_[i].count.load(std::memory_order_seq_cst) != 0) {
+            if (start == 0) {
+                start = profile ? stats_clock_ns() : 1;
+            }
+            sched_yield();
+        }
+    }
+    if (profile) {
+        lock_profile_record(write_site_, start != 0, start ? stats_clock_ns() - start : 0);
     }
 }
 
 inline void ReaderWriterLock::unlock_write()
 {
-    for (int i=0; i<NUM_MUTEX; i++) {
-        pthread_mutex_unlock(&mutex_[i]);
-    }
+    writer_.store(false, std::memory_order_release);
+    pthread_mutex_unlock(&writer_mutex_);
 }
 
 
@@ -0,0 +1,135 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "globalheap/size_class_table.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+#include "common/log.hh"
+
+namespace alps {
+
+const size_t SizeClassTable::kAlignment;
+const size_t SizeClassTable::kMaxSmallSize;
+const size_t SizeClassTable::kMaxClassSize;
+
+const SizeClassTable default_size_classes;
+
+SizeClassTable::SizeClassTable()
+    : nclasses_(kSizeClasses)
+{
+    std::copy(size_table, size_table + kSizeClasses, sizes_);
+}
+
+int SizeClassTable::set(const std::vector<size_t>& sizes)
+{
+    if (sizes.empty() || sizes.size() > static_cast<size_t>(kSizeClasses)) {
+        LOG(error) << "Size class table must have between 1 and " << kSizeClasses << " classes";
+        return -1;
+    }
+    for (size_t i = 0; i < sizes.size(); i++) {
+        if (sizes[i] == 0 || sizes[i] % kAlignment != 0 || (i > 0 && sizes[i] <= sizes[i-1])) {
+            LOG(error) << "Size classes must be increasing multiples of " << kAlignment << ": " << sizes[i];
+            return -1;
+        }
+    }
+    if (sizes.back() < kMaxSmallSize || sizes.back() > kMaxClassSize) {
+        LOG(error) << "Largest size class must be between " << kMaxSmallSize << " and " << kMaxClassSize;
+        return -1;
+    }
+    nclasses_ = sizes.size();
+    std::copy(sizes.begin(), sizes.end(), sizes_);
+    return 0;
+}
+
+bool SizeClassTable::is_default() const
+{
+    return nclasses_ == kSizeClasses && std::equal(sizes_, sizes_ + nclasses_, size_table);
+}
+
+uint64_t SizeClassTable::rounding_waste(const std::map<size_t, uint64_t>& histogram) const
+{
+    uint64_t waste = 0;
+    for (std::map<size_t, uint64_t>::const_iterator it = histogram.begin(); it != histogram.end(); it++) {
+        if (it->first <= kMaxSmallSize) {
+            waste += (size_from_class(sizeclass(it->first)) - it->first) * it->second;
+        }
+    }
+    return waste;
+}
+
+int profile_size_classes(const std::map<size_t, uint64_t>& histogram, int nclasses, std::vector<size_t>* sizes)
+{
+    std::set<size_t> classes;
+    for (size_t s = SizeClassTable::kAlignment; s <= SizeClassTable::kMaxSmallSize; s *= 2) {
+        classes.insert(s);
+    }
+    if (nclasses < static_cast<int>(classes.size()) || nclasses > kSizeClasses) {
+        LOG(error) << "Number of size classes must be between " << classes.size() << " and " << kSizeClasses;
+        return -1;
+    }
+
+    // candidate classes are the profiled sizes rounded up to the alignment;
+    // cumulative[i] counts the allocations of candidates[0..i]
+    std::map<size_t, uint64_t> rounded;
+    for (std::map<size_t, uint64_t>::const_iterator it = histogram.begin(); it != histogram.end(); it++) {
+        if (it->first <= SizeClassTable::kMaxSmallSize) {
+            size_t size = std::max(it->first, SizeClassTable::kAlignment);
+            rounded[(size + SizeClassTable::kAlignment - 1) / SizeClassTable::kAlignment * SizeClassTable::kAlignment] += it->second;
+        }
+    }
+    std::vector<size_t> candidates;
+    std::vector<uint64_t> cumulative;
+    for (std::map<size_t, uint64_t>::const_iterator it = rounded.begin(); it != rounded.end(); it++) {
+        candidates.push_back(it->first);
+        cumulative.push_back((cumulative.empty() ? 0 : cumulative.back()) + it->second);
+    }
+    // allocations of sizes up to and including size
+    auto count_upto = [&](size_t size) -> uint64_t {
+        size_t n = std::upper_bound(candidates.begin(), candidates.end(), size) - candidates.begin();
+        return n ? cumulative[n-1] : 0;
+    };
+
+    while (static_cast<int>(classes.size()) < nclasses) {
+        // adding class c between classes lo and hi saves hi - c bytes on
+        // every allocation of a size in (lo, c]
+        size_t best = 0;
+        uint64_t best_saving = 0;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            size_t c = candidates[i];
+            std::set<size_t>::iterator hi = classes.lower_bound(c);
+            if (*hi == c) {
+                continue;
+            }
+            size_t lo = hi == classes.begin() ? 0 : *std::prev(hi);
+            uint64_t saving = (*hi - c) * (count_upto(c) - count_upto(lo));
+            if (saving > best_saving) {
+                best = c;
+                best_saving = saving;
+            }
+        }
+        if (best_saving == 0) {
+            break;
+        }
+        classes.insert(best);
+    }
+    sizes->assign(classes.begin(), classes.end());
+    return 0;
+}
+
+} // namespace alps
@@ -0,0 +1,124 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_GLOBALHEAP_SIZE_CLASS_TABLE_HH_
+#define _ALPS_GLOBALHEAP_SIZE_CLASS_TABLE_HH_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <vector>
+
+#include "globalheap/size_class.hh"
+
+namespace alps {
+
+/**
+ * @brief Size classes of a heap
+ *
+ * @details
+ * A heap stores its size classes in its header when it is created (see
+ * nvHeapHeader), so different heaps can round small blocks differently.
+ * Heaps created without a table, including heaps created before tables
+ * were stored, use the default classes of size_class.hh. kSizeClasses is 
+ * the maximum number of classes of a table.
+ */
+class SizeClassTable {
+public:
+    static const size_t kAlignment = 8;               // classes are multiples of this
+    static const size_t kMaxSmallSize = 128*1024;     // largest size served from slabs
+    static const size_t kMaxClassSize = 245760;       // largest block that fits a slab
+
+public:
+    /**
+     * @brief Construct the default table
+     */
+    SizeClassTable();
+
+    /**
+     * @brief Replace the classes with @a sizes 
+     *
+     * @details
+     * Fails, leaving the table unchanged, unless the sizes are strictly
+     * increasing multiples of kAlignment, the largest of which is between 
+     * kMaxSmallSize and kMaxClassSize, and there are at most kSizeClasses
+     * of them.
+     */
+    int set(const std::vector<size_t>& sizes);
+
+    int nclasses() const
+    {
+        return nclasses_;
+    }
+
+    size_t size_from_class(int sizeclass) const
+    {
+        return sizes_[sizeclass];
+    }
+
+    /**
+     * @brief Return the smallest class that fits @a size, which must not
+     * exceed kMaxSmallSize
+     */
+    int sizeclass(size_t size) const
+    {
+        int sizeclass = 0;
+        while (sizes_[sizeclass] < size) {
+            sizeclass++;
+        }
+        return sizeclass;
+    }
+
+    /**
+     * @brief Whether the table has the default classes
+     */
+    bool is_default() const;
+
+    std::vector<size_t> sizes() const
+    {
+        return std::vector<size_t>(sizes_, sizes_ + nclasses_);
+    }
+
+    /**
+     * @brief Bytes lost to rounding allocations of the sizes in 
+     * @a histogram (size to number of allocations) up to their class
+     */
+    uint64_t rounding_waste(const std::map<size_t, uint64_t>& histogram) const;
+
+private:
+    int    nclasses_;
+    size_t sizes_[kSizeClasses];
+};
+
+extern const SizeClassTable default_size_classes;
+
+/**
+ * @brief Build a table of at most @a nclasses classes that keeps the 
+ * rounding waste of the allocation sizes in @a histogram low
+ *
+ * @details
+ * The table starts with power-of-two classes from kAlignment to 
+ * kMaxSmallSize, so that sizes missing from the histogram waste at most
+ * half their block, and then greedily adds the class that saves the most
+ * bytes for the histogram until no class saves any or the table is full.
+ * Sizes above kMaxSmallSize are allocated as extents and ignored.
+ */
+int profile_size_classes(const std::map<size_t, uint64_t>& histogram, int nclasses, std::vector<size_t>* sizes);
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_SIZE_CLASS_TABLE_HH_
@@ -20,14 +20,24 @@
 #include <algorithm>
 
 #include "common/debug.hh"
+#include "common/event_trace.hh"
+#include "common/persist.hh"
 #include "globalheap/slab.hh"
 #include "globalheap/slab_heap.hh"
 
 namespace alps {
 
+bool slab_coloring = true;
+
 void Slab::init()
 {   
     pthread_mutex_init(&pin_mutex_, NULL);
+    if (nvslab_->state() != nvSlabHeader::kSlabStateClean) {
+        size_t nallocated = nvslab_->recover(*size_classes_);
+        LOG(info) << "Recovered slab: " << "nvslab: " << nvslab_ << " allocated blocks: " << nallocated;
+    }
+    reserved_.clear();
+    pending_frees_.clear();
     if (block_size()) {
         free_list_.clear();
         for (size_t i=0; i<nblocks(); i++) {
@@ -40,20 +50,53 @@ void Slab::init()
 
 void Slab::init(int sizeclass)
 {
-    nvSlab::make(nvslab_, sizeclass);
+    nvSlab::remake(nvslab_, sizeclass, *size_classes_);
     init();
 }
 
-RRegion::TPtr<void> Slab::alloc_block() 
+size_t Slab::reserve()
 {
-    RRegion::TPtr<void> ptr;
+    PersistContext ctx;
+    size_t n = std::min(std::max<size_t>(slab_batch_size, 1), free_list_.size());
 
-    if (!free_list_.empty()) {
-        int bid = free_list_.front();
+    if (n == 0) {
+        return 0;
+    }
+    nvslab_->mark_dirty(ctx);
+    size_t first = reserved_.size();
+    for (size_t i=0; i<n; i++) {
+        size_t bid = free_list_.front();
         free_list_.pop_front();
         nvslab_->set_alloc(bid);
+        nvslab_->persist_block_state(bid, ctx);
+        reserved_.push_back(bid);
+    }
+    // hand out blocks in free list order
+    std::reverse(reserved_.begin() + first, reserved_.end());
+    flush_frees(ctx);
+    CRASH_POINT("slab_reserve");
+    ctx.commit();
+    return n;
+}
+
+void Slab::flush_frees(PersistContext& ctx)
+{
+    for (size_t i=0; i<pending_frees_.size(); i++) {
+        nvslab_->persist_block_state(pending_frees_[i], ctx);
+    }
+    pending_frees_.clear();
+}
+
+RRegion::TPtr<void> Slab::alloc_block() 
+{
+    RRegion::TPtr<void> ptr;
+
+    if (!reserved_.empty() || reserve() > 0) {
+        int bid = reserved_.back();
+        reserved_.pop_back();
         ptr = nvslab_->block(bid);
         LOG(info) << "Allocate block: " << "nvslab: " << nvslab_ << " block: " << bid;
+        TRACE_EVENT(kEventAllocBlock, nvslab_.offset(), bid);
     } else {
         LOG(info) << "Allocate block: FAILED: no free space";
         ptr = null_ptr;
@@ -67,9 +110,57 @@ void Slab::free_block(RRegion::TPtr<void> ptr)
     size_t bid = nvslab_->block_id(ptr);
 
     LOG(info) << "Free block: " << "nvslab: " << nvslab_ << " block: " << bid;
+    TRACE_EVENT(kEventFreeBlock, nvslab_.offset(), bid);
     assert(nvslab_->is_free(bid) == false);
+    PersistContext ctx;
+    nvslab_->mark_dirty(ctx);
     free_list_.push_front(bid);
     nvslab_->set_free(bid);
+    pending_frees_.push_back(bid);
+    if (pending_frees_.size() >= slab_batch_size) {
+        flush_frees(ctx);
+        ctx.commit();
+    }
+}
+
+bool Slab::defer_free(RRegion::TPtr<void> ptr)
+{
+    size_t bid = nvslab_->block_id(ptr);
+    // the freed block holds the link to the previously deferred block
+    uint64_t* next = static_cast<uint64_t*>(ptr.get());
+    uint64_t head = deferred_frees_.load(std::memory_order_relaxed);
+    do {
+        *next = head;
+    } while (!deferred_frees_.compare_exchange_weak(head, bid + 1, std::memory_order_seq_cst, std::memory_order_relaxed));
+    TRACE_EVENT(kEventDeferFree, nvslab_.offset(), bid);
+    return !deferred_queued_.exchange(true, std::memory_order_seq_cst);
+}
+
+void Slab::take_deferred_frees(std::vector<RRegion::TPtr<void> >* blocks)
+{
+    // taking the whole list at once makes the list immune to ABA; 
+    // seq_cst orders the exchange after the owner dequeued the slab
+    uint64_t head = deferred_frees_.exchange(0, std::memory_order_seq_cst);
+    while (head) {
+        RRegion::TPtr<void> ptr = nvslab_->block(head - 1);
+        blocks->push_back(ptr);
+        head = *static_cast<uint64_t*>(ptr.get());
+    }
+}
+
+void Slab::flush()
+{
+    PersistContext ctx;
+    for (size_t i=0; i<reserved_.size(); i++) {
+        size_t bid = reserved_[i];
+        nvslab_->set_free(bid);
+        nvslab_->persist_block_state(bid, ctx);
+        free_list_.push_front(bid);
+    }
+    reserved_.clear();
+    flush_frees(ctx);
+    ctx.commit();
+    nvslab_->mark_clean(ctx);
 }
 
 } // namespace alps
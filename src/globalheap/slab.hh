@@ -22,6 +22,7 @@
 #include <atomic>
 #include <list>
 #include <iostream>
+#include <vector>
 
 #include "common/debug.hh"
 #include "globalheap/nvslab.hh"
@@ -45,12 +46,32 @@ typedef std::list<Slab*> SlabList;
  * Slabs are owned and managed by a SlabHeap and any call for allocating/freeing 
  * blocks in a slab must be done through the SlabHeap that owns the slab.
  *
+ * Allocation is durable before a block is handed out, but bitmap updates 
+ * are batched to amortize flushes: the slab durably reserves up to 
+ * slab_batch_size free blocks at a time with a single fence and then hands
+ * them out without further flushes. Frees clear the bitmap in cache and are
+ * committed once slab_batch_size of them are pending, with the next 
+ * reservation, or at flush(). After a crash the durable bitmap thus 
+ * over-approximates the allocated blocks by at most the outstanding 
+ * reservation and pending frees, which recovery leaves allocated.
+ *
+ * A thread that frees a block of a slab whose owner is busy does not wait
+ * for the owner: it pushes the block on the lock-free deferred-free list
+ * of the slab, linked through the freed blocks themselves, and queues the
+ * slab on its owner, which applies the free when it next allocates (see
+ * SlabHeap::drain_deferred_frees). Deferred frees are volatile and are 
+ * lost like pending frees on a crash.
  */
 class Slab
 {
 public:
-    Slab(RRegion::TPtr<nvSlab> nvslab)
-        : nvslab_(nvslab),
+    Slab(RRegion::TPtr<nvSlab> nvslab, const SizeClassTable* size_classes = &default_size_classes)
+        : owner_(NULL),
+          deferred_frees_(0),
+          deferred_queued_(false),
+          deferred_next_(NULL),
+          nvslab_(nvslab),
+          size_classes_(size_classes),
           slab_list_(NULL)
     { 
         init();
@@ -61,6 +82,11 @@ public:
 
     void init(int sizeclass);
 
+    RRegion::TPtr<nvSlab> nvslab() const
+    {
+        return nvslab_;
+    }
+
     int sizeclass() const 
     {
         return nvslab_->sizeclass();
@@ -93,7 +119,7 @@ public:
 
     size_t nblocks_free() const
     {
-        return free_list_.size();
+        return free_list_.size() + reserved_.size();
     }
 
     void set_owner(SlabHeap* owner)
@@ -114,14 +140,46 @@ public:
     RRegion::TPtr<void> alloc_block();
     void free_block(RRegion::TPtr<void> ptr);
 
+    /**
+     * @brief Defer the free of block @a ptr to the owner of the slab
+     *
+     * @details
+     * Lock-free and safe to call from any thread. Returns true if the 
+     * caller must queue the slab on its owner, that is if the slab is not
+     * already queued on a slab heap.
+     */
+    bool defer_free(RRegion::TPtr<void> ptr);
+
+    /**
+     * @brief Move the blocks deferred so far to @a blocks (owner only)
+     */
+    void take_deferred_frees(std::vector<RRegion::TPtr<void> >* blocks);
+
+    /**
+     * @brief Return reserved blocks and commit pending frees so that the 
+     * durable bitmap exactly matches the allocated blocks
+     */
+    void flush();
+
     void stream_to(std::ostream& os) const {
         os << "(" << block_size() << ", " << nblocks() << ", " << nblocks_free() << ")";
     }
 
+private:
+    size_t reserve();
+    void flush_frees(PersistContext& ctx);
+
+public:
     pthread_mutex_t        pin_mutex_;
     std::atomic<SlabHeap*> owner_;
     std::list<size_t>      free_list_;
+    std::vector<size_t>    reserved_; // durably allocated blocks not handed out yet
+    std::vector<size_t>    pending_frees_; // freed blocks whose bitmap update is not committed
+    std::atomic<uint64_t>  deferred_frees_; // 1 + id of the last deferred block, 0 if none
+    std::atomic<bool>      deferred_queued_; // slab is on the deferred list of a slab heap
+    Slab*                  deferred_next_; // next slab on that list
     RRegion::TPtr<nvSlab>  nvslab_;
+    const SizeClassTable*  size_classes_; // size classes of the heap of the slab
     SlabList*              slab_list_; // list this slab belongs to
     SlabList::iterator     slab_list_it_; // position in the slab list
 };
@@ -37,6 +37,7 @@ RRegion::TPtr<void> SlabHeap::alloc_block(Slab* slab)
     if (ptr != null_ptr) {
         int new_fullness = slab->fullness();
         int szclass = slab->sizeclass();
+        HEAP_STATS(stats_.mallocs[szclass]++);
         LOG(info) << "Allocate block: " << "new_fullness: " << new_fullness << " old_fullness: " << old_fullness;
         if (empty || (new_fullness != old_fullness)) {
             move_slab(slab, szclass, new_fullness);
@@ -49,6 +50,7 @@ void SlabHeap::free_block(Slab* slab, RRegion::TPtr<void> ptr)
 {
     int old_fullness = slab->fullness();
     slab->free_block(ptr);
+    HEAP_STATS(stats_.frees[slab->sizeclass()]++);
     if (slab->empty()) {
         LOG(info) << "Free block: " << "recycle now empty slab";
         slab->remove();
@@ -88,7 +90,7 @@ Slab* SlabHeap::insert_slab(RRegion::TPtr<nvSlab> nvslab)
 {
     LOG(info) << "Insert slab: " << nvslab;
 
-    Slab* slab = new Slab(nvslab);
+    Slab* slab = new Slab(nvslab, size_classes_);
     insert_slab(slab, nvslab->sizeclass());
     return slab;
 }
@@ -108,7 +110,7 @@ void SlabHeap::insert_slab(Slab* slab, int szclass)
 
 void SlabHeap::remove_slab(Slab* slab)
 {
-    slab->set_owner(NULL);
+    // the caller hands the slab to its next owner
     slab->remove();
 }
 
@@ -118,6 +120,70 @@ void SlabHeap::move_slab(Slab* slab, int szclass, int to)
     slab->insert(&full_slabs_[szclass][to]);
 }
 
+void SlabHeap::queue_deferred(Slab* slab)
+{
+    Slab* head = deferred_slabs_.load(std::memory_order_relaxed);
+    do {
+        slab->deferred_next_ = head;
+    } while (!deferred_slabs_.compare_exchange_weak(head, slab, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void SlabHeap::drain_deferred_frees()
+{
+    if (deferred_slabs_.load(std::memory_order_relaxed) == NULL) {
+        return;
+    }
+    Slab* slab = deferred_slabs_.exchange(NULL, std::memory_order_acquire);
+    std::vector<RRegion::TPtr<void> > blocks;
+    while (slab) {
+        Slab* next = slab->deferred_next_;
+        if (slab->owner() != this) {
+            slab->owner()->queue_deferred(slab);
+        } else {
+            // dequeue before taking the blocks so that a free deferred 
+            // after we took them queues the slab again
+            slab->deferred_queued_.store(false, std::memory_order_seq_cst);
+            blocks.clear();
+            slab->take_deferred_frees(&blocks);
+            for (size_t i=0; i<blocks.size(); i++) {
+                free_block(slab, blocks[i]);
+                HEAP_STATS(stats_.deferred_frees++);
+            }
+        }
+        slab = next;
+    }
+}
+
+void SlabHeap::release_empty_slabs(size_t keep, std::vector<Slab*>* slabs)
+{
+    while (empty_slabs_.size() > keep) {
+        Slab* slab = empty_slabs_.back();
+        slab->remove();
+        slabs->push_back(slab);
+    }
+}
+
+void SlabHeap::flush()
+{
+    drain_deferred_frees();
+    for (int c=0; c<kSizeClasses; c++) {
+        for (int i=0; i<kSlabFullnessBins; i++) {
+            for (SlabList::iterator it = full_slabs_[c][i].begin();
+                 it != full_slabs_[c][i].end();
+                 it++) 
+            {
+                (*it)->flush();
+            }
+        }
+    }
+    for (SlabList::iterator it = empty_slabs_.begin();
+         it != empty_slabs_.end();
+         it++) 
+    {
+        (*it)->flush();
+    }
+}
+
 void SlabHeap::insert_slab_to_empty(Slab* slab)
 {
     slab->insert(&empty_slabs_);
@@ -125,9 +191,30 @@ void SlabHeap::insert_slab_to_empty(Slab* slab)
 
 Slab* SlabHeap::reuse_empty_slab(int szclass)
 {
+    // Prefer an empty slab already formatted for the class, then one of 
+    // the size new slabs of the class get; any slab that holds a block of
+    // the class will do otherwise
+    size_t size = slab_size_for(szclass);
+    size_t block_size = size_classes_->size_from_class(szclass);
     Slab* slab = NULL;
-    if (empty_slabs_.size()) {
-        slab = empty_slabs_.front();
+    bool same_size = false;
+    for (SlabList::iterator it = empty_slabs_.begin(); it != empty_slabs_.end(); it++) {
+        size_t slab_size = (*it)->nvslab()->size();
+        if (slab_size == size) {
+            if ((*it)->sizeclass() == szclass) {
+                slab = *it;
+                break;
+            }
+            if (!same_size) {
+                slab = *it;
+                same_size = true;
+            }
+        }
+        if (!slab && nvSlabHeader::max_nblocks(slab_size, block_size) > 0) {
+            slab = *it;
+        }
+    }
+    if (slab) {
         int fullness = slab->fullness();
         move_slab(slab, szclass, fullness);
         if (slab->sizeclass() != szclass) {
@@ -137,6 +224,26 @@ Slab* SlabHeap::reuse_empty_slab(int szclass)
     return slab;
 }
 
+static void add_slab_occupancy(const SlabList& slabs, HeapStats* stats)
+{
+    for (SlabList::const_iterator it = slabs.begin(); it != slabs.end(); it++) {
+        const Slab* slab = *it;
+        stats->slab_bytes += slab->nblocks() * slab->block_size();
+        stats->slab_bytes_free += slab->nblocks_free() * slab->block_size();
+    }
+}
+
+void SlabHeap::stats(HeapStats* stats) const
+{
+    stats_.add_to(stats);
+    for (int c=0; c<kSizeClasses; c++) {
+        for (int i=0; i<kSlabFullnessBins; i++) {
+            add_slab_occupancy(full_slabs_[c][i], stats);
+        }
+    }
+    add_slab_occupancy(empty_slabs_, stats);
+}
+
 void SlabHeap::stream_to(std::ostream& os) const {
     for (int i=0; i<kSlabFullnessBins; i++) {
         std::cout << "[" << i << "] ";
@@ -170,7 +277,7 @@ void SlabHeap::stream_to(std::ostream& os) const {
 void InsertSlabFunctor::operator()(Zone* zone, Extent* extent)
 {
     RRegion::TPtr<nvExtentHeader> nvexheader = static_cast<RRegion::TPtr<nvExtentHeader>>(zone->nvzone()->block_header(extent->start()));
-    RRegion::TPtr<nvSlab> nvslab = static_cast<RRegion::TPtr<nvSlab>>(zone->nvzone()->block(extent->start()));
+    RRegion::TPtr<nvSlab> nvslab = nvSlab::at(zone->nvzone(), extent->start());
 
     if (nvexheader->secondary_type == nvExtentHeader::kExtentTypeSlab) {
         slabheap_->insert_slab(nvslab);
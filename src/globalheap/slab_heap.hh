@@ -17,11 +17,15 @@
 #ifndef _ALPS_GLOBALHEAP_SLABHEAP_HH_
 #define _ALPS_GLOBALHEAP_SLABHEAP_HH_
 
+#include <atomic>
+#include <vector>
+
 #include "alps/common/assert_nd.hh"
 
 #include "globalheap/extentheap.hh"
 #include "globalheap/slab.hh"
 #include "globalheap/nvslab.hh"
+#include "globalheap/stats.hh"
 
 namespace alps {
 
@@ -36,14 +40,19 @@ class Zone;
  *
  * @details 
  * This class methods are not-thread safe. User is responsible for proper
- * serialization via lock/unlock.
+ * serialization via lock/unlock, except for queue_deferred, which is 
+ * lock-free.
  * 
  */
 class SlabHeap
 {
 public:
-    SlabHeap(ExtentHeap* extentheap)
-        : extentheap_(extentheap)
+    SlabHeap(ExtentHeap* extentheap, LockSite lock_site, const SizeClassTable* size_classes = &default_size_classes)
+        : extentheap_(extentheap),
+          lock_site_(lock_site),
+          size_classes_(size_classes),
+          zone_block_size_(extentheap ? extentheap->block_size() : BLOCK_SIZE),
+          deferred_slabs_(NULL)
     { 
         ASSERT_ND(pthread_mutex_init(&mutex_, NULL) == 0);
     }
@@ -57,9 +66,60 @@ public:
     void remove_slab(Slab* slab);
     void move_slab(Slab* slab, int szclass, int to);
 
+    /**
+     * @brief Queue @a slab, which has deferred frees, for draining by this
+     * heap
+     */
+    void queue_deferred(Slab* slab);
+
+    /**
+     * @brief Apply the frees deferred to the slabs queued on this heap
+     *
+     * @details
+     * Slabs that moved to another heap since they were queued are passed
+     * on to their new owner.
+     */
+    void drain_deferred_frees();
+
+    /**
+     * @brief Remove all but @a keep of the empty slabs of this heap and 
+     * append them to @a slabs
+     */
+    void release_empty_slabs(size_t keep, std::vector<Slab*>* slabs);
+
+    /**
+     * @brief Commit outstanding bitmap updates of all slabs in this heap
+     */
+    void flush();
+
+    /**
+     * @brief Add the statistics counters and the occupancy of the slabs
+     * of this heap to @a stats 
+     */
+    void stats(HeapStats* stats) const;
+
     void stream_to(std::ostream& os) const;
 
+    const SizeClassTable* size_classes() const
+    {
+        return size_classes_;
+    }
+
+    size_t zone_block_size() const
+    {
+        return zone_block_size_;
+    }
+
+    /**
+     * @brief Return the size of new slabs of size class @a szclass
+     */
+    size_t slab_size_for(int szclass) const
+    {
+        return nvSlab::size_for(zone_block_size_, size_classes_->size_from_class(szclass));
+    }
+
     void lock();
+    bool try_lock();
     void unlock();
 
 private:
@@ -69,13 +129,23 @@ private:
 protected:
     pthread_mutex_t mutex_;
     ExtentHeap*     extentheap_;
+    LockSite        lock_site_; // lock profile site of mutex_
+    const SizeClassTable* size_classes_;
+    size_t          zone_block_size_; // block size of the zones slabs are carved from
     SlabList        full_slabs_[kSizeClasses][kSlabFullnessBins]; // completely or partially full slabs
     SlabList        empty_slabs_; // completely empty slabs (that can be reused as a different size class)
+    std::atomic<Slab*> deferred_slabs_; // slabs with deferred frees, linked through Slab::deferred_next_
+    StatsCounters   stats_;
 };
 
 inline void SlabHeap::lock()
 {
-    pthread_mutex_lock(&mutex_);
+    stats_mutex_lock(&mutex_, &stats_, lock_site_);
+}
+
+inline bool SlabHeap::try_lock()
+{
+    return pthread_mutex_trylock(&mutex_) == 0;
 }
 
 inline void SlabHeap::unlock()
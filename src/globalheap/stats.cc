@@ -0,0 +1,158 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "globalheap/stats.hh"
+
+#include <iomanip>
+
+namespace alps {
+
+HeapStats::HeapStats()
+    : enabled(
+#ifdef ALPS_HEAP_STATS
+              true
+#else
+              false
+#endif
+             ),
+      class_size(size_table, size_table + kSizeClasses),
+      mallocs(kSizeClasses, 0),
+      frees(kSizeClasses, 0),
+      large_mallocs(0),
+      large_frees(0),
+      slab_refills(0),
+      deferred_frees(0),
+      zone_acquisitions(0),
+      zone_searches(0),
+      zone_search_ns(0),
+      lease_conflicts(0),
+      extent_allocations(0),
+      oom_fallbacks(0),
+      oom_failures(0),
+      lock_contentions(0),
+      lock_wait_ns(0),
+      zones_owned(0),
+      slab_bytes(0),
+      slab_bytes_free(0)
+{ }
+
+uint64_t HeapStats::total_mallocs() const
+{
+    uint64_t total = large_mallocs;
+    for (size_t i = 0; i < mallocs.size(); i++) {
+        total += mallocs[i];
+    }
+    return total;
+}
+
+uint64_t HeapStats::total_frees() const
+{
+    uint64_t total = large_frees;
+    for (size_t i = 0; i < frees.size(); i++) {
+        total += frees[i];
+    }
+    return total;
+}
+
+double HeapStats::slab_fragmentation() const
+{
+    if (slab_bytes == 0) {
+        return 0;
+    }
+    return (100.0 * slab_bytes_free) / slab_bytes;
+}
+
+HeapStats& HeapStats::operator+=(const HeapStats& other)
+{
+    for (size_t i = 0; i < mallocs.size() && i < other.mallocs.size(); i++) {
+        mallocs[i] += other.mallocs[i];
+        frees[i] += other.frees[i];
+    }
+    large_mallocs += other.large_mallocs;
+    large_frees += other.large_frees;
+    slab_refills += other.slab_refills;
+    deferred_frees += other.deferred_frees;
+    zone_acquisitions += other.zone_acquisitions;
+    zone_searches += other.zone_searches;
+    zone_search_ns += other.zone_search_ns;
+    lease_conflicts += other.lease_conflicts;
+    extent_allocations += other.extent_allocations;
+    oom_fallbacks += other.oom_fallbacks;
+    oom_failures += other.oom_failures;
+    lock_contentions += other.lock_contentions;
+    lock_wait_ns += other.lock_wait_ns;
+    zones_owned += other.zones_owned;
+    slab_bytes += other.slab_bytes;
+    slab_bytes_free += other.slab_bytes_free;
+    return *this;
+}
+
+void HeapStats::stream_to(std::ostream& os) const
+{
+    os << "zones_owned: " << zones_owned << std::endl;
+    os << "slab_bytes: " << slab_bytes << std::endl;
+    os << "slab_bytes_free: " << slab_bytes_free << std::endl;
+    if (!enabled) {
+        os << "heap statistics disabled (build with ALPS_HEAP_STATS)" << std::endl;
+        return;
+    }
+    os << "mallocs: " << total_mallocs() << std::endl;
+    os << "frees: " << total_frees() << std::endl;
+    os << "large_mallocs: " << large_mallocs << std::endl;
+    os << "large_frees: " << large_frees << std::endl;
+    os << "slab_refills: " << slab_refills << std::endl;
+    os << "deferred_frees: " << deferred_frees << std::endl;
+    os << "zone_acquisitions: " << zone_acquisitions << std::endl;
+    os << "zone_searches: " << zone_searches << std::endl;
+    os << "zone_search_ns: " << zone_search_ns << std::endl;
+    os << "lease_conflicts: " << lease_conflicts << std::endl;
+    os << "extent_allocations: " << extent_allocations << std::endl;
+    os << "oom_fallbacks: " << oom_fallbacks << std::endl;
+    os << "oom_failures: " << oom_failures << std::endl;
+    os << "lock_contentions: " << lock_contentions << std::endl;
+    os << "lock_wait_ns: " << lock_wait_ns << std::endl;
+    os << std::setw(12) << "class_size" << std::setw(16) << "mallocs" << std::setw(16) << "frees" << std::endl;
+    for (size_t i = 0; i < mallocs.size(); i++) {
+        if (mallocs[i] == 0 && frees[i] == 0) {
+            continue;
+        }
+        os << std::setw(12) << class_size[i] << std::setw(16) << mallocs[i] << std::setw(16) << frees[i] << std::endl;
+    }
+}
+
+void StatsCounters::add_to(HeapStats* stats) const
+{
+    for (int i = 0; i < kSizeClasses; i++) {
+        stats->mallocs[i] += mallocs[i];
+        stats->frees[i] += frees[i];
+    }
+    stats->large_mallocs += large_mallocs;
+    stats->large_frees += large_frees;
+    stats->slab_refills += slab_refills;
+    stats->deferred_frees += deferred_frees;
+    stats->zone_acquisitions += zone_acquisitions;
+    stats->zone_searches += zone_searches;
+    stats->zone_search_ns += zone_search_ns;
+    stats->lease_conflicts += lease_conflicts;
+    stats->extent_allocations += extent_allocations;
+    stats->oom_fallbacks += oom_fallbacks;
+    stats->oom_failures += oom_failures;
+    stats->lock_contentions += lock_contentions;
+    stats->lock_wait_ns += lock_wait_ns;
+}
+
+} // namespace alps
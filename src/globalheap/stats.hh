@@ -0,0 +1,146 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _ALPS_GLOBALHEAP_STATS_HH_
+#define _ALPS_GLOBALHEAP_STATS_HH_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "alps/globalheap/heap_stats.hh"
+
+#include "globalheap/lock_profile.hh"
+#include "globalheap/size_class.hh"
+
+/**
+ * @brief Evaluates @a stmt only when the library is built with 
+ * allocator statistics (ALPS_HEAP_STATS)
+ */
+#ifdef ALPS_HEAP_STATS
+#define HEAP_STATS(stmt) do { stmt; } while (0)
+#else
+#define HEAP_STATS(stmt) do { } while (0)
+#endif
+
+namespace alps {
+
+/**
+ * @brief Allocator statistics counters embedded in a volatile heap structure
+ *
+ * @details
+ * Counters are plain integers updated under the lock that already 
+ * serializes the operation being counted (e.g. the slab heap mutex for 
+ * block allocations, the zone heap writer lock for zone acquisitions), 
+ * so counting costs no additional atomic operations. As each thread is 
+ * mapped to its own ThreadSlabHeap, the hot counters are effectively 
+ * per-thread. Counters are aggregated on demand by add_to() under the 
+ * same locks.
+ */
+struct StatsCounters {
+    StatsCounters()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void add_to(HeapStats* stats) const;
+
+    uint64_t mallocs[kSizeClasses];
+    uint64_t frees[kSizeClasses];
+    uint64_t large_mallocs;
+    uint64_t large_frees;
+    uint64_t slab_refills;
+    uint64_t deferred_frees;
+    uint64_t zone_acquisitions;
+    uint64_t zone_searches;
+    uint64_t zone_search_ns;
+    uint64_t lease_conflicts;
+    uint64_t extent_allocations;
+    uint64_t oom_fallbacks;
+    uint64_t oom_failures;
+    uint64_t lock_contentions;
+    uint64_t lock_wait_ns;
+};
+
+inline uint64_t stats_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Acquires @a mutex, charging the time spent waiting to @a counters
+ * and, when lock profiling is on, to lock site @a site
+ *
+ * @details
+ * The uncontended path is a single trylock; the clock is read only when 
+ * the lock is held by someone else.
+ */
+inline void stats_mutex_lock(pthread_mutex_t* mutex, StatsCounters* counters, LockSite site)
+{
+    bool profile = lock_profile_enabled();
+#ifndef ALPS_HEAP_STATS
+    if (!profile) {
+        pthread_mutex_lock(mutex);
+        return;
+    }
+#endif
+    if (pthread_mutex_trylock(mutex) == 0) {
+        if (profile) {
+            lock_profile_record(site, false, 0);
+        }
+        return;
+    }
+    uint64_t start = stats_clock_ns();
+    pthread_mutex_lock(mutex);
+    uint64_t wait_ns = stats_clock_ns() - start;
+    HEAP_STATS(counters->lock_contentions++);
+    HEAP_STATS(counters->lock_wait_ns += wait_ns);
+    if (profile) {
+        lock_profile_record(site, true, wait_ns);
+    }
+}
+
+/**
+ * @brief Acquires @a mutex, charging the time spent waiting to lock site
+ * @a site when lock profiling is on
+ */
+inline void profiled_mutex_lock(pthread_mutex_t* mutex, LockSite site)
+{
+    if (!lock_profile_enabled()) {
+        pthread_mutex_lock(mutex);
+        return;
+    }
+    if (pthread_mutex_trylock(mutex) == 0) {
+        lock_profile_record(site, false, 0);
+        return;
+    }
+    uint64_t start = stats_clock_ns();
+    pthread_mutex_lock(mutex);
+    lock_profile_record(site, true, stats_clock_ns() - start);
+}
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_STATS_HH_
@@ -0,0 +1,298 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "globalheap/stats_segment.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include "common/log.hh"
+#include "globalheap/globalheap_internal.hh"
+#include "globalheap/stats.hh"
+
+namespace alps {
+
+const char* StatsPublisher::kSegmentPrefix = "alps-heapstats.";
+
+static const char* kShmDir = "/dev/shm";
+
+// number of attempts to read a consistent sample before giving up
+static const int kStatsReadRetries = 1000;
+
+
+void StatsSample::from(const HeapStats& stats)
+{
+    enabled = stats.enabled;
+    for (int i = 0; i < kSizeClasses; i++) {
+        mallocs[i] = stats.mallocs[i];
+        frees[i] = stats.frees[i];
+    }
+    large_mallocs = stats.large_mallocs;
+    large_frees = stats.large_frees;
+    slab_refills = stats.slab_refills;
+    deferred_frees = stats.deferred_frees;
+    zone_acquisitions = stats.zone_acquisitions;
+    zone_searches = stats.zone_searches;
+    zone_search_ns = stats.zone_search_ns;
+    lease_conflicts = stats.lease_conflicts;
+    extent_allocations = stats.extent_allocations;
+    oom_fallbacks = stats.oom_fallbacks;
+    oom_failures = stats.oom_failures;
+    lock_contentions = stats.lock_contentions;
+    lock_wait_ns = stats.lock_wait_ns;
+    zones_owned = stats.zones_owned;
+    slab_bytes = stats.slab_bytes;
+    slab_bytes_free = stats.slab_bytes_free;
+}
+
+void StatsSample::to(HeapStats* stats) const
+{
+    stats->enabled = enabled;
+    for (int i = 0; i < kSizeClasses; i++) {
+        stats->mallocs[i] = mallocs[i];
+        stats->frees[i] = frees[i];
+    }
+    stats->large_mallocs = large_mallocs;
+    stats->large_frees = large_frees;
+    stats->slab_refills = slab_refills;
+    stats->deferred_frees = deferred_frees;
+    stats->zone_acquisitions = zone_acquisitions;
+    stats->zone_searches = zone_searches;
+    stats->zone_search_ns = zone_search_ns;
+    stats->lease_conflicts = lease_conflicts;
+    stats->extent_allocations = extent_allocations;
+    stats->oom_fallbacks = oom_fallbacks;
+    stats->oom_failures = oom_failures;
+    stats->lock_contentions = lock_contentions;
+    stats->lock_wait_ns = lock_wait_ns;
+    stats->zones_owned = zones_owned;
+    stats->slab_bytes = slab_bytes;
+    stats->slab_bytes_free = slab_bytes_free;
+}
+
+
+void StatsBlock::init()
+{
+    memset(&sample, 0, sizeof(sample));
+    seq.store(0, std::memory_order_relaxed);
+    magic = kMagic;
+    version = kVersion;
+    sample_size = sizeof(StatsSample);
+}
+
+void StatsBlock::write(const StatsSample& new_sample)
+{
+    uint64_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&sample, &new_sample, sizeof(sample));
+    seq.store(s + 2, std::memory_order_release);
+}
+
+int StatsBlock::read(StatsSample* snapshot) const
+{
+    if (magic != kMagic || version != kVersion || sample_size != sizeof(StatsSample)) {
+        return -1;
+    }
+    for (int i = 0; i < kStatsReadRetries; i++) {
+        uint64_t s1 = seq.load(std::memory_order_acquire);
+        if (s1 & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(snapshot, &sample, sizeof(sample));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t s2 = seq.load(std::memory_order_relaxed);
+        if (s1 == s2) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+StatsPublisher::StatsPublisher(GlobalHeapInternal* heap, const std::string& heap_path, uint64_t generation, size_t interval_ms)
+    : heap_(heap),
+      heap_path_(heap_path),
+      generation_(generation),
+      interval_ms_(interval_ms),
+      block_(NULL),
+      stop_(false)
+{
+    segment_name_ = segment_name(heap_path, generation);
+}
+
+std::string StatsPublisher::segment_name(const std::string& heap_path, uint64_t generation)
+{
+    // FNV-1a hash of the heap path
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < heap_path.size(); i++) {
+        hash ^= static_cast<unsigned char>(heap_path[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    std::stringstream ss;
+    ss << kSegmentPrefix << std::hex << std::setw(16) << std::setfill('0') << hash
+       << "." << std::dec << generation;
+    return ss.str();
+}
+
+int StatsPublisher::init()
+{
+    std::string shm_name = "/" + segment_name_;
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG(error) << "Cannot create stats segment " << shm_name << ": " << strerror(errno);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(StatsBlock)) != 0) {
+        LOG(error) << "Cannot size stats segment " << shm_name << ": " << strerror(errno);
+        close(fd);
+        shm_unlink(shm_name.c_str());
+        return -1;
+    }
+    void* addr = mmap(NULL, sizeof(StatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOG(error) << "Cannot map stats segment " << shm_name << ": " << strerror(errno);
+        shm_unlink(shm_name.c_str());
+        return -1;
+    }
+    block_ = reinterpret_cast<StatsBlock*>(addr);
+    block_->init();
+    publish();
+
+    LOG(info) << "Publishing heap statistics in " << kShmDir << shm_name;
+
+    thread_ = std::thread(&StatsPublisher::run, this);
+    return 0;
+}
+
+int StatsPublisher::teardown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (block_) {
+        munmap(block_, sizeof(StatsBlock));
+        block_ = NULL;
+        std::string shm_name = "/" + segment_name_;
+        shm_unlink(shm_name.c_str());
+    }
+    return 0;
+}
+
+void StatsPublisher::publish()
+{
+    StatsSample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.from(heap_->stats());
+    sample.pid = getpid();
+    sample.generation = generation_;
+    sample.timestamp_ns = stats_clock_ns();
+    sample.heap_size = heap_->size();
+    sample.metazone_size = heap_->nvheap()->metazone_size();
+    strncpy(sample.heap_path, heap_path_.c_str(), StatsSample::kMaxPathLen - 1);
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    block_->write(sample);
+}
+
+void StatsPublisher::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cond_.wait_for(lock, std::chrono::milliseconds(interval_ms_), [this] { return stop_; })) {
+        lock.unlock();
+        publish();
+        lock.lock();
+    }
+}
+
+
+std::string stats_heap_path(const std::vector<boost::filesystem::path>& pathnames)
+{
+    std::stringstream ss;
+    for (std::vector<boost::filesystem::path>::const_iterator it = pathnames.begin();
+         it != pathnames.end();
+         it++) 
+    {
+        if (it != pathnames.begin()) {
+            ss << " ";
+        }
+        ss << boost::filesystem::absolute(*it).string();
+    }
+    return ss.str();
+}
+
+int list_stats_segments(std::vector<std::string>* names)
+{
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(kShmDir, ec);
+    if (ec) {
+        return -1;
+    }
+    size_t prefix_len = strlen(StatsPublisher::kSegmentPrefix);
+    for (; it != boost::filesystem::directory_iterator(); it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.compare(0, prefix_len, StatsPublisher::kSegmentPrefix) == 0) {
+            names->push_back(name);
+        }
+    }
+    return 0;
+}
+
+int read_stats_segment(const std::string& name, StatsSample* sample)
+{
+    std::string shm_name = "/" + name;
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(StatsBlock))) {
+        close(fd);
+        return -1;
+    }
+    void* addr = mmap(NULL, sizeof(StatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    int ret = reinterpret_cast<const StatsBlock*>(addr)->read(sample);
+    munmap(addr, sizeof(StatsBlock));
+    return ret;
+}
+
+bool stats_publisher_alive(const StatsSample& sample)
+{
+    return kill(static_cast<pid_t>(sample.pid), 0) == 0 || errno == EPERM;
+}
+
+} // namespace alps
@@ -0,0 +1,185 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _ALPS_GLOBALHEAP_STATS_SEGMENT_HH_
+#define _ALPS_GLOBALHEAP_STATS_SEGMENT_HH_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "alps/globalheap/heap_stats.hh"
+
+#include "globalheap/size_class.hh"
+
+namespace alps {
+
+// forward declarations
+class GlobalHeapInternal;
+
+/**
+ * @brief Plain-old-data copy of the statistics of a heap instance as
+ * published in a shared memory stats segment
+ */
+struct StatsSample {
+    static const size_t kMaxPathLen = 256;
+
+    void from(const HeapStats& stats);
+    void to(HeapStats* stats) const;
+
+    int64_t  pid;
+    uint64_t generation;
+    uint64_t timestamp_ns;   // CLOCK_MONOTONIC time of publication
+    uint64_t heap_size;
+    uint64_t metazone_size;
+    uint64_t enabled;
+    uint64_t mallocs[kSizeClasses];
+    uint64_t frees[kSizeClasses];
+    uint64_t large_mallocs;
+    uint64_t large_frees;
+    uint64_t slab_refills;
+    uint64_t deferred_frees;
+    uint64_t zone_acquisitions;
+    uint64_t zone_searches;
+    uint64_t zone_search_ns;
+    uint64_t lease_conflicts;
+    uint64_t extent_allocations;
+    uint64_t oom_fallbacks;
+    uint64_t oom_failures;
+    uint64_t lock_contentions;
+    uint64_t lock_wait_ns;
+    uint64_t zones_owned;
+    uint64_t slab_bytes;
+    uint64_t slab_bytes_free;
+    char     heap_path[kMaxPathLen]; // absolute paths of the heap files
+};
+
+/**
+ * @brief Layout of a shared memory stats segment
+ *
+ * @details
+ * The segment has a single writer, the publisher of the heap instance,
+ * and any number of readers in other processes. The sample is protected
+ * by a sequence lock: the writer makes @a seq odd while it updates the
+ * sample and even again when done, and readers retry until they observe
+ * the same even sequence number before and after copying the sample.
+ * Readers therefore never block or slow down the allocator.
+ */
+struct StatsBlock {
+    static const uint64_t kMagic = 0x5441545353504c41ULL; // "ALPSSTAT"
+    static const uint32_t kVersion = 3;
+
+    void init();
+    void write(const StatsSample& sample);
+
+    /**
+     * @brief Copy a consistent snapshot of the sample into @a sample
+     *
+     * @return 0 on success, -1 if the block is not a stats block or no
+     * consistent snapshot could be taken (e.g. the writer died in the
+     * middle of an update)
+     */
+    int read(StatsSample* sample) const;
+
+    uint64_t              magic;
+    uint32_t              version;
+    uint32_t              sample_size;
+    std::atomic<uint64_t> seq;
+    StatsSample           sample;
+};
+
+/**
+ * @brief Periodically publishes the statistics of a heap instance in a
+ * shared memory segment under /dev/shm
+ *
+ * @details
+ * The segment is named after a hash of the heap path and the heap
+ * generation, which is unique to each process that opened the heap.
+ * The segment is removed when the heap is closed; segments left behind
+ * by crashed processes are recognized by their dead pid.
+ */
+class StatsPublisher {
+public:
+    static const char* kSegmentPrefix;
+
+public:
+    StatsPublisher(GlobalHeapInternal* heap, const std::string& heap_path, uint64_t generation, size_t interval_ms);
+
+    int init();
+    int teardown();
+
+    /**
+     * @brief Publish the current statistics of the heap
+     */
+    void publish();
+
+    const std::string& segment_name() const
+    {
+        return segment_name_;
+    }
+
+    static std::string segment_name(const std::string& heap_path, uint64_t generation);
+
+private:
+    void run();
+
+private:
+    GlobalHeapInternal*     heap_;
+    std::string             heap_path_;
+    uint64_t                generation_;
+    size_t                  interval_ms_;
+    std::string             segment_name_;
+    StatsBlock*             block_;
+    std::mutex              write_mutex_; // serializes writers of block_
+    std::thread             thread_;
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    bool                    stop_;
+};
+
+/**
+ * @brief Heap path under which a heap comprising files @a pathnames 
+ * publishes its statistics 
+ */
+std::string stats_heap_path(const std::vector<boost::filesystem::path>& pathnames);
+
+/**
+ * @brief List the names of all stats segments currently under /dev/shm
+ */
+int list_stats_segments(std::vector<std::string>* names);
+
+/**
+ * @brief Read a consistent snapshot of the sample published in stats
+ * segment @a name without synchronizing with its writer
+ */
+int read_stats_segment(const std::string& name, StatsSample* sample);
+
+/**
+ * @brief Whether the process that published @a sample is still alive
+ */
+bool stats_publisher_alive(const StatsSample& sample);
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_STATS_SEGMENT_HH_
@@ -24,29 +24,32 @@
 namespace alps {
 
 ThreadSlabHeap::ThreadSlabHeap(ProcessSlabHeap* process_slab_heap)
-    : SlabHeap(NULL),
+    : SlabHeap(NULL, kLockSiteThreadSlabHeap, process_slab_heap->size_classes()),
       process_slab_heap_(process_slab_heap)
 {
- 
+    zone_block_size_ = process_slab_heap->zone_block_size();
 }
 
 RRegion::TPtr<void> ThreadSlabHeap::malloc(size_t size)
 {
     RRegion::TPtr<void> ptr;
-    const int szclass = sizeclass(size);
+    const int szclass = size_classes_->sizeclass(size);
 
     lock(); 
+    drain_deferred_frees();
 
     Slab* slab = find_slab(szclass);
 
     if (!slab) {
         // No slab in my thread-local slab heap so try to get a slab 
         // from the central process-wide slab heap
-        slab = process_slab_heap_->acquire_slab(szclass);
+        slab = process_slab_heap_->acquire_slab(szclass, this);
         if (!slab) {
             LOG(warning) << "Out of memory";
+            HEAP_STATS(stats_.oom_failures++);
             ptr = null_ptr;
         } else {
+            HEAP_STATS(stats_.slab_refills++);
             insert_slab(slab, szclass);
         }
     }
@@ -0,0 +1,186 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "globalheap/trace.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "common/log.hh"
+#include "globalheap/stats.hh"
+
+namespace alps {
+
+const uint16_t TraceRecord::kOpMalloc;
+const uint16_t TraceRecord::kOpFree;
+const uint16_t TraceRecord::kAnyIg;
+
+const char* TraceRecorder::kTracePrefix = "alps-heaptrace.";
+
+// threads are numbered in order of first use across all recorders
+static std::atomic<uint32_t> trace_nthreads(0);
+static __thread uint32_t trace_thread = 0;
+
+static uint32_t trace_thread_id()
+{
+    if (trace_thread == 0) {
+        trace_thread = ++trace_nthreads;
+    }
+    return trace_thread;
+}
+
+
+TraceRecorder::TraceRecorder(const std::string& trace_dir, uint64_t generation, size_t heap_size, size_t metazone_size)
+    : fd_(-1),
+      start_ns_(0),
+      file_offset_(0),
+      buffers_(NULL)
+{
+    std::stringstream ss;
+    ss << trace_dir << "/" << kTracePrefix << getpid() << "." << generation;
+    filename_ = ss.str();
+
+    memset(&header_, 0, sizeof(header_));
+    header_.magic = TraceHeader::kMagic;
+    header_.version = TraceHeader::kVersion;
+    header_.record_size = sizeof(TraceRecord);
+    header_.pid = getpid();
+    header_.generation = generation;
+    header_.heap_size = heap_size;
+    header_.metazone_size = metazone_size;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    delete [] buffers_;
+}
+
+int TraceRecorder::init()
+{
+    fd_ = open(filename_.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd_ < 0) {
+        LOG(error) << "Cannot create trace file " << filename_ << ": " << strerror(errno);
+        return -1;
+    }
+    if (pwrite(fd_, &header_, sizeof(header_), 0) != sizeof(header_)) {
+        LOG(error) << "Cannot write trace file " << filename_ << ": " << strerror(errno);
+        ::close(fd_);
+        fd_ = -1;
+        return -1;
+    }
+    file_offset_ = sizeof(header_);
+    buffers_ = new Buffer[kBuffers];
+    for (size_t i = 0; i < kBuffers; i++) {
+        pthread_mutex_init(&buffers_[i].mutex, NULL);
+        buffers_[i].nrecords = 0;
+    }
+    start_ns_ = stats_clock_ns();
+
+    LOG(info) << "Recording allocation trace in " << filename_;
+    return 0;
+}
+
+int TraceRecorder::teardown()
+{
+    if (fd_ < 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < kBuffers; i++) {
+        pthread_mutex_lock(&buffers_[i].mutex);
+        flush(&buffers_[i]);
+        pthread_mutex_unlock(&buffers_[i].mutex);
+        pthread_mutex_destroy(&buffers_[i].mutex);
+    }
+    ::close(fd_);
+    fd_ = -1;
+    return 0;
+}
+
+void TraceRecorder::record(uint16_t op, uint16_t ig, size_t size, RRegion::TPtr<void> ptr)
+{
+    Buffer* buffer = &buffers_[pthread_self() % kBuffers];
+
+    pthread_mutex_lock(&buffer->mutex);
+    TraceRecord* rec = &buffer->records[buffer->nrecords++];
+    rec->timestamp_ns = stats_clock_ns() - start_ns_;
+    rec->thread = trace_thread_id();
+    rec->op = op;
+    rec->ig = ig;
+    rec->size = size;
+    rec->offset = ptr == null_ptr ? 0 : ptr.offset();
+    if (buffer->nrecords == kBufferRecords) {
+        flush(buffer);
+    }
+    pthread_mutex_unlock(&buffer->mutex);
+}
+
+void TraceRecorder::flush(Buffer* buffer)
+{
+    if (buffer->nrecords == 0) {
+        return;
+    }
+    size_t len = buffer->nrecords * sizeof(TraceRecord);
+    uint64_t offset = file_offset_.fetch_add(len);
+    if (pwrite(fd_, buffer->records, len, offset) != static_cast<ssize_t>(len)) {
+        LOG(error) << "Cannot write trace file " << filename_ << ": " << strerror(errno);
+    }
+    buffer->nrecords = 0;
+}
+
+
+static bool trace_record_before(const TraceRecord& a, const TraceRecord& b)
+{
+    return a.timestamp_ns < b.timestamp_ns;
+}
+
+int read_trace(const std::string& filename, TraceHeader* header, std::vector<TraceRecord>* records)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        read(fd, header, sizeof(*header)) != sizeof(*header) ||
+        header->magic != TraceHeader::kMagic ||
+        header->version != TraceHeader::kVersion ||
+        header->record_size != sizeof(TraceRecord))
+    {
+        ::close(fd);
+        return -1;
+    }
+    // a trace of a crashed process may end with a torn record
+    size_t nrecords = (st.st_size - sizeof(*header)) / sizeof(TraceRecord);
+    records->resize(nrecords);
+    size_t len = nrecords * sizeof(TraceRecord);
+    ssize_t ret = read(fd, records->data(), len);
+    ::close(fd);
+    if (ret != static_cast<ssize_t>(len)) {
+        return -1;
+    }
+    // records of a thread share a buffer and are already in order
+    std::stable_sort(records->begin(), records->end(), trace_record_before);
+    return 0;
+}
+
+} // namespace alps
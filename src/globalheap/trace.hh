@@ -0,0 +1,127 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _ALPS_GLOBALHEAP_TRACE_HH_
+#define _ALPS_GLOBALHEAP_TRACE_HH_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "alps/pegasus/relocatable_region.hh"
+
+namespace alps {
+
+/**
+ * @brief Header at the beginning of an allocation trace file
+ */
+struct TraceHeader {
+    static const uint64_t kMagic = 0x3143525453504c41ULL; // "ALPSTRC1"
+    static const uint32_t kVersion = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    int64_t  pid;
+    uint64_t generation;
+    uint64_t heap_size;
+    uint64_t metazone_size;
+};
+
+/**
+ * @brief A single allocator operation in an allocation trace
+ *
+ * @details
+ * A realloc is recorded as a malloc of the new block followed by a free
+ * of the old one, which is what the allocator does underneath.
+ */
+struct TraceRecord {
+    static const uint16_t kOpMalloc = 1;
+    static const uint16_t kOpFree = 2;
+    static const uint16_t kAnyIg = 0xffff; // malloc without memory attributes
+
+    uint64_t timestamp_ns; // time since the trace was started
+    uint32_t thread;       // recording thread, numbered from 1 in order of first use
+    uint16_t op;
+    uint16_t ig;           // interleave group requested by malloc
+    uint64_t size;         // requested size (malloc only)
+    uint64_t offset;       // offset of the returned or freed block, 0 if malloc failed
+};
+
+/**
+ * @brief Records a binary trace of the allocator operations on a heap
+ * instance
+ *
+ * @details
+ * Records are appended to one of several buffers, picked by calling
+ * thread as the thread slab heaps are, so that recording threads rarely
+ * contend. Full buffers are written to the trace file at offsets reserved
+ * with an atomic counter, without serializing writers. Records of
+ * different buffers are therefore not ordered in the file; readers order
+ * them by timestamp. Records still buffered when the process dies are
+ * lost.
+ */
+class TraceRecorder {
+public:
+    static const char* kTracePrefix;
+    static const size_t kBuffers = 16;
+    static const size_t kBufferRecords = 1024;
+
+public:
+    TraceRecorder(const std::string& trace_dir, uint64_t generation, size_t heap_size, size_t metazone_size);
+    ~TraceRecorder();
+
+    int init();
+    int teardown();
+
+    void record(uint16_t op, uint16_t ig, size_t size, RRegion::TPtr<void> ptr);
+
+    const std::string& filename() const
+    {
+        return filename_;
+    }
+
+private:
+    struct Buffer {
+        pthread_mutex_t mutex;
+        size_t          nrecords;
+        TraceRecord     records[kBufferRecords];
+    };
+
+    void flush(Buffer* buffer);
+
+private:
+    std::string           filename_;
+    TraceHeader           header_;
+    int                   fd_;
+    uint64_t              start_ns_;
+    std::atomic<uint64_t> file_offset_; // end of the space reserved in the trace file
+    Buffer*               buffers_;
+};
+
+/**
+ * @brief Read the header and all records of trace file @a filename,
+ * ordered by timestamp
+ */
+int read_trace(const std::string& filename, TraceHeader* header, std::vector<TraceRecord>* records);
+
+} // namespace alps
+
+#endif // _ALPS_GLOBALHEAP_TRACE_HH_
@@ -15,9 +15,12 @@
  */
 
 #include <unistd.h> 
+#include <atomic>
+#include <fstream>
 #include <iostream>
 #include <iomanip>  
 #include <string> 
+#include <thread>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 
@@ -28,6 +31,9 @@
 #include "globalheap/layout.hh"
 #include "globalheap/nvslab.hh"
 #include "globalheap/size_class.hh"
+#include "globalheap/size_class_table.hh"
+#include "globalheap/stats_segment.hh"
+#include "globalheap/trace.hh"
 #include "globalheap/zone.hh"
 
 using namespace alps;
@@ -106,29 +112,51 @@ bool heap_exists(boost::filesystem::path heap_path_prefix)
  * CREATE HEAP
  ******************************************************************************/
 
-int create_heap(std::string heap_path, size_t heap_size, size_t metazone_size, int npartitions)
+/**
+ * @brief Read block sizes, one per line, from @a filename; lines starting
+ * with # are comments
+ */
+int read_size_classes(std::string filename, std::vector<size_t>* sizes)
+{
+    std::ifstream is(filename.c_str());
+    if (!is) {
+        std::cout << "ERROR: Cannot read size classes " << filename << std::endl;
+        return -1;
+    }
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        sizes->push_back(string_to_size(line));
+    }
+    return 0;
+}
+
+int create_heap(std::string heap_path, size_t heap_size, size_t metazone_size, size_t block_size, int npartitions, std::string size_classes_file)
 {
     int ret;
     GlobalHeapInternal* heap;
+    std::vector<size_t> size_classes;
 
     if (heap_exists(heap_path)) {
         std::cout << "ERROR: Heap " << heap_path << " already exists!" << std::endl;
         return -1;
     }
 
+    if (!size_classes_file.empty() && read_size_classes(size_classes_file, &size_classes) != 0) {
+        return -1;
+    }
+
     std::cout << "Create heap: " << "heap_path=" << heap_path
               << ", heap_size=" << heap_size
-              << ", metazone_size=" << metazone_size << std::endl;
+              << ", metazone_size=" << metazone_size 
+              << ", block_size=" << block_size
+              << ", size_classes=" << (size_classes.empty() ? std::string("default") : size_classes_file) << std::endl;
 
-    if (npartitions > 1) {
-        std::vector<boost::filesystem::path> paths = heap_paths(heap_path, npartitions);
-        if ((ret = GlobalHeapInternal::create(paths, heap_size, metazone_size, &heap)) != 0) {
-            return ret;
-        }
-    } else {
-        if ((ret = GlobalHeapInternal::create(heap_path, heap_size, metazone_size, &heap)) != 0) {
-            return ret;
-        }
+    std::vector<boost::filesystem::path> paths = heap_paths(heap_path, npartitions);
+    if ((ret = GlobalHeapInternal::create(paths, heap_size, metazone_size, block_size, size_classes, &heap)) != 0) {
+        return ret;
     }
     return heap->close();
 }
@@ -144,7 +172,9 @@ int cmd_create(std::string progname, boost::program_options::parsed_options& par
             ("size", po::value<std::string>()->required(), "Heap size in bytes")
             ("heappath", po::value<std::string>()->required(), "Heap path")
             ("metazone_size", po::value<std::string>()->default_value("8G"), "Metazone size in bytes (must be power of two)")
-            ("partitions", po::value<int>()->default_value(1), "Partition the heap into so many files");
+            ("block_size", po::value<std::string>()->default_value("256K"), "Block size in bytes (power of two between 64K and 4M)")
+            ("partitions", po::value<int>()->default_value(1), "Partition the heap into so many files")
+            ("size_classes", po::value<std::string>()->default_value(""), "File with the block sizes of the heap's size classes, one per line (see profile-sizes)");
 
         if (vm.count("help")) {
             return usage(progname, desc, 0);
@@ -158,7 +188,8 @@ int cmd_create(std::string progname, boost::program_options::parsed_options& par
         std::string heap_path = vm["heappath"].as<std::string>();
         heap_size = string_to_size(vm["size"].as<std::string>());
         metazone_size = string_to_size(vm["metazone_size"].as<std::string>());
-        return create_heap(heap_path, heap_size, metazone_size, vm["partitions"].as<int>());
+        size_t block_size = string_to_size(vm["block_size"].as<std::string>());
+        return create_heap(heap_path, heap_size, metazone_size, block_size, vm["partitions"].as<int>(), vm["size_classes"].as<std::string>());
     }
     catch(po::error& e) 
     { 
@@ -348,7 +379,7 @@ std::string with_perc(size_t num, size_t den)
 class ZoneStats {
     typedef std::map<size_t, BlockStats> BlockStatsMap;
 public:
-    ZoneStats(size_t total_size, RRegion::TPtr<nvZone> nvzone = null_ptr)
+    ZoneStats(size_t total_size = 0, RRegion::TPtr<nvZone> nvzone = null_ptr)
         : total_size_(total_size),
           effective_size_(0),
           free_size_(0),
@@ -403,13 +434,13 @@ public:
             RRegion::TPtr<nvExtentHeader> exhdr = static_cast<RRegion::TPtr<nvExtentHeader>>(nvzone_->block_header(extent.start()));
             if (!extent_is_free) {
                 if (exhdr->secondary_type == nvExtentHeader::kExtentTypeSlab) {
-                    RRegion::TPtr<nvSlab> nvslab = static_cast<RRegion::TPtr<nvSlab>>(nvzone_->block(extent.start()));
+                    RRegion::TPtr<nvSlab> nvslab = nvSlab::at(nvzone_, extent.start());
                     add_stat(nvslab->block_size(), nvslab->nblocks(), nvslab->nblocks_free());
                 } else {
-                    add_stat(exhdr->size * BLOCK_SIZE, 1, 0);
+                    add_stat(exhdr->size * nvzone_->block_size(), 1, 0);
                 }
             } else {
-                add_stat(extent.len() * BLOCK_SIZE, 1, 1);
+                add_stat(extent.len() * nvzone_->block_size(), 1, 1);
             }
         }
     }
@@ -442,6 +473,38 @@ public:
         }
     }
 
+    void stream_json(std::ostream& os) const {
+        os << "{\"size\": " << total_size_;
+        os << ", \"effective_size\": " << effective_size_;
+        os << ", \"used_size\": " << effective_size_ - free_size_;
+        os << ", \"free_size\": " << free_size_;
+        if (nvzone_ != null_ptr) {
+            os << ", \"owner\": " << size_t(nvzone_->header.lease.lock_status());
+        }
+        os << ", \"blocks\": [";
+        for (BlockStatsMap::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+            const BlockStats& blockstats = it->second;
+            os << (it == blocks.begin() ? "" : ", ");
+            os << "{\"block_size\": " << blockstats.block_size_;
+            os << ", \"free_blocks\": " << blockstats.nblocks_free_;
+            os << ", \"total_blocks\": " << blockstats.nblocks_ << "}";
+        }
+        os << "]}";
+    }
+
+    // One row per block size; scope is the zone id or "summary"
+    void stream_csv(std::ostream& os, const std::string& scope) const {
+        std::string owner;
+        if (nvzone_ != null_ptr) {
+            owner = std::to_string(size_t(nvzone_->header.lease.lock_status()));
+        }
+        for (BlockStatsMap::const_iterator it = blocks.begin(); it != blocks.end(); it++) {
+            const BlockStats& blockstats = it->second;
+            os << scope << "," << owner << "," << total_size_ << "," << effective_size_ << "," << free_size_ << ",";
+            os << blockstats.block_size_ << "," << blockstats.nblocks_free_ << "," << blockstats.nblocks_ << std::endl;
+        }
+    }
+
     BlockStatsMap blocks;
     size_t total_size_;
     size_t effective_size_;
@@ -456,11 +519,41 @@ inline std::ostream& operator<<(std::ostream& os, const ZoneStats& zonestats)
 }
 
 
-int report_heap_stats(std::string heap_path, std::string zones, bool per_zone)
+// Build the statistics of zones in parallel. Workers claim zones from a 
+// shared index and fold them into a per-thread summary, so the only 
+// synchronization is the claim counter; per-thread summaries are merged 
+// once all workers are done. StatsT is constructed from a zone and 
+// merged through add_stat().
+template<typename StatsT>
+void scan_zones(RRegion::TPtr<nvHeap> nvheap, const std::vector<ZoneId>& zoneids, 
+                int nthreads, bool per_zone, std::vector<StatsT>* zs, StatsT* zs_all)
 {
-    int rc;
-    GlobalHeapInternal* heap;
+    std::atomic<size_t> next(0);
+    std::vector<StatsT> zs_thread(nthreads);
+    std::vector<std::thread> workers;
+
+    if (per_zone) {
+        zs->assign(zoneids.size(), StatsT());
+    }
+    for (int t = 0; t < nthreads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            for (size_t i = next++; i < zoneids.size(); i = next++) {
+                StatsT zone_stats(nvheap, zoneids[i]);
+                zs_thread[t].add_stat(zone_stats);
+                if (per_zone) {
+                    (*zs)[i] = zone_stats;
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < nthreads; t++) {
+        workers[t].join();
+        zs_all->add_stat(zs_thread[t]);
+    }
+}
 
+int open_existing_heap(std::string heap_path, GlobalHeapInternal** heap)
+{
     if (!heap_exists(heap_path)) {
         std::cout << "ERROR: Heap " << heap_path << " does not exist!" << std::endl;
         return -1;
@@ -468,30 +561,73 @@ int report_heap_stats(std::string heap_path, std::string zones, bool per_zone)
     std::vector<boost::filesystem::path> paths = find_existing_heap_paths(heap_path);
 
     if (paths.size() > 1) {
-        if ((rc = GlobalHeapInternal::open(paths, &heap)) != 0) {
-            return rc;
-        }
-    } else {
-        if ((rc = GlobalHeapInternal::open(paths[0], &heap)) != 0) {
-            return rc;
-        }
+        return GlobalHeapInternal::open(paths, heap);
+    } 
+    return GlobalHeapInternal::open(paths[0], heap);
+}
+
+int scan_threads(int nthreads, size_t nzones)
+{
+    if (nthreads <= 0) {
+        nthreads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return std::max(1, std::min(nthreads, static_cast<int>(nzones)));
+}
+
+int report_heap_stats(std::string heap_path, std::string zones, bool per_zone, int nthreads, std::string format)
+{
+    int rc;
+    GlobalHeapInternal* heap;
+
+    if (format != "text" && format != "json" && format != "csv") {
+        std::cout << "ERROR: Unknown format " << format << std::endl;
+        return -1;
+    }
+    if ((rc = open_existing_heap(heap_path, &heap)) != 0) {
+        return rc;
     }
     RRegion::TPtr<nvHeap> nvheap = heap->nvheap();
 
-    ZoneStats zs_all(0);
-    std::list<ZoneId> zoneids = expand_zones(heap, zones);
-    for (std::list<ZoneId>::iterator it = zoneids.begin(); it != zoneids.end(); it++) {
-        ZoneId zid = *it;
-        ZoneStats zs(nvheap, zid);
-        zs_all.add_stat(zs);
+    std::list<ZoneId> zone_list = expand_zones(heap, zones);
+    std::vector<ZoneId> zoneids{ std::begin(zone_list), std::end(zone_list) };
+    nthreads = scan_threads(nthreads, zoneids.size());
+
+    ZoneStats zs_all;
+    std::vector<ZoneStats> zs;
+    scan_zones(nvheap, zoneids, nthreads, per_zone, &zs, &zs_all);
+
+    if (format == "json") {
+        std::cout << "{";
         if (per_zone) {
-            std::cout << "ZONE: " << zid << std::endl;
-            std::cout << zs << std::endl;
+            std::cout << "\"zones\": [";
+            for (size_t i = 0; i < zoneids.size(); i++) {
+                std::cout << (i == 0 ? "" : ", ") << "{\"zone\": " << zoneids[i] << ", \"stats\": ";
+                zs[i].stream_json(std::cout);
+                std::cout << "}";
+            }
+            std::cout << "], ";
+        }
+        std::cout << "\"summary\": ";
+        zs_all.stream_json(std::cout);
+        std::cout << "}" << std::endl;
+    } else if (format == "csv") {
+        std::cout << "scope,owner,size,effective_size,free_size,block_size,free_blocks,total_blocks" << std::endl;
+        if (per_zone) {
+            for (size_t i = 0; i < zoneids.size(); i++) {
+                zs[i].stream_csv(std::cout, std::to_string(zoneids[i]));
+            }
         }
+        zs_all.stream_csv(std::cout, "summary");
+    } else {
+        if (per_zone) {
+            for (size_t i = 0; i < zoneids.size(); i++) {
+                std::cout << "ZONE: " << zoneids[i] << std::endl;
+                std::cout << zs[i] << std::endl;
+            }
+        }
+        std::cout << "SUMMARY" << std::endl;
+        std::cout << zs_all << std::endl;
     }
-
-    std::cout << "SUMMARY" << std::endl;
-    std::cout << zs_all << std::endl;
     return heap->close();
 }
 
@@ -503,7 +639,9 @@ int cmd_report(std::string progname, boost::program_options::parsed_options& par
         desc.add_options()
             ("zones", po::value<std::string>()->default_value("all")->required(), "Zones to report statistics for")
             ("heappath", po::value<std::string>()->required(), "Heap path")
-            ("perzone", po::value<bool>()->default_value(false), "Report per zone statistics");
+            ("perzone", po::value<bool>()->default_value(false), "Report per zone statistics")
+            ("threads", po::value<int>()->default_value(0), "Number of threads scanning zones (0 for one per CPU)")
+            ("format", po::value<std::string>()->default_value("text"), "Output format: text, json or csv");
 
         if (vm.count("help")) {
             return usage(progname, desc, 0);
@@ -517,7 +655,617 @@ int cmd_report(std::string progname, boost::program_options::parsed_options& par
         std::string heappath = vm["heappath"].as<std::string>();
         std::string zones = vm["zones"].as<std::string>();
         bool perzone = vm["perzone"].as<bool>();
-        return report_heap_stats(heappath, zones, perzone);
+        int nthreads = vm["threads"].as<int>();
+        std::string format = vm["format"].as<std::string>();
+        return report_heap_stats(heappath, zones, perzone, nthreads, format);
+    }
+    catch(po::error& e) 
+    { 
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl; 
+        return usage(progname, desc, 0);
+    } 
+    return -1;
+}
+
+/******************************************************************************
+ * REPORT HEAP FRAGMENTATION
+ ******************************************************************************/
+
+// Occupancy of the slabs of a size class
+class SlabClassStats {
+public:
+    static const int kOccupancyBins = 10; // 10% wide bins
+
+    SlabClassStats()
+        : nslabs_(0),
+          nblocks_(0),
+          nblocks_free_(0)
+    { 
+        std::fill(occupancy_, occupancy_ + kOccupancyBins, 0);
+    }
+
+    void add_slab(size_t nblocks, size_t nblocks_free)
+    {
+        int bin = ((nblocks - nblocks_free) * kOccupancyBins) / nblocks;
+        occupancy_[std::min(bin, kOccupancyBins - 1)]++;
+        nslabs_++;
+        nblocks_ += nblocks;
+        nblocks_free_ += nblocks_free;
+    }
+
+    void add_stat(const SlabClassStats& other)
+    {
+        for (int i = 0; i < kOccupancyBins; i++) {
+            occupancy_[i] += other.occupancy_[i];
+        }
+        nslabs_ += other.nslabs_;
+        nblocks_ += other.nblocks_;
+        nblocks_free_ += other.nblocks_free_;
+    }
+
+    size_t nslabs_;
+    size_t nblocks_;
+    size_t nblocks_free_;
+    size_t occupancy_[kOccupancyBins];
+};
+
+// Size classes and block size of the heap being reported
+static SizeClassTable frag_size_classes;
+static size_t frag_block_size = BLOCK_SIZE;
+
+// Summarize free-space fragmentation and slab occupancy of zones
+class FragStats {
+    typedef std::map<size_t, size_t> ExtentHistogram; // log2(extent blocks) -> #extents
+    typedef std::map<int, SlabClassStats> SlabClassMap;
+public:
+    FragStats()
+        : nzones_(0),
+          nfree_blocks_(0),
+          largest_free_(0),
+          largest_free_sum_(0),
+          slab_overhead_(0)
+    { }
+
+    FragStats(RRegion::TPtr<nvHeap> nvheap, ZoneId zid)
+        : nzones_(1),
+          nfree_blocks_(0),
+          largest_free_(0),
+          largest_free_sum_(0),
+          slab_overhead_(0)
+    {
+        RRegion::TPtr<nvZone> nvzone = nvheap->zone(zid);
+        ig_ = nvzone->header.ig;
+        summarize_zone(nvzone);
+        largest_free_sum_ = largest_free_;
+    }
+
+    void summarize_zone(RRegion::TPtr<nvZone> nvzone)
+    {
+        size_t nblocks = nvzone->nblocks();
+        Extent extent;
+        bool extent_is_free;
+        for (size_t next_start = 0;
+             find_extent(nvzone, next_start, nblocks, &extent, &extent_is_free) < nblocks; )
+        {
+            next_start = extent.start() + extent.len();
+            if (extent_is_free) {
+                add_free_extent(extent.len());
+                continue;
+            }
+            RRegion::TPtr<nvExtentHeader> exhdr = static_cast<RRegion::TPtr<nvExtentHeader>>(nvzone->block_header(extent.start()));
+            if (exhdr->secondary_type == nvExtentHeader::kExtentTypeSlab) {
+                RRegion::TPtr<nvSlab> nvslab = nvSlab::at(nvzone, extent.start());
+                if (nvslab->nblocks() > 0) {
+                    slabs_[nvslab->sizeclass()].add_slab(nvslab->nblocks(), nvslab->nblocks_free());
+                    slab_overhead_ += nvslab->slack();
+                }
+            }
+        }
+    }
+
+    void add_free_extent(size_t len)
+    {
+        size_t bucket = 0;
+        while ((size_t(2) << bucket) <= len) {
+            bucket++;
+        }
+        free_extents_[bucket]++;
+        nfree_blocks_ += len;
+        largest_free_ = std::max(largest_free_, len);
+    }
+
+    void add_stat(const FragStats& other)
+    {
+        nzones_ += other.nzones_;
+        nfree_blocks_ += other.nfree_blocks_;
+        largest_free_ = std::max(largest_free_, other.largest_free_);
+        largest_free_sum_ += other.largest_free_sum_;
+        slab_overhead_ += other.slab_overhead_;
+        for (ExtentHistogram::const_iterator it = other.free_extents_.begin(); it != other.free_extents_.end(); it++) {
+            free_extents_[it->first] += it->second;
+        }
+        for (SlabClassMap::const_iterator it = other.slabs_.begin(); it != other.slabs_.end(); it++) {
+            slabs_[it->first].add_stat(it->second);
+        }
+    }
+
+    // External fragmentation index: 0 when the free space of each zone is 
+    // one extent, approaching 1 as free space is scattered over small 
+    // extents. Extents cannot span zones, so for a group of zones the 
+    // largest free extent of each zone counts as unfragmented.
+    double fragmentation_index() const
+    {
+        if (nfree_blocks_ == 0) {
+            return 0;
+        }
+        return 1.0 - double(largest_free_sum_) / double(nfree_blocks_);
+    }
+
+    // Bytes lost to size-class rounding by the allocated blocks of a class.
+    // Requested sizes are not persisted, so the loss is bounded by the gap
+    // to the next smaller class; the average assumes requests uniformly 
+    // distributed within the gap.
+    static size_t rounding_loss_max(int szclass, size_t nblocks_used)
+    {
+        size_t gap = frag_size_classes.size_from_class(szclass) - (szclass > 0 ? frag_size_classes.size_from_class(szclass-1) : 0);
+        return nblocks_used * (gap - 1);
+    }
+
+    size_t rounding_loss_max() const
+    {
+        size_t loss = 0;
+        for (SlabClassMap::const_iterator it = slabs_.begin(); it != slabs_.end(); it++) {
+            loss += rounding_loss_max(it->first, it->second.nblocks_ - it->second.nblocks_free_);
+        }
+        return loss;
+    }
+
+    void stream_to(std::ostream& os) const {
+        os << std::setw(28) << std::left << "Zones: " << nzones_ << std::endl;
+        os << std::setw(28) << std::left << "Free size: " << nfree_blocks_ * frag_block_size << std::endl;
+        os << std::setw(28) << std::left << "Largest free extent: " << largest_free_ * frag_block_size << std::endl;
+        os << std::setw(28) << std::left << "Fragmentation index: " << std::fixed << std::setprecision(3) << fragmentation_index() << std::endl;
+        os << std::setw(28) << std::left << "Slab overhead: " << slab_overhead_ << std::endl;
+        os << std::setw(28) << std::left << "Rounding loss (max/avg): " << rounding_loss_max() << "/" << rounding_loss_max() / 2 << std::endl;
+
+        os << std::endl;
+        os << "Free extent histogram:" << std::endl;
+        os << std::setw(20) << std::left << "Min Size";
+        os << std::setw(20) << std::left << "#Extents";
+        os << std::endl;
+        for (ExtentHistogram::const_iterator it = free_extents_.begin(); it != free_extents_.end(); it++) {
+            os << std::setw(20) << std::left << (size_t(1) << it->first) * frag_block_size;
+            os << std::setw(20) << std::left << it->second;
+            os << std::endl;
+        }
+
+        os << std::endl;
+        os << "Slab occupancy (#slabs per 10% used bin):" << std::endl;
+        os << std::setw(12) << std::left << "Block Size";
+        os << std::setw(10) << std::left << "#Slabs";
+        for (int i = 0; i < SlabClassStats::kOccupancyBins; i++) {
+            std::stringstream ss;
+            ss << i * 10 << "%";
+            os << std::setw(7) << std::left << ss.str();
+        }
+        os << std::setw(20) << std::left << "Rounding Loss(max)";
+        os << std::endl;
+        for (SlabClassMap::const_iterator it = slabs_.begin(); it != slabs_.end(); it++) {
+            const SlabClassStats& cs = it->second;
+            os << std::setw(12) << std::left << frag_size_classes.size_from_class(it->first);
+            os << std::setw(10) << std::left << cs.nslabs_;
+            for (int i = 0; i < SlabClassStats::kOccupancyBins; i++) {
+                os << std::setw(7) << std::left << cs.occupancy_[i];
+            }
+            os << std::setw(20) << std::left << rounding_loss_max(it->first, cs.nblocks_ - cs.nblocks_free_);
+            os << std::endl;
+        }
+    }
+
+    void stream_json(std::ostream& os) const {
+        os << "{\"zones\": " << nzones_;
+        os << ", \"free_size\": " << nfree_blocks_ * frag_block_size;
+        os << ", \"largest_free_extent\": " << largest_free_ * frag_block_size;
+        os << ", \"fragmentation_index\": " << std::fixed << std::setprecision(3) << fragmentation_index();
+        os << ", \"slab_overhead\": " << slab_overhead_;
+        os << ", \"rounding_loss_max\": " << rounding_loss_max();
+        os << ", \"rounding_loss_avg\": " << rounding_loss_max() / 2;
+        os << ", \"free_extents\": [";
+        for (ExtentHistogram::const_iterator it = free_extents_.begin(); it != free_extents_.end(); it++) {
+            os << (it == free_extents_.begin() ? "" : ", ");
+            os << "{\"min_size\": " << (size_t(1) << it->first) * frag_block_size << ", \"count\": " << it->second << "}";
+        }
+        os << "], \"slabs\": [";
+        for (SlabClassMap::const_iterator it = slabs_.begin(); it != slabs_.end(); it++) {
+            const SlabClassStats& cs = it->second;
+            os << (it == slabs_.begin() ? "" : ", ");
+            os << "{\"block_size\": " << frag_size_classes.size_from_class(it->first);
+            os << ", \"slabs\": " << cs.nslabs_;
+            os << ", \"free_blocks\": " << cs.nblocks_free_;
+            os << ", \"total_blocks\": " << cs.nblocks_;
+            os << ", \"rounding_loss_max\": " << rounding_loss_max(it->first, cs.nblocks_ - cs.nblocks_free_);
+            os << ", \"occupancy\": [";
+            for (int i = 0; i < SlabClassStats::kOccupancyBins; i++) {
+                os << (i == 0 ? "" : ", ") << cs.occupancy_[i];
+            }
+            os << "]}";
+        }
+        os << "]}";
+    }
+
+    InterleaveGroup   ig_;
+    size_t            nzones_;
+    size_t            nfree_blocks_;
+    size_t            largest_free_; // in blocks
+    size_t            largest_free_sum_; // sum of the largest free extent of each zone
+    size_t            slab_overhead_; // slab bytes not usable for blocks (inline header and tail)
+    ExtentHistogram   free_extents_;
+    SlabClassMap      slabs_;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const FragStats& fragstats)
+{
+    fragstats.stream_to(os);
+    return os;
+}
+
+
+int report_heap_frag(std::string heap_path, std::string zones, bool per_zone, int nthreads, std::string format)
+{
+    int rc;
+    GlobalHeapInternal* heap;
+
+    if (format != "text" && format != "json") {
+        std::cout << "ERROR: Unknown format " << format << std::endl;
+        return -1;
+    }
+    if ((rc = open_existing_heap(heap_path, &heap)) != 0) {
+        return rc;
+    }
+    RRegion::TPtr<nvHeap> nvheap = heap->nvheap();
+    frag_size_classes = heap->size_classes();
+    frag_block_size = nvheap->block_size();
+
+    std::list<ZoneId> zone_list = expand_zones(heap, zones);
+    std::vector<ZoneId> zoneids{ std::begin(zone_list), std::end(zone_list) };
+    nthreads = scan_threads(nthreads, zoneids.size());
+
+    // per-zone results are always needed to group zones by interleave group
+    FragStats fs_all;
+    std::vector<FragStats> fs;
+    scan_zones(nvheap, zoneids, nthreads, true, &fs, &fs_all);
+
+    std::map<InterleaveGroup, FragStats> fs_ig;
+    for (size_t i = 0; i < zoneids.size(); i++) {
+        fs_ig[fs[i].ig_].add_stat(fs[i]);
+    }
+
+    if (format == "json") {
+        std::cout << "{";
+        if (per_zone) {
+            std::cout << "\"zones\": [";
+            for (size_t i = 0; i < zoneids.size(); i++) {
+                std::cout << (i == 0 ? "" : ", ") << "{\"zone\": " << zoneids[i] << ", \"ig\": " << int(fs[i].ig_) << ", \"stats\": ";
+                fs[i].stream_json(std::cout);
+                std::cout << "}";
+            }
+            std::cout << "], ";
+        }
+        std::cout << "\"interleave_groups\": [";
+        for (std::map<InterleaveGroup, FragStats>::iterator it = fs_ig.begin(); it != fs_ig.end(); it++) {
+            std::cout << (it == fs_ig.begin() ? "" : ", ") << "{\"ig\": " << int(it->first) << ", \"stats\": ";
+            it->second.stream_json(std::cout);
+            std::cout << "}";
+        }
+        std::cout << "], \"summary\": ";
+        fs_all.stream_json(std::cout);
+        std::cout << "}" << std::endl;
+    } else {
+        if (per_zone) {
+            for (size_t i = 0; i < zoneids.size(); i++) {
+                std::cout << "ZONE: " << zoneids[i] << " (interleave group " << int(fs[i].ig_) << ")" << std::endl;
+                std::cout << fs[i] << std::endl;
+            }
+        }
+        for (std::map<InterleaveGroup, FragStats>::iterator it = fs_ig.begin(); it != fs_ig.end(); it++) {
+            std::cout << "INTERLEAVE GROUP: " << int(it->first) << std::endl;
+            std::cout << it->second << std::endl;
+        }
+        std::cout << "SUMMARY" << std::endl;
+        std::cout << fs_all << std::endl;
+    }
+    return heap->close();
+}
+
+int cmd_frag(std::string progname, boost::program_options::parsed_options& parsed, boost::program_options::variables_map& vm)
+{
+    namespace po = boost::program_options; 
+    po::options_description desc("frag options");
+    try {
+        desc.add_options()
+            ("zones", po::value<std::string>()->default_value("all")->required(), "Zones to report fragmentation for")
+            ("heappath", po::value<std::string>()->required(), "Heap path")
+            ("perzone", po::value<bool>()->default_value(false), "Report per zone fragmentation")
+            ("threads", po::value<int>()->default_value(0), "Number of threads scanning zones (0 for one per CPU)")
+            ("format", po::value<std::string>()->default_value("text"), "Output format: text or json");
+
+        if (vm.count("help")) {
+            return usage(progname, desc, 0);
+        }
+
+        std::vector<std::string> opts = po::collect_unrecognized(parsed.options, po::include_positional);
+        opts.erase(opts.begin());
+        po::store(po::command_line_parser(opts).options(desc).run(), vm);
+        po::notify(vm); // throws on error, so do after help in case 
+                        // there are any problems 
+        std::string heappath = vm["heappath"].as<std::string>();
+        std::string zones = vm["zones"].as<std::string>();
+        bool perzone = vm["perzone"].as<bool>();
+        int nthreads = vm["threads"].as<int>();
+        std::string format = vm["format"].as<std::string>();
+        return report_heap_frag(heappath, zones, perzone, nthreads, format);
+    }
+    catch(po::error& e) 
+    { 
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl; 
+        return usage(progname, desc, 0);
+    } 
+    return -1;
+}
+
+/******************************************************************************
+ * MONITOR LIVE HEAP STATISTICS
+ ******************************************************************************/
+
+typedef std::map<std::string, StatsSample> StatsSampleMap;
+
+// Read the stats segments of all live processes that attached heap_path 
+// (or any heap if heap_path is empty). Segments are read without 
+// synchronizing with the publishing processes.
+void sample_stats_segments(std::string heap_path, StatsSampleMap* samples)
+{
+    std::vector<std::string> names;
+    list_stats_segments(&names);
+    for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); it++) {
+        StatsSample sample;
+        if (read_stats_segment(*it, &sample) != 0) {
+            continue;
+        }
+        if (!stats_publisher_alive(sample)) {
+            continue;
+        }
+        if (!heap_path.empty() && heap_path != sample.heap_path) {
+            continue;
+        }
+        samples->insert(std::pair<std::string, StatsSample>(*it, sample));
+    }
+}
+
+std::string per_sec(uint64_t count, uint64_t elapsed_ns)
+{
+    std::stringstream ss;
+    if (elapsed_ns == 0) {
+        ss << "-";
+    } else {
+        ss << (count * 1000000000ULL) / elapsed_ns;
+    }
+    return ss.str();
+}
+
+void stream_top(std::ostream& os, const StatsSampleMap& prev, const StatsSampleMap& cur)
+{
+    os << std::setw(8) << std::left << "PID";
+    os << std::setw(12) << std::left << "INSTANCE";
+    os << std::setw(8) << std::left << "ZONES";
+    os << std::setw(16) << std::left << "ZONE BYTES";
+    os << std::setw(16) << std::left << "SLAB BYTES";
+    os << std::setw(8) << std::left << "FRAG%";
+    os << std::setw(12) << std::left << "MALLOC/s";
+    os << std::setw(12) << std::left << "FREE/s";
+    os << std::setw(12) << std::left << "REFILL/s";
+    os << std::setw(12) << std::left << "CONTEND/s";
+    os << std::setw(12) << std::left << "OOM/s";
+    os << "HEAP" << std::endl;
+    for (StatsSampleMap::const_iterator it = cur.begin(); it != cur.end(); it++) {
+        const StatsSample& sample = it->second;
+        HeapStats stats;
+        sample.to(&stats);
+        // rates are only known for processes seen in the previous round
+        HeapStats prev_stats;
+        uint64_t elapsed_ns = 0;
+        StatsSampleMap::const_iterator pit = prev.find(it->first);
+        if (pit != prev.end() && sample.timestamp_ns > pit->second.timestamp_ns) {
+            pit->second.to(&prev_stats);
+            elapsed_ns = sample.timestamp_ns - pit->second.timestamp_ns;
+        }
+        os << std::setw(8) << std::left << sample.pid;
+        os << std::setw(12) << std::left << sample.generation;
+        os << std::setw(8) << std::left << sample.zones_owned;
+        os << std::setw(16) << std::left << sample.zones_owned * sample.metazone_size;
+        os << std::setw(16) << std::left << sample.slab_bytes;
+        os << std::setw(8) << std::left << std::fixed << std::setprecision(1) << stats.slab_fragmentation();
+        os << std::setw(12) << std::left << per_sec(stats.total_mallocs() - prev_stats.total_mallocs(), elapsed_ns);
+        os << std::setw(12) << std::left << per_sec(stats.total_frees() - prev_stats.total_frees(), elapsed_ns);
+        os << std::setw(12) << std::left << per_sec(stats.slab_refills - prev_stats.slab_refills, elapsed_ns);
+        os << std::setw(12) << std::left << per_sec(stats.lock_contentions - prev_stats.lock_contentions, elapsed_ns);
+        os << std::setw(12) << std::left << per_sec(stats.oom_failures - prev_stats.oom_failures, elapsed_ns);
+        os << sample.heap_path << std::endl;
+    }
+}
+
+int top_heap_stats(std::string heap_path, size_t interval_ms, size_t count)
+{
+    std::string stats_path;
+    if (!heap_path.empty()) {
+        if (!heap_exists(heap_path)) {
+            std::cout << "ERROR: Heap " << heap_path << " does not exist!" << std::endl;
+            return -1;
+        }
+        stats_path = stats_heap_path(find_existing_heap_paths(heap_path));
+    }
+
+    StatsSampleMap prev;
+    sample_stats_segments(stats_path, &prev);
+    for (size_t i = 0; count == 0 || i < count; i++) {
+        usleep(interval_ms * 1000);
+        StatsSampleMap cur;
+        sample_stats_segments(stats_path, &cur);
+        stream_top(std::cout, prev, cur);
+        std::cout << std::endl;
+        prev.swap(cur);
+    }
+    return 0;
+}
+
+int cmd_top(std::string progname, boost::program_options::parsed_options& parsed, boost::program_options::variables_map& vm)
+{
+    namespace po = boost::program_options; 
+    po::options_description desc("top options");
+    try {
+        desc.add_options()
+            ("heappath", po::value<std::string>()->default_value(""), "Heap path (all heaps if empty)")
+            ("interval", po::value<size_t>()->default_value(1000), "Sampling interval in milliseconds")
+            ("count", po::value<size_t>()->default_value(1), "Number of samples to report (0 for unlimited)");
+
+        if (vm.count("help")) {
+            return usage(progname, desc, 0);
+        }
+
+        std::vector<std::string> opts = po::collect_unrecognized(parsed.options, po::include_positional);
+        opts.erase(opts.begin());
+        po::store(po::command_line_parser(opts).options(desc).run(), vm);
+        po::notify(vm); // throws on error, so do after help in case 
+                        // there are any problems 
+        std::string heappath = vm["heappath"].as<std::string>();
+        size_t interval = vm["interval"].as<size_t>();
+        size_t count = vm["count"].as<size_t>();
+        return top_heap_stats(heappath, interval, count);
+    }
+    catch(po::error& e) 
+    { 
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl; 
+        return usage(progname, desc, 0);
+    } 
+    return -1;
+}
+
+/******************************************************************************
+ * PROFILE SIZE CLASSES
+ ******************************************************************************/
+
+// Read a size histogram from the mallocs of an allocation trace 
+int read_trace_histogram(std::string filename, std::map<size_t, uint64_t>* histogram)
+{
+    TraceHeader header;
+    std::vector<TraceRecord> records;
+    if (read_trace(filename, &header, &records) != 0) {
+        std::cout << "ERROR: Cannot read trace " << filename << std::endl;
+        return -1;
+    }
+    for (std::vector<TraceRecord>::iterator it = records.begin(); it != records.end(); it++) {
+        if (it->op == TraceRecord::kOpMalloc) {
+            (*histogram)[it->size]++;
+        }
+    }
+    return 0;
+}
+
+// Read a size histogram of "size count" lines; lines starting with # are comments
+int read_text_histogram(std::string filename, std::map<size_t, uint64_t>* histogram)
+{
+    std::ifstream is(filename.c_str());
+    if (!is) {
+        std::cout << "ERROR: Cannot read histogram " << filename << std::endl;
+        return -1;
+    }
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream ss(line);
+        size_t size;
+        uint64_t count;
+        if (!(ss >> size >> count)) {
+            std::cout << "ERROR: Malformed histogram line: " << line << std::endl;
+            return -1;
+        }
+        (*histogram)[size] += count;
+    }
+    return 0;
+}
+
+int profile_sizes(std::string trace, std::string histogram_file, int nclasses, std::string output)
+{
+    std::map<size_t, uint64_t> histogram;
+    if (!trace.empty() && read_trace_histogram(trace, &histogram) != 0) {
+        return -1;
+    }
+    if (!histogram_file.empty() && read_text_histogram(histogram_file, &histogram) != 0) {
+        return -1;
+    }
+    if (histogram.empty()) {
+        std::cout << "ERROR: No allocation sizes to profile (use --trace or --histogram)" << std::endl;
+        return -1;
+    }
+
+    std::vector<size_t> sizes;
+    SizeClassTable table;
+    if (profile_size_classes(histogram, nclasses, &sizes) != 0 || table.set(sizes) != 0) {
+        return -1;
+    }
+
+    uint64_t nallocs = 0;
+    uint64_t bytes = 0;
+    for (std::map<size_t, uint64_t>::iterator it = histogram.begin(); it != histogram.end(); it++) {
+        if (it->first <= SizeClassTable::kMaxSmallSize) {
+            nallocs += it->second;
+            bytes += it->first * it->second;
+        }
+    }
+
+    // the table is written with comments, so that it can be fed back to 
+    // create --size_classes as is
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output.c_str());
+        if (!file) {
+            std::cout << "ERROR: Cannot write size classes " << output << std::endl;
+            return -1;
+        }
+    }
+    std::ostream& os = output.empty() ? std::cout : file;
+    os << "# small allocations: " << nallocs << " (" << bytes << " bytes)" << std::endl;
+    os << "# rounding waste with default classes: " << default_size_classes.rounding_waste(histogram) << " bytes" << std::endl;
+    os << "# rounding waste with these " << table.nclasses() << " classes: " << table.rounding_waste(histogram) << " bytes" << std::endl;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        os << sizes[i] << std::endl;
+    }
+    return 0;
+}
+
+int cmd_profile_sizes(std::string progname, boost::program_options::parsed_options& parsed, boost::program_options::variables_map& vm)
+{
+    namespace po = boost::program_options; 
+    po::options_description desc("profile-sizes options");
+    try {
+        desc.add_options()
+            ("trace", po::value<std::string>()->default_value(""), "Allocation trace to take the size histogram from (see StatsOptions::trace_dir)")
+            ("histogram", po::value<std::string>()->default_value(""), "File with a size histogram, one \"size count\" pair per line")
+            ("classes", po::value<int>()->default_value(kSizeClasses), "Maximum number of size classes")
+            ("output", po::value<std::string>()->default_value(""), "File to write the size classes to (standard output if empty)");
+
+        if (vm.count("help")) {
+            return usage(progname, desc, 0);
+        }
+
+        std::vector<std::string> opts = po::collect_unrecognized(parsed.options, po::include_positional);
+        opts.erase(opts.begin());
+        po::store(po::command_line_parser(opts).options(desc).run(), vm);
+        po::notify(vm); // throws on error, so do after help in case 
+                        // there are any problems 
+        return profile_sizes(vm["trace"].as<std::string>(), vm["histogram"].as<std::string>(), 
+                             vm["classes"].as<int>(), vm["output"].as<std::string>());
     }
     catch(po::error& e) 
     { 
@@ -544,7 +1292,7 @@ int main(int argc, char** argv)
             ("help", "Print help messages") 
             ("config", po::value<std::string>(), "File to load Alps/Pegasus configuration options from") 
             ("log_level", po::value<std::string>()->default_value("warning"), "Log messages at or above this level: INFO, WARNING, ERROR, and FATAL")
-            ("command", po::value<std::string>()->required(), "Command to execute: [create, format, report]")
+            ("command", po::value<std::string>()->required(), "Command to execute: [create, format, report, frag, top, profile-sizes]")
             ("heappath", po::value<std::string>(), "Heap path")
             ("subargs", po::value<std::vector<std::string> >(), "Arguments for command");
 
@@ -592,6 +1340,12 @@ int main(int argc, char** argv)
                 ret = cmd_format(progname, parsed, vm);
             } else if (cmd == "report") {
                 ret = cmd_report(progname, parsed, vm);
+            } else if (cmd == "frag") {
+                ret = cmd_frag(progname, parsed, vm);
+            } else if (cmd == "top") {
+                ret = cmd_top(progname, parsed, vm);
+            } else if (cmd == "profile-sizes") {
+                ret = cmd_profile_sizes(progname, parsed, vm);
             } else {
                 std::cout << "ERROR: Unrecognized command " << cmd << std::endl;
                 ret = -1;
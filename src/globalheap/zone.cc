@@ -53,9 +53,7 @@ ErrorCode Zone::alloc_extent(size_t size_nblocks, RRegion::TPtr<nvExtentHeader>*
 
 void Zone::free_extent(RRegion::TPtr<void> ptr)
 {
-    RRegion::TPtr<nvBlock> nvblock_base = nvzone_->block(0);
-    uintptr_t offset = ptr.offset() - nvblock_base.offset();
-    size_t idx = offset >> BLOCK_LOG2SIZE;
+    size_t idx = nvzone_->block_id(ptr);
     RRegion::TPtr<nvExtentHeader> nvexheader = static_cast<RRegion::TPtr<nvExtentHeader>>(nvzone_->block_header(idx));
     fsmap_.free_extent(Extent(idx, nvexheader->size));
     nvexheader->mark_free();
@@ -22,9 +22,11 @@
 
 #include "alps/globalheap/memattrib.hh"
 
+#include "common/event_trace.hh"
 #include "globalheap/layout.hh"
 #include "globalheap/lease.hh"
 #include "globalheap/rwlock.hh"
+#include "globalheap/stats.hh"
 #include "globalheap/zone.hh"
 
 namespace alps {
@@ -51,13 +53,15 @@ protected:
 
 public:
     ZoneHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation)
-        : nvheap_(nvheap),
+        : rwlock_(kLockSiteZoneHeapRead, kLockSiteZoneHeapWrite),
+          nvheap_(nvheap),
           generation_(generation),
           memattrib_(0)
     { }
 
     ZoneHeap(RRegion::TPtr<nvHeap> nvheap, Generation generation, const MemAttrib& memattrib)
-        : nvheap_(nvheap),
+        : rwlock_(kLockSiteZoneHeapRead, kLockSiteZoneHeapWrite),
+          nvheap_(nvheap),
           generation_(generation),
           memattrib_(memattrib)
     { }
@@ -81,12 +85,22 @@ public:
         return nvheap_;
     }
 
+    /**
+     * @brief Add the statistics counters and the number of zones owned by
+     * this heap to @a stats 
+     */
+    void stats(HeapStats* stats);
+
+protected:
+    void count_zone_search(uint64_t elapsed_ns);
+
 protected:
     ReaderWriterLock      rwlock_; // serializes zone acquisition
     RRegion::TPtr<nvHeap> nvheap_;
     Generation            generation_;
     MemAttrib             memattrib_;
     ZoneSet               zones_;
+    StatsCounters         zone_stats_; // updated under rwlock_
 };
 
 inline RRegion::TPtr<nvZone> ZoneHeap::nvzone(RRegion::TPtr<void> ptr)
@@ -99,6 +113,22 @@ inline RRegion::TPtr<nvZone> ZoneHeap::nvzone(size_t zone_id)
     return nvheap_->zone(zone_id);
 }
 
+inline void ZoneHeap::stats(HeapStats* stats)
+{
+    rwlock_.lock_read();
+    zone_stats_.add_to(stats);
+    stats->zones_owned += zones_.size();
+    rwlock_.unlock_read();
+}
+
+inline void ZoneHeap::count_zone_search(uint64_t elapsed_ns)
+{
+    rwlock_.lock_write();
+    zone_stats_.zone_searches++;
+    zone_stats_.zone_search_ns += elapsed_ns;
+    rwlock_.unlock_write();
+}
+
 inline MemAttrib ZoneHeap::nvzone_memattrib(size_t zone_id)
 {
     InterleaveGroup ig = nvheap_->zone(zone_id)->header.ig;
@@ -146,11 +176,20 @@ Zone* ZoneHeap::acquire_zone(bool alloc_new_zone, size_t zone_id, size_t min_fre
         }
         // if we won the race with other threads then initialize zone descriptor
         if (nvzone->header.lease.lock_status() == Lease::kUnlocked) { 
-            if (nvzone->header.lease.try_lock(generation_) == 0) {
+            if (nvzone->header.lease.try_lock(generation_) != 0) {
+                // another process leased the zone since we checked
+                HEAP_STATS(zone_stats_.lease_conflicts++);
+            } else {
+                if (nvzone->format_pending()) {
+                    LOG(info) << "Format lazily formatted zone: " << zone_id;
+                    nvzone->format_blocks();
+                }
                 Zone* zone = new Zone(nvheap_, nvzone);
                 zone->init();
                 if (min_free_blocks == 0 || zone->has_free_space(min_free_blocks)) {
                     LOG(info) << "Acquired zone: " << zone_id; 
+                    HEAP_STATS(zone_stats_.zone_acquisitions++);
+                    TRACE_EVENT(kEventAcquireZone, zone_id, 0);
                     zone->enumerate(enumerate_callback_functor);
                     zones_.insert(zone);
                     rwlock_.unlock_write();
@@ -170,30 +209,28 @@ Zone* ZoneHeap::acquire_zone(bool alloc_new_zone, size_t zone_id, size_t min_fre
 template<typename T> 
 Zone* ZoneHeap::acquire_new_zone(size_t min_free_blocks, T enumerate_callback_functor)
 {
-    Zone* zone;
+    Zone* zone = NULL;
     size_t nzones = nvheap_->nzones();
+#ifdef ALPS_HEAP_STATS
+    uint64_t start = stats_clock_ns();
+#endif
 
     for (size_t i=0; i<nzones; i++) {
         if ((zone = acquire_zone(true, i, min_free_blocks, enumerate_callback_functor))) {
-            return zone;
+            break;
         }
     }
-    return NULL;
+#ifdef ALPS_HEAP_STATS
+    count_zone_search(stats_clock_ns() - start);
+#endif
+    return zone;
 }
 
 
 template<typename T> 
 Zone* ZoneHeap::acquire_new_zone(T enumerate_callback_functor)
 {
-    Zone* zone;
-    size_t nzones = nvheap_->nzones();
-
-    for (size_t i=0; i<nzones; i++) {
-        if ((zone = acquire_zone(true, i, 1, enumerate_callback_functor))) {
-            return zone;
-        }
-    }
-    return NULL;
+    return acquire_new_zone(1, enumerate_callback_functor);
 }
 
 
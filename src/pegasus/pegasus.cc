@@ -25,6 +25,10 @@
 #include "alps/pegasus/pegasus_options.hh"
 
 #include "common/debug.hh"
+#include "common/event_trace.hh"
+#include "common/maintenance.hh"
+#include "common/persist.hh"
+#include "common/stats_export.hh"
 #include "pegasus/lfs_region_file.hh"
 #include "pegasus/lfs_topology.hh"
 #include "pegasus/region_file_factory.hh"
@@ -94,6 +98,10 @@ ErrorStack Pegasus::init(const PegasusOptions& pegasus_options)
         return kRetOk;
     }
     init_log(pegasus_options.debug_options);
+    init_event_trace(pegasus_options.debug_options);
+    init_persist(pegasus_options.persist_options);
+    init_stats_export(pegasus_options.stats_options);
+    init_maintenance(pegasus_options.maintenance_options);
 
     address_space_ = new AddressSpace(pegasus_options.address_space_options);
     region_file_factory_ = new RegionFileFactory(pegasus_options);
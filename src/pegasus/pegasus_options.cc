@@ -25,6 +25,9 @@ std::vector< CHILD_PTR > get_children_impl(PARENT_OPTION_PTR option) {
     std::vector< CHILD_PTR > children;
     children.push_back(&option->debug_options);
     children.push_back(&option->lfs_options);
+    children.push_back(&option->maintenance_options);
+    children.push_back(&option->persist_options);
+    children.push_back(&option->stats_options);
     children.push_back(&option->tmpfs_options);
     return children;
 }
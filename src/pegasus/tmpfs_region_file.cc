@@ -59,7 +59,6 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <algorithm>
@@ -67,6 +66,8 @@
 #include <fstream>
 #include <map>
 #include <sstream>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <boost/serialization/map.hpp>
 #include <boost/serialization/string.hpp>
@@ -207,7 +208,56 @@ ErrorCode TmpfsRegionFile::close()
     return kErrorCodeOk;
 }
 
-ErrorCode TmpfsRegionFile::__alloc_physical_frames(int fd, loff_t offset, loff_t length, bool zero_books) 
+// Linux 5.14: faults in the pages of a mapping without the tmpfs inode 
+// lock that fallocate holds for the whole allocation
+#ifndef MADV_POPULATE_WRITE
+# define MADV_POPULATE_WRITE 23
+#endif
+
+/**
+ * @brief Allocate the pages of books [offset, offset+length) of the file 
+ * on NUMA node @a node
+ *
+ * @details
+ * Runs in its own thread, as tmpfs places the pages of a file according to
+ * the memory policy of the thread that allocates them.
+ */
+static void alloc_node_books(int fd, int node, const std::vector<std::pair<loff_t, loff_t> >* runs, 
+                             bool zero_books, ErrorCode* rc)
+{
+    os_set_membind(node); // the interleave group is the socket node
+
+    *rc = kErrorCodeOk;
+    for (std::vector<std::pair<loff_t, loff_t> >::const_iterator it = runs->begin(); it != runs->end(); it++) {
+        loff_t off = it->first;
+        loff_t len = it->second;
+        void* addr = ::mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, off);
+        if (addr != MAP_FAILED) {
+            int ret = 0;
+            if (zero_books) {
+                memset(addr, 0, len);
+            } else {
+                ret = ::madvise(addr, len, MADV_POPULATE_WRITE);
+            }
+            ::munmap(addr, len);
+            if (ret == 0) {
+                continue;
+            }
+            if (errno != EINVAL) {
+                *rc = kErrorCodeGeneric;
+                return;
+            }
+        }
+        // kernels without MADV_POPULATE_WRITE, or a descriptor that cannot
+        // be mapped for writing
+        if (zero_books ? os_write_zeros(fd, off, len) != 0 : posix_fallocate(fd, off, len) != 0) {
+            *rc = kErrorCodeGeneric;
+            return;
+        }
+    }
+}
+
+ErrorCode TmpfsRegionFile::alloc_physical_frames(int fd, loff_t offset, loff_t length, bool zero_books) 
 {
     if (length < 0) {
         return kErrorCodeInvalidParameter;
@@ -236,9 +286,9 @@ ErrorCode TmpfsRegionFile::__alloc_physical_frames(int fd, loff_t offset, loff_t
         // to this by constructing an interleave request that emulates a round-robin 
         // interleave policy across the sockets/nodes of the system
         case kRoundRobin:
-            int max_n = numa_max_node();
+            int nnodes = numa_max_node() + 1;
             for (size_t i=0; i<end/booksize_; i++) {
-                interleave_request.push_back(i % max_n);
+                interleave_request.push_back(i % nnodes);
             } 
             break;
     }
@@ -251,6 +301,9 @@ ErrorCode TmpfsRegionFile::__alloc_physical_frames(int fd, loff_t offset, loff_t
         interleave_request.push_back(0x0);
     }
 
+    // gather consecutive books of the same node into runs, and allocate 
+    // the runs of each node with a thread of its own
+    std::map<int, std::vector<std::pair<loff_t, loff_t> > > node_runs;
     int i;
     loff_t off;
     for (off = begin, i = begin/booksize_; 
@@ -258,21 +311,29 @@ ErrorCode TmpfsRegionFile::__alloc_physical_frames(int fd, loff_t offset, loff_t
          off += booksize_, i++) 
     {
         int interleave_group = static_cast<int>(interleave_request[i]);
-        os_set_membind(interleave_group); // the interleave group is the socket node
-        if (zero_books) {
-            if (os_write_zeros(fd, off, booksize_)) {
-                return kErrorCodeGeneric;
-            }
+        std::vector<std::pair<loff_t, loff_t> >& runs = node_runs[interleave_group];
+        if (!runs.empty() && runs.back().first + runs.back().second == off) {
+            runs.back().second += booksize_;
         } else {
-#if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
-            if (posix_fallocate(fd, off, booksize_) < 0) {
-                return kErrorCodeGeneric;
-            }
-#else
-            if (os_write_zeros(fd, off, booksize_)) {
-                return kErrorCodeGeneric;
-            }
-#endif
+            runs.push_back(std::make_pair(off, loff_t(booksize_)));
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<ErrorCode> rcs(node_runs.size());
+    size_t n = 0;
+    for (std::map<int, std::vector<std::pair<loff_t, loff_t> > >::iterator it = node_runs.begin(); 
+         it != node_runs.end(); 
+         it++, n++) 
+    {
+        threads.push_back(std::thread(alloc_node_books, fd, it->first, &it->second, zero_books, &rcs[n]));
+    }
+    for (n = 0; n < threads.size(); n++) {
+        threads[n].join();
+    }
+    for (n = 0; n < rcs.size(); n++) {
+        if (rcs[n] != kErrorCodeOk) {
+            return rcs[n];
         }
     }
 
@@ -283,51 +344,6 @@ ErrorCode TmpfsRegionFile::__alloc_physical_frames(int fd, loff_t offset, loff_t
     return kErrorCodeOk;
 }
 
-ErrorCode TmpfsRegionFile::alloc_physical_frames(int fd, loff_t offset, loff_t length, bool zero_books)
-{
-#ifdef PARALLEL_ALLOC
-    // we did not find this effective as tmpfs holds a file mutex when 
-    // allocating space to a file and thus serializes allocations
-    int N = 4;
-    pid_t pid[32];
-    for (int i=0; i<N; i++) {
-        pid[i] = fork();
-        if (pid[i] == 0) {
-            ErrorCode rc = __alloc_physical_frames(fd, offset+i*length/N, length/N, zero_books);
-            int ret = static_cast<int>(rc);
-            exit(ret);
-        }
-    }
-
-    for (int i=0; i<N; i++) {
-        if (pid[i] != 0) {
-            int status;
-            wait(&status);
-            if (status != 0) {
-                return static_cast<ErrorCode>(status);
-            }
-        }
-    }
-    return kErrorCodeOk;
-#else
-    pid_t pid = fork();
-    if (pid == 0) {
-        // child
-        ErrorCode rc = __alloc_physical_frames(fd, offset, length, zero_books);
-        int ret = static_cast<int>(rc);
-        exit(ret);
-    } else {
-        // parent
-        int status;
-        wait(&status);
-        if (status != 0) {
-            return static_cast<ErrorCode>(status);
-        }
-        return kErrorCodeOk;
-    }
-#endif
-}
-
 ErrorCode TmpfsRegionFile::ftruncate(int fd, off_t length, bool lock)
 {
     ErrorCode rc;
@@ -348,7 +364,15 @@ ErrorCode TmpfsRegionFile::ftruncate(int fd, off_t length, bool lock)
 
     loff_t delta = length - existing_length;
     if (delta > 0) {
+        // extend the file first so that the new books can be mapped
+        if (::ftruncate(fd, length) != 0) {
+            if (lock) tmpfs_release_global();
+            return kErrorCodeFsTruncateFailed;
+        }
         if ((rc = alloc_physical_frames(fd, existing_length, delta, false)) != kErrorCodeOk) {
+            if (::ftruncate(fd, existing_length) != 0) {
+                LOG(error) << "Cannot shrink TMPFS region file path: " << pathname_ << " back to size: " << existing_length;
+            }
             if (lock) tmpfs_release_global();    
             return rc;
         }
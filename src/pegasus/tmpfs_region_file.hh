@@ -79,7 +79,6 @@ private:
     int save_xattr_map(const char* path, const std::map<std::string, std::string>& map);
     int load_xattr_map(const char* path, std::map<std::string, std::string>* map);
     void set_interleave_policy(InterleavePolicy policy);
-    ErrorCode __alloc_physical_frames(int fd, loff_t offset, loff_t length, bool zero_books);
     ErrorCode alloc_physical_frames(int fd, loff_t offset, loff_t length, bool zero_books);
     ErrorCode ftruncate(int fd, off_t length, bool lock);
  
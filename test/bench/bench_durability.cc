@@ -0,0 +1,197 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file bench_durability.cc
+ *
+ * @brief Allocation throughput of the global heap under each durability 
+ * mode and slab bitmap batch size (see PersistOptions).
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include "alps/globalheap/globalheap.hh"
+
+#include "common/persist.hh"
+#include "globalheap/persist.hh"
+#include "test_common.hh"
+
+using namespace alps;
+
+#define PROGNAME argv[0]
+
+struct BenchResult {
+    size_t          nops;
+    PersistCounters counters;
+};
+
+void alloc_free_loop(GlobalHeap* heap, unsigned int seed, size_t nops, 
+                     size_t min_size, size_t max_size, size_t window, 
+                     BenchResult* result)
+{
+    std::vector<RRegion::TPtr<void> > live(window, null_ptr);
+
+    persist_counters().reset();
+    for (size_t i=0; i<nops; i++) {
+        size_t slot = i % window;
+        if (live[slot] != null_ptr) {
+            heap->free(live[slot]);
+        }
+        size_t size = min_size + rand_r(&seed) % (max_size - min_size + 1);
+        live[slot] = heap->malloc(size);
+    }
+    for (size_t slot=0; slot<window; slot++) {
+        if (live[slot] != null_ptr) {
+            heap->free(live[slot]);
+        }
+    }
+    result->nops = nops;
+    result->counters = persist_counters();
+}
+
+int run_mode(TestEnvironment* env, DurabilityMode mode, size_t batch_size, size_t heap_size, 
+             int nthreads, size_t nops, size_t min_size, size_t max_size, 
+             size_t window)
+{
+    GlobalHeap* heap;
+    std::string path = env->test_path("bench_durability");
+
+    DurabilityMode selected = set_durability_mode(mode);
+    slab_batch_size = batch_size;
+
+    env->cleanup_fs();
+    if (GlobalHeap::create(path.c_str(), heap_size, env->booksize(), &heap) != 0) {
+        std::cerr << "ERROR: Cannot create heap " << path << std::endl;
+        return -1;
+    }
+
+    std::vector<BenchResult> results(nthreads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t=0; t<nthreads; t++) {
+        threads.push_back(std::thread(alloc_free_loop, heap, t+1, nops, min_size, max_size, window, &results[t]));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    heap->close();
+    env->cleanup_fs();
+
+    size_t total_ops = 0;
+    uint64_t flushes = 0;
+    uint64_t fences = 0;
+    for (auto& r: results) {
+        total_ops += r.nops;
+        flushes += r.counters.flushes;
+        fences += r.counters.fences;
+    }
+    double secs = std::chrono::duration<double>(end - start).count();
+
+    std::string name = durability_mode_to_string(mode);
+    if (selected != mode) {
+        name += std::string("(") + durability_mode_to_string(selected) + ")";
+    }
+    std::cout << std::left << std::setw(24) << name << std::right
+              << std::setw(8) << batch_size
+              << std::setw(14) << std::fixed << std::setprecision(0) << total_ops / secs
+              << std::setw(14) << std::setprecision(3) << double(flushes) / total_ops
+              << std::setw(14) << double(fences) / total_ops
+              << std::endl;
+    return 0;
+}
+
+int usage(std::string progname, boost::program_options::options_description desc, int rc = 0)
+{
+    std::cerr << "Usage: " << progname << " [options]" << std::endl 
+              << desc << std::endl;
+    return rc; 
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options; 
+    std::string progname = PROGNAME;
+    po::options_description desc("Options"); 
+
+    try {
+        desc.add_options() 
+            ("help", "Print help messages") 
+            ("test_dir", po::value<std::string>()->default_value("/dev/shm/nvm"), "Directory where to create the heap")
+            ("modes", po::value<std::string>()->default_value("none,clflush,clflushopt,clwb,msync"), "Comma separated list of durability modes to run")
+            ("batch_sizes", po::value<std::string>()->default_value("1,32"), "Comma separated list of slab bitmap batch sizes to run")
+            ("heap_size", po::value<std::string>()->default_value("64M"), "Heap size")
+            ("threads", po::value<int>()->default_value(1), "Number of allocating threads")
+            ("nops", po::value<size_t>()->default_value(200000), "Allocations per thread")
+            ("min_size", po::value<size_t>()->default_value(8), "Minimum allocation size")
+            ("max_size", po::value<size_t>()->default_value(4096), "Maximum allocation size")
+            ("window", po::value<size_t>()->default_value(1024), "Live allocations per thread");
+
+        po::variables_map vm; 
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) { 
+            return usage(progname, desc);
+        } 
+        po::notify(vm);
+
+        TestOptions test_options;
+        test_options.test_dir = vm["test_dir"].as<std::string>();
+        TestEnvironment* env = new TestEnvironment(test_options);
+        env->SetUp();
+
+        std::vector<std::string> modes;
+        boost::split(modes, vm["modes"].as<std::string>(), boost::is_any_of(","));
+        std::vector<std::string> batch_sizes;
+        boost::split(batch_sizes, vm["batch_sizes"].as<std::string>(), boost::is_any_of(","));
+
+        std::cout << std::left << std::setw(24) << "mode" << std::right
+                  << std::setw(8) << "batch"
+                  << std::setw(14) << "ops/s" 
+                  << std::setw(14) << "flushes/op" 
+                  << std::setw(14) << "fences/op" << std::endl;
+        for (auto& m: modes) {
+            DurabilityMode mode;
+            if (durability_mode_from_string(m, &mode) != 0) {
+                std::cerr << "ERROR: Unknown durability mode " << m << std::endl;
+                return -1;
+            }
+            for (auto& b: batch_sizes) {
+                if (run_mode(env, mode, std::stoul(b), 
+                             string_to_size(vm["heap_size"].as<std::string>()), 
+                             vm["threads"].as<int>(), vm["nops"].as<size_t>(), 
+                             vm["min_size"].as<size_t>(), vm["max_size"].as<size_t>(),
+                             vm["window"].as<size_t>()) != 0) 
+                {
+                    return -1;
+                }
+            }
+        }
+    }
+    catch(po::error& e) { 
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl; 
+        return usage(progname, desc, -1);
+    } 
+    return 0;
+}
@@ -0,0 +1,444 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file bench_globalheap.cc
+ *
+ * @brief Allocator microbenchmarks: throughput and malloc/free latency
+ * percentiles of the global heap for every combination of thread count,
+ * block size distribution and allocation ratio.
+ *
+ * @details
+ * Each thread first populates the heap with a low watermark of live
+ * blocks and then performs a random sequence of mallocs and frees,
+ * staying between the low and high watermark, as in the stress test.
+ * Every malloc and free is timed individually. Results are printed as a
+ * table and optionally written as JSON for regression tracking. With
+ * --lock-profile the allocator lock profile of the measured interval is
+ * reported along with each result. With --maintenance every heap runs a 
+ * background maintenance thread, whose effect shows in the tail latencies.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include "alps/globalheap/globalheap.hh"
+
+#include "common/maintenance.hh"
+
+#include "globalheap/test_workload.hh"
+#include "test_common.hh"
+
+using namespace alps;
+
+#define PROGNAME argv[0]
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig {
+    int         nthreads;
+    std::string dist_name;
+    int         perc_alloc;
+};
+
+struct ThreadResult {
+    std::vector<uint64_t> malloc_ns;
+    std::vector<uint64_t> free_ns;
+    size_t                failed_mallocs;
+};
+
+struct LatencySummary {
+    size_t   count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+
+    // sorts the latencies in place
+    void compute(std::vector<uint64_t>* ns)
+    {
+        count = ns->size();
+        p50 = p99 = p999 = 0;
+        if (count == 0) {
+            return;
+        }
+        std::sort(ns->begin(), ns->end());
+        p50 = percentile(*ns, 0.5);
+        p99 = percentile(*ns, 0.99);
+        p999 = percentile(*ns, 0.999);
+    }
+
+    static uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+    {
+        size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[idx];
+    }
+
+    void stream_json(std::ostream& os) const {
+        os << "{\"count\": " << count;
+        os << ", \"p50_ns\": " << p50;
+        os << ", \"p99_ns\": " << p99;
+        os << ", \"p999_ns\": " << p999 << "}";
+    }
+};
+
+struct BenchResult {
+    BenchConfig    config;
+    double         secs;
+    size_t         failed_mallocs;
+    LatencySummary malloc_lat;
+    LatencySummary free_lat;
+    LockProfile    lock_profile;
+
+    double ops_per_sec() const
+    {
+        return (malloc_lat.count + free_lat.count) / secs;
+    }
+
+    void stream_json(std::ostream& os) const {
+        os << "{\"threads\": " << config.nthreads;
+        os << ", \"distribution\": \"" << config.dist_name << "\"";
+        os << ", \"perc_alloc\": " << config.perc_alloc;
+        os << ", \"secs\": " << secs;
+        os << ", \"ops_per_sec\": " << ops_per_sec();
+        os << ", \"failed_mallocs\": " << failed_mallocs;
+        os << ", \"malloc\": ";
+        malloc_lat.stream_json(os);
+        os << ", \"free\": ";
+        free_lat.stream_json(os);
+        if (lock_profile.enabled) {
+            os << ", \"locks\": ";
+            lock_profile.stream_json(os);
+        }
+        os << "}";
+    }
+};
+
+static uint64_t elapsed_ns(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+static RRegion::TPtr<void> timed_malloc(GlobalHeap* heap, size_t size, ThreadResult* result)
+{
+    Clock::time_point start = Clock::now();
+    RRegion::TPtr<void> ptr = heap->malloc(size);
+    Clock::time_point end = Clock::now();
+    if (ptr == null_ptr) {
+        result->failed_mallocs++;
+    } else {
+        result->malloc_ns.push_back(elapsed_ns(start, end));
+    }
+    return ptr;
+}
+
+static void timed_free(GlobalHeap* heap, RRegion::TPtr<void> ptr, ThreadResult* result)
+{
+    Clock::time_point start = Clock::now();
+    heap->free(ptr);
+    Clock::time_point end = Clock::now();
+    result->free_ns.push_back(elapsed_ns(start, end));
+}
+
+void random_alloc_free(GlobalHeap* heap,
+                       UniformDistribution* block_dist,
+                       unsigned int seed,
+                       size_t low_watermark,
+                       size_t high_watermark,
+                       size_t nops,
+                       int perc_alloc,
+                       boost::barrier* start_barrier,
+                       boost::barrier* end_barrier,
+                       ThreadResult* result)
+{
+    LiveBlocks live_blocks;
+    unsigned int opseed = seed;
+
+    result->failed_mallocs = 0;
+    result->malloc_ns.reserve(nops);
+    result->free_ns.reserve(nops);
+
+    // populate the heap up to the low watermark outside the measured interval
+    for (size_t i=0; i < low_watermark; i++) {
+        size_t block_size = block_dist->random(&seed);
+        RRegion::TPtr<void> ptr = heap->malloc(block_size);
+        if (ptr != null_ptr) {
+            live_blocks.insert_block((uint64_t) ptr.get(), block_size);
+        }
+    }
+
+    start_barrier->wait();
+    for (size_t i=0; i < nops; i++) {
+        bool do_alloc;
+        if (live_blocks.size() == 0) {
+            do_alloc = true;
+        } else if (live_blocks.size() >= high_watermark) {
+            do_alloc = false;
+        } else {
+            do_alloc = int(rand_r(&opseed) % 100) < perc_alloc;
+        }
+
+        if (do_alloc) {
+            size_t block_size = block_dist->random(&seed);
+            RRegion::TPtr<void> ptr = timed_malloc(heap, block_size, result);
+            if (ptr != null_ptr) {
+                live_blocks.insert_block((uint64_t) ptr.get(), block_size);
+            }
+        } else {
+            uint64_t vaddr = live_blocks.pick_block_random(&seed);
+            live_blocks.remove_block(vaddr);
+            timed_free(heap, RRegion::TPtr<void>((void*) vaddr), result);
+        }
+    }
+    end_barrier->wait();
+
+    while (live_blocks.size() > 0) {
+        uint64_t vaddr = live_blocks.pick_block_random(&seed);
+        live_blocks.remove_block(vaddr);
+        heap->free(RRegion::TPtr<void>((void*) vaddr));
+    }
+}
+
+int run_config(TestEnvironment* env, const BenchConfig& config, UniformDistribution* block_dist,
+               size_t heap_size, size_t nops, size_t low_watermark, size_t high_watermark,
+               BenchResult* bench_result)
+{
+    GlobalHeap* heap;
+    std::string path = env->test_path("bench_globalheap");
+
+    env->cleanup_fs();
+    if (GlobalHeap::create(path.c_str(), heap_size, env->booksize(), &heap) != 0) {
+        std::cerr << "ERROR: Cannot create heap " << path << std::endl;
+        return -1;
+    }
+
+    // the extra participant is this thread, which times the run between the barriers
+    boost::barrier start_barrier(config.nthreads + 1);
+    boost::barrier end_barrier(config.nthreads + 1);
+    std::vector<ThreadResult> results(config.nthreads);
+    std::vector<std::thread> threads;
+    for (int t=0; t<config.nthreads; t++) {
+        threads.push_back(std::thread(random_alloc_free, heap, block_dist, t+1,
+                                      low_watermark, high_watermark, nops, config.perc_alloc,
+                                      &start_barrier, &end_barrier, &results[t]));
+    }
+    start_barrier.wait();
+    reset_lock_profile();
+    Clock::time_point start = Clock::now();
+    end_barrier.wait();
+    Clock::time_point end = Clock::now();
+    get_lock_profile(&bench_result->lock_profile);
+    for (auto& t: threads) {
+        t.join();
+    }
+    heap->close();
+    env->cleanup_fs();
+
+    std::vector<uint64_t> malloc_ns;
+    std::vector<uint64_t> free_ns;
+    bench_result->config = config;
+    bench_result->failed_mallocs = 0;
+    for (auto& r: results) {
+        malloc_ns.insert(malloc_ns.end(), r.malloc_ns.begin(), r.malloc_ns.end());
+        free_ns.insert(free_ns.end(), r.free_ns.begin(), r.free_ns.end());
+        bench_result->failed_mallocs += r.failed_mallocs;
+    }
+    bench_result->secs = std::chrono::duration<double>(end - start).count();
+    bench_result->malloc_lat.compute(&malloc_ns);
+    bench_result->free_lat.compute(&free_ns);
+    return 0;
+}
+
+void stream_header(std::ostream& os)
+{
+    os << std::left << std::setw(24) << "distribution" << std::right
+       << std::setw(8) << "threads"
+       << std::setw(8) << "alloc%"
+       << std::setw(14) << "ops/s"
+       << std::setw(12) << "malloc p50"
+       << std::setw(12) << "p99"
+       << std::setw(12) << "p999"
+       << std::setw(12) << "free p50"
+       << std::setw(12) << "p99"
+       << std::setw(12) << "p999"
+       << std::setw(10) << "failed" << std::endl;
+}
+
+void stream_result(std::ostream& os, const BenchResult& r)
+{
+    os << std::left << std::setw(24) << r.config.dist_name << std::right
+       << std::setw(8) << r.config.nthreads
+       << std::setw(8) << r.config.perc_alloc
+       << std::setw(14) << std::fixed << std::setprecision(0) << r.ops_per_sec()
+       << std::setw(12) << r.malloc_lat.p50
+       << std::setw(12) << r.malloc_lat.p99
+       << std::setw(12) << r.malloc_lat.p999
+       << std::setw(12) << r.free_lat.p50
+       << std::setw(12) << r.free_lat.p99
+       << std::setw(12) << r.free_lat.p999
+       << std::setw(10) << r.failed_mallocs << std::endl;
+}
+
+int write_json(const std::string& filename, const std::vector<BenchResult>& results,
+               size_t heap_size, size_t nops, size_t low_watermark, size_t high_watermark)
+{
+    std::ofstream ofs(filename.c_str());
+    if (!ofs) {
+        std::cerr << "ERROR: Cannot write results to " << filename << std::endl;
+        return -1;
+    }
+    ofs << "{\"benchmark\": \"globalheap\"";
+    ofs << ", \"heap_size\": " << heap_size;
+    ofs << ", \"nops\": " << nops;
+    ofs << ", \"low_watermark\": " << low_watermark;
+    ofs << ", \"high_watermark\": " << high_watermark;
+    ofs << ", \"results\": [";
+    for (size_t i=0; i<results.size(); i++) {
+        ofs << (i == 0 ? "\n  " : ",\n  ");
+        results[i].stream_json(ofs);
+    }
+    ofs << "\n]}" << std::endl;
+    return 0;
+}
+
+int usage(std::string progname, boost::program_options::options_description desc, int rc = 0)
+{
+    std::cerr << "Usage: " << progname << " [options]" << std::endl
+              << desc << std::endl;
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    std::string progname = PROGNAME;
+    po::options_description desc("Options");
+
+    try {
+        desc.add_options()
+            ("help", "Print help messages")
+            ("test_dir", po::value<std::string>()->default_value("/dev/shm/nvm"), "Directory where to create the heap")
+            ("heap_size", po::value<std::string>()->default_value("1G"), "Heap size")
+            ("threads", po::value<std::string>()->default_value("1,2,4"), "Comma separated list of thread counts to run")
+            ("dists", po::value<std::string>()->default_value("64,8-4096:8,64K-512K"), "Comma separated list of block size distributions: SIZE, MIN-MAX or MIN-MAX:INCR")
+            ("perc_alloc", po::value<std::string>()->default_value("50,70"), "Comma separated list of percentages of operations that are mallocs")
+            ("nops", po::value<size_t>()->default_value(100000), "Operations per thread")
+            ("low_watermark", po::value<size_t>()->default_value(64), "Live blocks per thread before measuring")
+            ("high_watermark", po::value<size_t>()->default_value(256), "Maximum live blocks per thread")
+            ("json", po::value<std::string>(), "Write results as JSON to this file")
+            ("lock-profile", "Profile the allocator locks and report them with each result")
+            ("maintenance", "Run a background maintenance thread per heap");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            return usage(progname, desc);
+        }
+        po::notify(vm);
+
+        size_t heap_size = string_to_size(vm["heap_size"].as<std::string>());
+        size_t nops = vm["nops"].as<size_t>();
+        size_t low_watermark = vm["low_watermark"].as<size_t>();
+        size_t high_watermark = vm["high_watermark"].as<size_t>();
+        if (high_watermark <= low_watermark) {
+            std::cerr << "ERROR: high_watermark must be larger than low_watermark" << std::endl;
+            return -1;
+        }
+
+        std::vector<int> thread_counts;
+        std::vector<int> perc_allocs;
+        if (parse_list(vm["threads"].as<std::string>(), &thread_counts) != 0 ||
+            parse_list(vm["perc_alloc"].as<std::string>(), &perc_allocs) != 0)
+        {
+            std::cerr << "ERROR: Invalid list of thread counts or allocation percentages" << std::endl;
+            return -1;
+        }
+        std::vector<std::string> dist_names;
+        boost::split(dist_names, vm["dists"].as<std::string>(), boost::is_any_of(","));
+        std::vector<UniformDistribution*> dists;
+        for (auto& name: dist_names) {
+            UniformDistribution* dist = parse_distribution(name);
+            if (!dist) {
+                std::cerr << "ERROR: Invalid block size distribution " << name << std::endl;
+                return -1;
+            }
+            dists.push_back(dist);
+        }
+
+        TestOptions test_options;
+        test_options.test_dir = vm["test_dir"].as<std::string>();
+        TestEnvironment* env = new TestEnvironment(test_options);
+        env->SetUp();
+
+        set_lock_profile(vm.count("lock-profile") > 0);
+        heap_maintenance = vm.count("maintenance") > 0;
+
+        std::vector<BenchResult> results;
+        stream_header(std::cout);
+        for (size_t d=0; d<dists.size(); d++) {
+            for (auto nthreads: thread_counts) {
+                for (auto perc_alloc: perc_allocs) {
+                    BenchConfig config = {nthreads, dist_names[d], perc_alloc};
+                    BenchResult result;
+                    if (run_config(env, config, dists[d], heap_size, nops,
+                                   low_watermark, high_watermark, &result) != 0)
+                    {
+                        return -1;
+                    }
+                    if (result.lock_profile.enabled && !results.empty()) {
+                        std::cout << std::endl;
+                        stream_header(std::cout);
+                    }
+                    stream_result(std::cout, result);
+                    if (result.lock_profile.enabled) {
+                        std::cout << result.lock_profile;
+                    }
+                    results.push_back(result);
+                }
+            }
+        }
+
+        if (vm.count("json")) {
+            if (write_json(vm["json"].as<std::string>(), results, heap_size, nops,
+                           low_watermark, high_watermark) != 0)
+            {
+                return -1;
+            }
+        }
+        for (auto dist: dists) {
+            delete dist;
+        }
+    }
+    catch(po::error& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    catch(std::invalid_argument& e) {
+        std::cerr << "ERROR: Invalid number: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    return 0;
+}
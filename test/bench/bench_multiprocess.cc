@@ -0,0 +1,430 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file bench_multiprocess.cc
+ *
+ * @brief Allocation throughput and zone leasing behavior of a global heap
+ * shared by several worker processes.
+ *
+ * @details
+ * The heap is created by the parent and opened by each of the forked
+ * workers, so that every worker runs under its own generation and leases
+ * its own zones, as in a deployment where several processes share a heap.
+ * Workers start and stop on a process-shared barrier. For each allocation
+ * mix the harness reports per-process and aggregate throughput, the zones
+ * each process acquired, the number of and time spent in zone searches
+ * (ZoneHeap::acquire_new_zone) and zone leases lost to other processes.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include "alps/globalheap/globalheap.hh"
+
+#include "globalheap/test_workload.hh"
+#include "test_common.hh"
+
+using namespace alps;
+
+#define PROGNAME argv[0]
+
+/**
+ * @brief Result of a worker process, written by the worker into memory
+ * shared with the parent
+ */
+struct WorkerResult {
+    int64_t  pid;
+    int64_t  status;
+    uint64_t nops;
+    uint64_t failed_mallocs;
+    double   secs;
+    uint64_t zone_acquisitions;
+    uint64_t zone_searches;
+    uint64_t zone_search_ns;
+    uint64_t lease_conflicts;
+    uint64_t lock_contentions;
+    uint64_t lock_wait_ns;
+
+    WorkerResult& operator+=(const WorkerResult& other)
+    {
+        nops += other.nops;
+        failed_mallocs += other.failed_mallocs;
+        zone_acquisitions += other.zone_acquisitions;
+        zone_searches += other.zone_searches;
+        zone_search_ns += other.zone_search_ns;
+        lease_conflicts += other.lease_conflicts;
+        lock_contentions += other.lock_contentions;
+        lock_wait_ns += other.lock_wait_ns;
+        return *this;
+    }
+};
+
+/**
+ * @brief State shared between the parent and the workers through an
+ * anonymous shared mapping created before forking
+ */
+struct SharedState {
+    static SharedState* create(int nprocs);
+    static void destroy(SharedState* state);
+
+    WorkerResult* result(int i)
+    {
+        return reinterpret_cast<WorkerResult*>(this + 1) + i;
+    }
+
+    int               nprocs;
+    pthread_barrier_t start_barrier; // nprocs workers plus the parent
+    pthread_barrier_t end_barrier;
+};
+
+SharedState* SharedState::create(int nprocs)
+{
+    size_t size = sizeof(SharedState) + nprocs * sizeof(WorkerResult);
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    memset(addr, 0, size);
+    SharedState* state = reinterpret_cast<SharedState*>(addr);
+    state->nprocs = nprocs;
+
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&state->start_barrier, &attr, nprocs + 1);
+    pthread_barrier_init(&state->end_barrier, &attr, nprocs + 1);
+    pthread_barrierattr_destroy(&attr);
+    return state;
+}
+
+void SharedState::destroy(SharedState* state)
+{
+    pthread_barrier_destroy(&state->start_barrier);
+    pthread_barrier_destroy(&state->end_barrier);
+    munmap(state, sizeof(SharedState) + state->nprocs * sizeof(WorkerResult));
+}
+
+struct LoopResult {
+    size_t nops;
+    size_t failed_mallocs;
+};
+
+void alloc_free_loop(GlobalHeap* heap, UniformDistribution* block_dist, unsigned int seed,
+                     size_t low_watermark, size_t high_watermark, size_t nops,
+                     int perc_alloc, LoopResult* result)
+{
+    LiveBlocks live_blocks;
+    unsigned int opseed = seed;
+
+    result->failed_mallocs = 0;
+    for (size_t i=0; i < nops; i++) {
+        bool do_alloc;
+        if (live_blocks.size() < low_watermark) {
+            do_alloc = true;
+        } else if (live_blocks.size() >= high_watermark) {
+            do_alloc = false;
+        } else {
+            do_alloc = int(rand_r(&opseed) % 100) < perc_alloc;
+        }
+
+        if (do_alloc) {
+            size_t block_size = block_dist->random(&seed);
+            RRegion::TPtr<void> ptr = heap->malloc(block_size);
+            if (ptr != null_ptr) {
+                live_blocks.insert_block((uint64_t) ptr.get(), block_size);
+            } else {
+                result->failed_mallocs++;
+            }
+        } else {
+            uint64_t vaddr = live_blocks.pick_block_random(&seed);
+            live_blocks.remove_block(vaddr);
+            heap->free(RRegion::TPtr<void>((void*) vaddr));
+        }
+    }
+    result->nops = nops;
+
+    while (live_blocks.size() > 0) {
+        uint64_t vaddr = live_blocks.pick_block_random(&seed);
+        live_blocks.remove_block(vaddr);
+        heap->free(RRegion::TPtr<void>((void*) vaddr));
+    }
+}
+
+/**
+ * @brief Body of a worker process
+ *
+ * @details
+ * The worker always takes part in both barriers, even when it cannot open
+ * the heap, so that a failing worker does not leave the others waiting.
+ */
+void run_worker(const std::string& path, int rank, int nthreads, UniformDistribution* block_dist,
+                int perc_alloc, size_t nops, size_t low_watermark, size_t high_watermark,
+                SharedState* state)
+{
+    WorkerResult* result = state->result(rank);
+    result->pid = getpid();
+
+    GlobalHeap* heap = NULL;
+    if (GlobalHeap::open(path.c_str(), &heap) != 0) {
+        result->status = -1;
+        heap = NULL;
+    }
+
+    pthread_barrier_wait(&state->start_barrier);
+    if (heap) {
+        std::vector<LoopResult> loop_results(nthreads);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int t=0; t<nthreads; t++) {
+            unsigned int seed = rank * nthreads + t + 1;
+            threads.push_back(std::thread(alloc_free_loop, heap, block_dist, seed,
+                                          low_watermark, high_watermark, nops, perc_alloc,
+                                          &loop_results[t]));
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        result->secs = std::chrono::duration<double>(end - start).count();
+        for (auto& r: loop_results) {
+            result->nops += r.nops;
+            result->failed_mallocs += r.failed_mallocs;
+        }
+    }
+    pthread_barrier_wait(&state->end_barrier);
+
+    if (heap) {
+        HeapStats stats = heap->stats();
+        result->zone_acquisitions = stats.zone_acquisitions;
+        result->zone_searches = stats.zone_searches;
+        result->zone_search_ns = stats.zone_search_ns;
+        result->lease_conflicts = stats.lease_conflicts;
+        result->lock_contentions = stats.lock_contentions;
+        result->lock_wait_ns = stats.lock_wait_ns;
+        heap->close();
+    }
+}
+
+void stream_header(std::ostream& os)
+{
+    os << std::left << std::setw(12) << "process" << std::right
+       << std::setw(12) << "ops"
+       << std::setw(14) << "ops/s"
+       << std::setw(10) << "zones"
+       << std::setw(10) << "searches"
+       << std::setw(12) << "search ms"
+       << std::setw(12) << "conflicts"
+       << std::setw(12) << "lock waits"
+       << std::setw(12) << "lock ms"
+       << std::setw(10) << "failed" << std::endl;
+}
+
+void stream_result(std::ostream& os, const std::string& name, const WorkerResult& r, double secs)
+{
+    os << std::left << std::setw(12) << name << std::right
+       << std::setw(12) << r.nops
+       << std::setw(14) << std::fixed << std::setprecision(0) << (secs > 0 ? r.nops / secs : 0)
+       << std::setw(10) << r.zone_acquisitions
+       << std::setw(10) << r.zone_searches
+       << std::setw(12) << std::setprecision(3) << r.zone_search_ns / 1e6
+       << std::setw(12) << r.lease_conflicts
+       << std::setw(12) << r.lock_contentions
+       << std::setw(12) << r.lock_wait_ns / 1e6
+       << std::setw(10) << r.failed_mallocs << std::endl;
+}
+
+int run_mix(TestEnvironment* env, int nprocs, int nthreads, const std::string& dist_name,
+            UniformDistribution* block_dist, int perc_alloc, size_t heap_size, size_t nops,
+            size_t low_watermark, size_t high_watermark)
+{
+    GlobalHeap* heap;
+    std::string path = env->test_path("bench_multiprocess");
+
+    // the parent only creates the heap; all allocations come from the workers
+    env->cleanup_fs();
+    if (GlobalHeap::create(path.c_str(), heap_size, env->booksize(), &heap) != 0) {
+        std::cerr << "ERROR: Cannot create heap " << path << std::endl;
+        return -1;
+    }
+    heap->close();
+
+    SharedState* state = SharedState::create(nprocs);
+    if (!state) {
+        std::cerr << "ERROR: Cannot map shared state" << std::endl;
+        return -1;
+    }
+
+    std::vector<pid_t> pids;
+    for (int i=0; i<nprocs; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            // cannot continue without all the barrier participants
+            std::cerr << "ERROR: Cannot fork worker process" << std::endl;
+            abort();
+        }
+        if (pid == 0) {
+            run_worker(path, i, nthreads, block_dist, perc_alloc, nops,
+                       low_watermark, high_watermark, state);
+            _exit(state->result(i)->status == 0 ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+
+    pthread_barrier_wait(&state->start_barrier);
+    auto start = std::chrono::steady_clock::now();
+    pthread_barrier_wait(&state->end_barrier);
+    auto end = std::chrono::steady_clock::now();
+
+    int rc = 0;
+    for (auto pid: pids) {
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            rc = -1;
+        }
+    }
+
+    std::cout << std::endl << "distribution: " << dist_name
+              << ", alloc%: " << perc_alloc
+              << ", processes: " << nprocs
+              << ", threads/process: " << nthreads << std::endl;
+    stream_header(std::cout);
+    WorkerResult total;
+    memset(&total, 0, sizeof(total));
+    for (int i=0; i<nprocs; i++) {
+        WorkerResult* r = state->result(i);
+        if (r->status != 0) {
+            std::cerr << "ERROR: Worker " << r->pid << " cannot open heap " << path << std::endl;
+            continue;
+        }
+        stream_result(std::cout, std::to_string(r->pid), *r, r->secs);
+        total += *r;
+    }
+    stream_result(std::cout, "aggregate", total, std::chrono::duration<double>(end - start).count());
+
+    SharedState::destroy(state);
+    env->cleanup_fs();
+    return rc;
+}
+
+int usage(std::string progname, boost::program_options::options_description desc, int rc = 0)
+{
+    std::cerr << "Usage: " << progname << " [options]" << std::endl
+              << desc << std::endl;
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    std::string progname = PROGNAME;
+    po::options_description desc("Options");
+
+    try {
+        desc.add_options()
+            ("help", "Print help messages")
+            ("test_dir", po::value<std::string>()->default_value("/dev/shm/nvm"), "Directory where to create the heap")
+            ("heap_size", po::value<std::string>()->default_value("1G"), "Heap size")
+            ("procs", po::value<int>()->default_value(4), "Number of worker processes")
+            ("threads", po::value<int>()->default_value(1), "Number of allocating threads per worker process")
+            ("dists", po::value<std::string>()->default_value("64,8-4096:8,64K-512K"), "Comma separated list of block size distributions: SIZE, MIN-MAX or MIN-MAX:INCR")
+            ("perc_alloc", po::value<std::string>()->default_value("50"), "Comma separated list of percentages of operations that are mallocs")
+            ("nops", po::value<size_t>()->default_value(100000), "Operations per thread")
+            ("low_watermark", po::value<size_t>()->default_value(64), "Minimum live blocks per thread")
+            ("high_watermark", po::value<size_t>()->default_value(256), "Maximum live blocks per thread");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            return usage(progname, desc);
+        }
+        po::notify(vm);
+
+        int nprocs = vm["procs"].as<int>();
+        int nthreads = vm["threads"].as<int>();
+        if (nprocs <= 0 || nthreads <= 0) {
+            std::cerr << "ERROR: procs and threads must be positive" << std::endl;
+            return -1;
+        }
+        size_t low_watermark = vm["low_watermark"].as<size_t>();
+        size_t high_watermark = vm["high_watermark"].as<size_t>();
+        if (high_watermark <= low_watermark) {
+            std::cerr << "ERROR: high_watermark must be larger than low_watermark" << std::endl;
+            return -1;
+        }
+        std::vector<int> perc_allocs;
+        if (parse_list(vm["perc_alloc"].as<std::string>(), &perc_allocs) != 0) {
+            std::cerr << "ERROR: Invalid list of allocation percentages" << std::endl;
+            return -1;
+        }
+        std::vector<std::string> dist_names;
+        boost::split(dist_names, vm["dists"].as<std::string>(), boost::is_any_of(","));
+        std::vector<UniformDistribution*> dists;
+        for (auto& name: dist_names) {
+            UniformDistribution* dist = parse_distribution(name);
+            if (!dist) {
+                std::cerr << "ERROR: Invalid block size distribution " << name << std::endl;
+                return -1;
+            }
+            dists.push_back(dist);
+        }
+
+        TestOptions test_options;
+        test_options.test_dir = vm["test_dir"].as<std::string>();
+        TestEnvironment* env = new TestEnvironment(test_options);
+        env->SetUp();
+
+        int rc = 0;
+        for (size_t d=0; d<dists.size(); d++) {
+            for (auto perc_alloc: perc_allocs) {
+                if (run_mix(env, nprocs, nthreads, dist_names[d], dists[d], perc_alloc,
+                            string_to_size(vm["heap_size"].as<std::string>()),
+                            vm["nops"].as<size_t>(), low_watermark, high_watermark) != 0)
+                {
+                    rc = -1;
+                }
+            }
+        }
+        for (auto dist: dists) {
+            delete dist;
+        }
+        return rc;
+    }
+    catch(po::error& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    catch(std::invalid_argument& e) {
+        std::cerr << "ERROR: Invalid number: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    return 0;
+}
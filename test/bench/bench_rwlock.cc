@@ -0,0 +1,268 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file bench_rwlock.cc
+ *
+ * @brief Read-mostly scaling of the allocator reader-writer lock.
+ *
+ * @details
+ * Every thread repeatedly takes the lock, in read mode except for the
+ * given percentage of write operations, and reads (or updates) a small
+ * shared table inside the critical section, which is about as much work
+ * as a memory attribute or zone lookup. The ReaderWriterLock is compared
+ * against the striped mutex it replaced and against pthread_rwlock.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include "globalheap/rwlock.hh"
+#include "globalheap/test_workload.hh"
+
+using namespace alps;
+
+#define PROGNAME argv[0]
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief The previous ReaderWriterLock: a reader takes one of 8 mutexes
+ * picked by thread, a writer takes all of them
+ */
+class StripedMutexLock {
+public:
+    static const int kStripes = 8;
+
+    StripedMutexLock()
+    {
+        for (int i=0; i<kStripes; i++) {
+            pthread_mutex_init(&mutex_[i], NULL);
+        }
+    }
+
+    void lock_read() { pthread_mutex_lock(&mutex_[pthread_self() % kStripes]); }
+    void unlock_read() { pthread_mutex_unlock(&mutex_[pthread_self() % kStripes]); }
+
+    void lock_write()
+    {
+        for (int i=0; i<kStripes; i++) {
+            pthread_mutex_lock(&mutex_[i]);
+        }
+    }
+
+    void unlock_write()
+    {
+        for (int i=0; i<kStripes; i++) {
+            pthread_mutex_unlock(&mutex_[i]);
+        }
+    }
+
+private:
+    pthread_mutex_t mutex_[kStripes];
+};
+
+class PthreadRWLock {
+public:
+    PthreadRWLock()
+    {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init(&rwlock_, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+
+    void lock_read() { pthread_rwlock_rdlock(&rwlock_); }
+    void unlock_read() { pthread_rwlock_unlock(&rwlock_); }
+    void lock_write() { pthread_rwlock_wrlock(&rwlock_); }
+    void unlock_write() { pthread_rwlock_unlock(&rwlock_); }
+
+private:
+    pthread_rwlock_t rwlock_;
+};
+
+struct SharedTable {
+    static const int kEntries = 16;
+    uint64_t entries[kEntries];
+};
+
+template<typename LockT>
+LockT* make_lock()
+{
+    return new LockT;
+}
+
+template<>
+ReaderWriterLock* make_lock<ReaderWriterLock>()
+{
+    return new ReaderWriterLock(kLockSiteZoneHeapRead, kLockSiteZoneHeapWrite);
+}
+
+template<typename LockT>
+void run_thread(LockT* lock, SharedTable* table, unsigned int seed, size_t nops, int perc_write,
+                boost::barrier* start_barrier, Clock::time_point* start, Clock::time_point* end,
+                uint64_t* checksum)
+{
+    uint64_t sum = 0;
+    start_barrier->wait();
+    *start = Clock::now();
+    for (size_t i = 0; i < nops; i++) {
+        int entry = rand_r(&seed) % SharedTable::kEntries;
+        if (perc_write > 0 && int(rand_r(&seed) % 100) < perc_write) {
+            lock->lock_write();
+            table->entries[entry]++;
+            lock->unlock_write();
+        } else {
+            lock->lock_read();
+            sum += table->entries[entry];
+            lock->unlock_read();
+        }
+    }
+    *end = Clock::now();
+    *checksum = sum;
+}
+
+template<typename LockT>
+double run_config(int nthreads, size_t nops, int perc_write)
+{
+    LockT* lock = make_lock<LockT>();
+    SharedTable table = {};
+    boost::barrier start_barrier(nthreads);
+    std::vector<Clock::time_point> starts(nthreads);
+    std::vector<Clock::time_point> ends(nthreads);
+    std::vector<uint64_t> checksums(nthreads);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < nthreads; t++) {
+        threads.push_back(std::thread(run_thread<LockT>, lock, &table, t+1, nops, perc_write,
+                                      &start_barrier, &starts[t], &ends[t], &checksums[t]));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    // threads may be descheduled around the barrier, so time the run from 
+    // the first thread to start to the last one to finish
+    Clock::time_point start = *std::min_element(starts.begin(), starts.end());
+    Clock::time_point end = *std::max_element(ends.begin(), ends.end());
+    delete lock;
+    return nthreads * nops / std::chrono::duration<double>(end - start).count();
+}
+
+double run_lock(const std::string& lock, int nthreads, size_t nops, int perc_write)
+{
+    if (lock == "rwlock") {
+        return run_config<ReaderWriterLock>(nthreads, nops, perc_write);
+    } else if (lock == "striped") {
+        return run_config<StripedMutexLock>(nthreads, nops, perc_write);
+    }
+    return run_config<PthreadRWLock>(nthreads, nops, perc_write);
+}
+
+int usage(std::string progname, boost::program_options::options_description desc, int rc = 0)
+{
+    std::cerr << "Usage: " << progname << " [options]" << std::endl
+              << desc << std::endl;
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    std::string progname = PROGNAME;
+    po::options_description desc("Options");
+
+    try {
+        desc.add_options()
+            ("help", "Print help messages")
+            ("locks", po::value<std::string>()->default_value("rwlock,striped,pthread"), "Comma separated list of locks: rwlock, striped or pthread")
+            ("threads", po::value<std::string>()->default_value("1,2,4,8,16,32,64,128"), "Comma separated list of thread counts to run")
+            ("perc_write", po::value<std::string>()->default_value("0,1"), "Comma separated list of percentages of operations that take the lock for writing")
+            ("nops", po::value<size_t>()->default_value(1000000), "Operations per thread");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            return usage(progname, desc);
+        }
+        po::notify(vm);
+
+        std::vector<std::string> locks;
+        boost::split(locks, vm["locks"].as<std::string>(), boost::is_any_of(","));
+        for (auto& lock: locks) {
+            if (lock != "rwlock" && lock != "striped" && lock != "pthread") {
+                std::cerr << "ERROR: Unknown lock " << lock << std::endl;
+                return -1;
+            }
+        }
+        std::vector<int> thread_counts;
+        if (parse_list(vm["threads"].as<std::string>(), &thread_counts) != 0) {
+            std::cerr << "ERROR: Invalid list of thread counts" << std::endl;
+            return -1;
+        }
+        // unlike the thread counts, a write percentage may be zero
+        std::vector<std::string> perc_write_items;
+        std::vector<int> perc_writes;
+        boost::split(perc_write_items, vm["perc_write"].as<std::string>(), boost::is_any_of(","));
+        for (auto& item: perc_write_items) {
+            int perc_write = std::stoi(item);
+            if (perc_write < 0 || perc_write > 100) {
+                std::cerr << "ERROR: Invalid write percentage " << item << std::endl;
+                return -1;
+            }
+            perc_writes.push_back(perc_write);
+        }
+        size_t nops = vm["nops"].as<size_t>();
+
+        std::cout << std::left << std::setw(10) << "lock" << std::right
+                  << std::setw(8) << "threads"
+                  << std::setw(8) << "write%"
+                  << std::setw(16) << "ops/s" << std::endl;
+        for (auto perc_write: perc_writes) {
+            for (auto& lock: locks) {
+                for (auto nthreads: thread_counts) {
+                    double ops = run_lock(lock, nthreads, nops, perc_write);
+                    std::cout << std::left << std::setw(10) << lock << std::right
+                              << std::setw(8) << nthreads
+                              << std::setw(8) << perc_write
+                              << std::setw(16) << std::fixed << std::setprecision(0) << ops << std::endl;
+                }
+            }
+        }
+    }
+    catch(po::error& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    catch(std::invalid_argument& e) {
+        std::cerr << "ERROR: Invalid number: " << e.what() << std::endl << std::endl;
+        return usage(progname, desc, -1);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file bench_slab_color.cc
+ *
+ * @brief Pointer chasing over the first blocks of many slabs, with and 
+ * without slab coloring.
+ *
+ * @details
+ * A single thread fills a fresh heap with blocks of one size class and 
+ * picks the first block of every slab, recognized as a block that does not
+ * immediately follow the previously allocated one. The picked blocks are
+ * linked into a random cycle that is then chased. Without coloring the 
+ * first blocks of all slabs sit at the same offset from a block boundary
+ * and compete for the same cache sets; coloring spreads them over as many
+ * sets as the slack of the slabs allows. Besides the chase latency the 
+ * benchmark reports over how many L1 sets (64 sets of 64-byte lines) the 
+ * picked blocks are spread.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include "alps/globalheap/globalheap.hh"
+
+#include "globalheap/nvslab.hh"
+#include "test_common.hh"
+
+using namespace alps;
+
+#define PROGNAME argv[0]
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t kL1Sets = 64;
+
+int run_coloring(TestEnvironment* env, bool coloring, size_t heap_size, size_t size, size_t nslabs, size_t nhops)
+{
+    GlobalHeap* heap;
+    std::string path = env->test_path("bench_slab_color");
+
+    slab_coloring = coloring;
+    env->cleanup_fs();
+    if (GlobalHeap::create(path.c_str(), heap_size, env->booksize(), &heap) != 0) {
+        std::cerr << "ERROR: Cannot create heap " << path << std::endl;
+        return -1;
+    }
+
+    std::vector<char*> firsts;
+    char* prev = NULL;
+    while (firsts.size() < nslabs) {
+        RRegion::TPtr<void> ptr = heap->malloc(size);
+        if (ptr == null_ptr) {
+            break;
+        }
+        char* p = static_cast<char*>(ptr.get());
+        if (prev == NULL || p - prev != static_cast<ptrdiff_t>(size)) {
+            firsts.push_back(p);
+        }
+        prev = p;
+    }
+    if (firsts.size() < 2) {
+        std::cerr << "ERROR: Heap too small for two slabs" << std::endl;
+        heap->close();
+        return -1;
+    }
+
+    std::set<size_t> sets;
+    for (size_t i=0; i<firsts.size(); i++) {
+        sets.insert((reinterpret_cast<uintptr_t>(firsts[i]) / kCacheLineSize) % kL1Sets);
+    }
+
+    // link the first blocks into a random cycle
+    std::vector<size_t> order(firsts.size());
+    for (size_t i=0; i<order.size(); i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+    for (size_t i=0; i<order.size(); i++) {
+        *reinterpret_cast<char**>(firsts[order[i]]) = firsts[order[(i+1) % order.size()]];
+    }
+
+    char* p = firsts[order[0]];
+    Clock::time_point start = Clock::now();
+    for (size_t i=0; i<nhops; i++) {
+        p = *reinterpret_cast<char* volatile*>(p);
+    }
+    Clock::time_point end = Clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+    std::cout << std::left << std::setw(10) << (coloring ? "on" : "off") << std::right
+              << std::setw(10) << firsts.size()
+              << std::setw(10) << sets.size()
+              << std::setw(12) << std::fixed << std::setprecision(2) << ns / nhops
+              << std::endl;
+
+    heap->close();
+    env->cleanup_fs();
+    return 0;
+}
+
+int usage(std::string progname, boost::program_options::options_description desc, int rc = 0)
+{
+    std::cerr << "Usage: " << progname << " [options]" << std::endl 
+              << desc << std::endl;
+    return rc; 
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options; 
+    std::string progname = PROGNAME;
+    po::options_description desc("Options"); 
+
+    try {
+        desc.add_options() 
+            ("help", "Print help messages") 
+            ("test_dir", po::value<std::string>()->default_value("/dev/shm/nvm"), "Directory where to create the heap")
+            ("coloring", po::value<std::string>()->default_value("off,on"), "Comma separated list of slab coloring settings to run: on or off")
+            ("heap_size", po::value<std::string>()->default_value("1G"), "Heap size")
+            ("size", po::value<size_t>()->default_value(1024), "Block size (should be the size of a size class)")
+            ("slabs", po::value<size_t>()->default_value(2048), "Number of slabs whose first blocks are chased")
+            ("hops", po::value<size_t>()->default_value(10000000), "Number of pointers followed");
+
+        po::variables_map vm; 
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) { 
+            return usage(progname, desc);
+        } 
+        po::notify(vm);
+
+        std::vector<std::string> settings;
+        boost::split(settings, vm["coloring"].as<std::string>(), boost::is_any_of(","));
+        for (auto& setting: settings) {
+            if (setting != "on" && setting != "off") {
+                std::cerr << "ERROR: Unknown coloring setting " << setting << std::endl;
+                return -1;
+            }
+        }
+
+        TestOptions test_options;
+        test_options.test_dir = vm["test_dir"].as<std::string>();
+        TestEnvironment* env = new TestEnvironment(test_options);
+        env->SetUp();
+
+        std::cout << std::left << std::setw(10) << "coloring" << std::right
+                  << std::setw(10) << "slabs"
+                  << std::setw(10) << "l1_sets" 
+                  << std::setw(12) << "ns/hop" << std::endl;
+        for (auto& setting: settings) {
+            if (run_coloring(env, setting == "on", string_to_size(vm["heap_size"].as<std::string>()),
+                             vm["size"].as<size_t>(), vm["slabs"].as<size_t>(), vm["hops"].as<size_t>()) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+    catch(po::error& e) { 
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl; 
+        return usage(progname, desc, -1);
+    } 
+    return 0;
+}
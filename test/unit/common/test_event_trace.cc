@@ -0,0 +1,138 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+#include <atomic>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "common/event_trace.hh"
+
+using namespace alps;
+
+// events are tagged with a per-test arg1 so that tests do not see each other's events
+static size_t count_events(uint16_t type, uint64_t tag, std::vector<Event>* matched = NULL)
+{
+    std::vector<Event> events;
+    collect_events(&events);
+    size_t n = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].type == type && events[i].arg1 == tag) {
+            if (matched) {
+                matched->push_back(events[i]);
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+TEST(EventTrace, switch)
+{
+    set_event_trace(false);
+    TRACE_EVENT(kEventMalloc, 1, 100);
+    EXPECT_EQ(0U, count_events(kEventMalloc, 100));
+
+    set_event_trace(true);
+    TRACE_EVENT(kEventMalloc, 2, 100);
+    set_event_trace(false);
+    std::vector<Event> matched;
+    EXPECT_EQ(1U, count_events(kEventMalloc, 100, &matched));
+    EXPECT_EQ(2U, matched[0].arg0);
+
+    std::stringstream ss;
+    dump_events(ss);
+    EXPECT_NE(std::string::npos, ss.str().find("malloc 2 100"));
+}
+
+TEST(EventTrace, overflow)
+{
+    set_event_trace(true);
+    for (uint64_t i = 0; i < 3 * EventRing::kEvents; i++) {
+        TRACE_EVENT(kEventFree, i, 200);
+    }
+    set_event_trace(false);
+    // the ring keeps the most recent events in order
+    std::vector<Event> matched;
+    EXPECT_EQ(EventRing::kEvents, count_events(kEventFree, 200, &matched));
+    for (size_t i = 0; i < matched.size(); i++) {
+        EXPECT_EQ(2 * EventRing::kEvents + i, matched[i].arg0);
+    }
+}
+
+TEST(EventTrace, threads)
+{
+    const int nthreads = 4;
+    const uint64_t nevents = 1000;
+    std::vector<std::thread> threads;
+
+    set_event_trace(true);
+    for (int t = 0; t < nthreads; t++) {
+        threads.push_back(std::thread([=]() {
+            for (uint64_t i = 0; i < nevents; i++) {
+                TRACE_EVENT(kEventAllocBlock, t * nevents + i, 300);
+            }
+        }));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    set_event_trace(false);
+
+    std::vector<Event> matched;
+    EXPECT_EQ(nthreads * nevents, count_events(kEventAllocBlock, 300, &matched));
+    std::set<uint32_t> tids;
+    for (size_t i = 0; i < matched.size(); i++) {
+        tids.insert(matched[i].thread);
+        if (i > 0) {
+            EXPECT_LE(matched[i-1].timestamp_ns, matched[i].timestamp_ns);
+        }
+    }
+    EXPECT_EQ(static_cast<size_t>(nthreads), tids.size());
+}
+
+TEST(EventTrace, concurrent_snapshot)
+{
+    std::atomic<bool> stop(false);
+
+    set_event_trace(true);
+    std::thread writer([&]() {
+        for (uint64_t i = 0; !stop; i++) {
+            TRACE_EVENT(kEventFreeBlock, i, 400);
+        }
+    });
+    // snapshots taken while the ring wraps hold consecutive events only
+    for (int r = 0; r < 100; r++) {
+        std::vector<Event> matched;
+        count_events(kEventFreeBlock, 400, &matched);
+        for (size_t i = 1; i < matched.size(); i++) {
+            EXPECT_EQ(matched[i-1].arg0 + 1, matched[i].arg0);
+        }
+    }
+    stop = true;
+    writer.join();
+    set_event_trace(false);
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
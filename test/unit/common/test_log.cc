@@ -0,0 +1,73 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "common/log.hh"
+
+using namespace alps;
+
+TEST(Log, async_drop_on_overflow)
+{
+    const int nthreads = 4;
+    const int nmessages = 100;
+    std::string filename = "/tmp/test_log." + std::to_string(getpid());
+
+    DebugOptions options;
+    options.log_filename = filename;
+    options.log_level = "error";
+    options.log_async = true;
+    options.log_queue_size = 16;
+    init_log(options);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++) {
+        threads.push_back(std::thread([=]() {
+            for (int i = 0; i < nmessages; i++) {
+                LOG(error) << "test_log message " << t << " " << i;
+            }
+        }));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    size_t dropped = log_messages_dropped();
+    flush_log();
+
+    // every message is either written out or counted as dropped
+    std::ifstream log(filename);
+    std::string line;
+    size_t written = 0;
+    while (std::getline(log, line)) {
+        if (line.find("test_log message") != std::string::npos) {
+            written++;
+        }
+    }
+    EXPECT_EQ(static_cast<size_t>(nthreads * nmessages), written + dropped);
+    unlink(filename.c_str());
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -97,6 +97,34 @@ TEST(BitMap, clear)
     test_clear(256);
 }
 
+void test_count(int bitmap_len)
+{
+    char buf[64];
+  
+    BitMap* bm = BitMap::make(bitmap_len, buf);
+
+    int expected = 0;
+    for (int i=0; i<bitmap_len; i+=3) {
+        bm->set(i);
+        expected++;
+    }
+    // bits past the bitmap length in the last entry must not be counted
+    for (int i=bitmap_len; i % BitMap::kEntrySize; i++) {
+        bm->set(i);
+    }
+    EXPECT_EQ(size_t(expected), bm->count(bitmap_len));
+}
+
+TEST(BitMap, count)
+{
+    test_count(4);
+    test_count(8);
+    test_count(12);
+    test_count(67);
+    test_count(256);
+    test_count(509);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
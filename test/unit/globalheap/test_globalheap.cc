@@ -15,12 +15,19 @@
  */
 
 #include <fcntl.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 #include "alps/globalheap/globalheap.hh"
 
 #include "common/os.hh"
+#include "common/persist.hh"
+#include "common/stats_export.hh"
 #include "globalheap/globalheap_internal.hh"
+#include "globalheap/maintainer.hh"
+#include "globalheap/size_class.hh"
+#include "globalheap/stats_segment.hh"
+#include "globalheap/trace.hh"
 #include "test_heap_fixture.hh"
 
 using namespace alps;
@@ -142,6 +149,178 @@ TEST_F(GlobalHeapTest, format)
 }
 
 
+TEST_F(GlobalHeapTest, size_classes)
+{
+    GlobalHeapInternal* heap;  
+    std::vector<boost::filesystem::path> paths{test_path("globalheap0")};
+    std::vector<size_t> sizes{104, 1024, 128*1024};
+
+    EXPECT_NE(0, GlobalHeapInternal::create(paths, global_heap_size, global_metazone_size, BLOCK_SIZE, std::vector<size_t>{100, 128*1024}, &heap));
+    ASSERT_EQ(0, GlobalHeapInternal::create(paths, global_heap_size, global_metazone_size, BLOCK_SIZE, sizes, &heap));
+    ASSERT_EQ(0, heap->close());
+
+    // the classes are loaded from the heap header
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_EQ(sizes, heap->size_classes().sizes());
+    RRegion::TPtr<char> p1 = static_cast<RRegion::TPtr<char> >(heap->malloc(100));
+    RRegion::TPtr<char> p2 = static_cast<RRegion::TPtr<char> >(heap->malloc(100));
+    EXPECT_NE(null_ptr, p1);
+    EXPECT_NE(null_ptr, p2);
+    EXPECT_EQ(104, p2 - p1);
+    HeapStats stats = heap->stats();
+    EXPECT_EQ(104U, stats.class_size[0]);
+    EXPECT_EQ(0U, stats.class_size[sizes.size()]);
+    ASSERT_EQ(0, heap->close());
+
+    // and survive formatting
+    ASSERT_EQ(0, GlobalHeapInternal::format(test_path("globalheap0").c_str()));
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_EQ(sizes, heap->size_classes().sizes());
+    ASSERT_EQ(0, heap->close());
+}
+
+TEST_F(GlobalHeapTest, block_size)
+{
+    GlobalHeapInternal* heap;  
+    std::vector<boost::filesystem::path> paths{test_path("globalheap0")};
+    size_t block_size = 64*1024;
+
+    EXPECT_NE(0, GlobalHeapInternal::create(paths, global_heap_size, global_metazone_size, 96*1024, std::vector<size_t>(), &heap));
+    ASSERT_EQ(0, GlobalHeapInternal::create(paths, global_heap_size, global_metazone_size, block_size, std::vector<size_t>(), &heap));
+    EXPECT_EQ(block_size, heap->nvheap()->block_size());
+    EXPECT_EQ(block_size, heap->nvheap()->zone(0)->block_size());
+
+    // large blocks are rounded up to the block size
+    RRegion::TPtr<char> l1 = static_cast<RRegion::TPtr<char> >(heap->malloc(130*1024));
+    RRegion::TPtr<char> l2 = static_cast<RRegion::TPtr<char> >(heap->malloc(130*1024));
+    EXPECT_NE(null_ptr, l1);
+    EXPECT_NE(null_ptr, l2);
+    EXPECT_EQ(ptrdiff_t(3*block_size), l2 - l1);
+
+    // slabs of large classes span several zone blocks, so frees must find
+    // the slab header blocks away
+    std::vector<RRegion::TPtr<void> > ptrs;
+    for (int i=0; i<16; i++) {
+        ptrs.push_back(heap->malloc(100*1024));
+        EXPECT_NE(null_ptr, ptrs.back());
+    }
+    HeapStats stats = heap->stats();
+    EXPECT_GE(stats.slab_bytes, 16*100*1024U);
+    for (size_t i=0; i<ptrs.size(); i++) {
+        heap->free(ptrs[i]);
+    }
+    heap->free(RRegion::TPtr<void>(l1));
+    heap->free(RRegion::TPtr<void>(l2));
+    ASSERT_EQ(0, heap->close());
+
+    // the block size is loaded from the heap header and survives formatting
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_EQ(block_size, heap->nvheap()->block_size());
+    ASSERT_EQ(0, heap->close());
+    ASSERT_EQ(0, GlobalHeapInternal::format(test_path("globalheap0").c_str()));
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_EQ(block_size, heap->nvheap()->block_size());
+    EXPECT_EQ(block_size, heap->nvheap()->zone(0)->block_size());
+    EXPECT_NE(null_ptr, heap->malloc(100*1024));
+    ASSERT_EQ(0, heap->close());
+}
+
+TEST_F(GlobalHeapTest, separate_slab_meta)
+{
+    GlobalHeapInternal* heap;  
+    std::vector<boost::filesystem::path> paths{test_path("globalheap0")};
+
+    slab_metadata_separate = true;
+    ASSERT_EQ(0, GlobalHeapInternal::create(paths, global_heap_size, global_metazone_size, BLOCK_SIZE, std::vector<size_t>(), &heap));
+    slab_metadata_separate = false;
+    EXPECT_TRUE(heap->nvheap()->separate_slab_meta());
+    RRegion::TPtr<nvZone> nvzone = heap->nvheap()->zone(0);
+    ASSERT_TRUE(nvzone->separate_slab_meta());
+
+    // 4K blocks fill a slab exactly, so the first one is aligned at the 
+    // zone block and frees must not take it for a large block
+    std::vector<RRegion::TPtr<char> > ptrs;
+    for (int i=0; i<128; i++) {
+        ptrs.push_back(static_cast<RRegion::TPtr<char> >(heap->malloc(4096)));
+        ASSERT_NE(null_ptr, ptrs.back());
+        // no block shares the metadata area
+        EXPECT_LE(0, ptrs.back() - RRegion::TPtr<char>(nvzone->block(0)));
+    }
+    RRegion::TPtr<char> l1 = static_cast<RRegion::TPtr<char> >(heap->malloc(300*1024));
+    EXPECT_NE(null_ptr, l1);
+    size_t naligned = 0;
+    for (size_t i=0; i<ptrs.size(); i++) {
+        if ((ptrs[i] - RRegion::TPtr<char>(nvzone->block(0))) % BLOCK_SIZE == 0) {
+            naligned++;
+        }
+        heap->free(RRegion::TPtr<void>(ptrs[i]));
+    }
+    EXPECT_LT(0U, naligned);
+    heap->free(RRegion::TPtr<void>(l1));
+    HeapStats stats = heap->stats();
+    if (stats.enabled) {
+        EXPECT_EQ(128U, stats.total_frees() - stats.large_frees);
+        EXPECT_EQ(1U, stats.large_frees);
+    }
+    ASSERT_EQ(0, heap->close());
+
+    // slabs are found through the metadata area when the heap is reloaded,
+    // and formatting keeps the placement
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_TRUE(heap->nvheap()->separate_slab_meta());
+    EXPECT_NE(null_ptr, heap->malloc(4096));
+    ASSERT_EQ(0, heap->close());
+    ASSERT_EQ(0, GlobalHeapInternal::format(test_path("globalheap0").c_str()));
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_TRUE(heap->nvheap()->zone(0)->separate_slab_meta());
+    EXPECT_NE(null_ptr, heap->malloc(4096));
+    ASSERT_EQ(0, heap->close());
+}
+
+TEST_F(GlobalHeapTest, lazy_format)
+{
+    GlobalHeapInternal* heap;
+
+    // zones are formatted when first leased
+    format_lazy = true;
+    ASSERT_EQ(0, GlobalHeapInternal::create(test_path("globalheap0").c_str(), global_heap_size, global_metazone_size, &heap));
+    format_lazy = false;
+    for (size_t zid=0; zid<heap->nvheap()->nzones(); zid++) {
+        EXPECT_TRUE(heap->nvheap()->zone(zid)->format_pending());
+    }
+    RRegion::TPtr<void> p1 = heap->malloc(300*1024);
+    ASSERT_NE(null_ptr, p1);
+    RRegion::TPtr<nvZone> nvzone = heap->nvheap()->zone(p1);
+    EXPECT_FALSE(nvzone->format_pending());
+    size_t npending = 0;
+    for (size_t zid=0; zid<heap->nvheap()->nzones(); zid++) {
+        npending += heap->nvheap()->zone(zid)->format_pending();
+    }
+    EXPECT_EQ(heap->nvheap()->nzones() - 1, npending);
+    ASSERT_EQ(0, heap->close());
+
+    // a lazily formatted heap forgets earlier allocations
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    ASSERT_NE(null_ptr, heap->malloc(300*1024));
+    ASSERT_EQ(0, heap->close());
+    format_lazy = true;
+    ASSERT_EQ(0, GlobalHeapInternal::format(test_path("globalheap0").c_str()));
+    format_lazy = false;
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    EXPECT_EQ(p1, heap->malloc(300*1024));
+    ASSERT_EQ(0, heap->close());
+
+    // eager formatting formats all zones before returning
+    format_threads = 2;
+    ASSERT_EQ(0, GlobalHeapInternal::format(test_path("globalheap0").c_str()));
+    format_threads = 0;
+    ASSERT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    for (size_t zid=0; zid<heap->nvheap()->nzones(); zid++) {
+        EXPECT_FALSE(heap->nvheap()->zone(zid)->format_pending());
+    }
+    EXPECT_EQ(p1, heap->malloc(300*1024));
+    ASSERT_EQ(0, heap->close());
+}
 
 TEST_F(AutoGlobalHeapTest, alloc)
 {
@@ -184,6 +363,243 @@ TEST_F(AutoGlobalHeapTest, alloc_free)
     heap_->free(p2);
 }
 
+TEST_F(AutoGlobalHeapTest, stats)
+{
+    HeapStats before = heap_->stats();
+    if (!before.enabled) {
+        return;
+    }
+    EXPECT_EQ(0U, before.total_mallocs());
+
+    RRegion::TPtr<void> p1 = heap_->malloc(1024);
+    RRegion::TPtr<void> p2 = heap_->malloc(1024);
+    RRegion::TPtr<void> p3 = heap_->malloc(256*1024);
+    EXPECT_NE(null_ptr, p1);
+    EXPECT_NE(null_ptr, p2);
+    EXPECT_NE(null_ptr, p3);
+    heap_->free(p1);
+    heap_->free(p3);
+
+    HeapStats after = heap_->stats();
+    int szclass = sizeclass(1024);
+    EXPECT_EQ(2U, after.mallocs[szclass]);
+    EXPECT_EQ(1U, after.frees[szclass]);
+    EXPECT_EQ(1U, after.large_mallocs);
+    EXPECT_EQ(1U, after.large_frees);
+    EXPECT_EQ(3U, after.total_mallocs());
+    EXPECT_EQ(2U, after.total_frees());
+    EXPECT_EQ(1U, after.slab_refills);
+    EXPECT_LE(1U, after.zone_acquisitions);
+    EXPECT_EQ(2U, after.extent_allocations);
+    EXPECT_EQ(0U, after.oom_failures);
+}
+
+TEST_F(AutoGlobalHeapTest, maintain)
+{
+    std::vector<RRegion::TPtr<void> > ptrs;
+    ptrs.push_back(heap_->malloc(1024));
+    ASSERT_NE(null_ptr, ptrs.back());
+    HeapStats before = heap_->stats();
+    EXPECT_EQ(1U, before.zones_owned);
+
+    // a full watermark leases another zone, and the class that was just 
+    // handed a slab gets two formatted ones
+    heap_->maintain(100, 2);
+    HeapStats after = heap_->stats();
+    EXPECT_EQ(2U, after.zones_owned);
+    EXPECT_LT(before.slab_bytes, after.slab_bytes);
+    EXPECT_EQ(after.slab_bytes - before.slab_bytes, after.slab_bytes_free - before.slab_bytes_free);
+
+    // the next slab of the class is a prepared one
+    size_t nblocks = before.slab_bytes / 1024;
+    for (size_t i=0; i<nblocks; i++) {
+        ptrs.push_back(heap_->malloc(1024));
+        ASSERT_NE(null_ptr, ptrs.back());
+    }
+    EXPECT_EQ(after.slab_bytes, heap_->stats().slab_bytes);
+
+    // once freed, the slabs of the thread slab heap beyond one go back to 
+    // the process slab heap, where any thread can reuse them
+    for (size_t i=0; i<ptrs.size(); i++) {
+        heap_->free(ptrs[i]);
+    }
+    heap_->maintain(0, 0);
+    EXPECT_EQ(after.slab_bytes, heap_->stats().slab_bytes);
+    EXPECT_NE(null_ptr, heap_->malloc(1024));
+
+    // the background thread runs the same passes until the heap closes
+    HeapMaintainer maintainer(heap_, 1, 0, 2);
+    ASSERT_EQ(0, maintainer.init());
+    usleep(10000);
+    ASSERT_EQ(0, maintainer.teardown());
+}
+
+TEST_F(AutoGlobalHeapTest, reserve)
+{
+    // small blocks are reserved as formatted slabs of their class
+    ASSERT_EQ(0, heap_->reserve(1024, 1000));
+    HeapStats before = heap_->stats();
+    EXPECT_LE(1000U*1024, before.slab_bytes_free);
+
+    std::vector<RRegion::TPtr<void> > ptrs;
+    for (size_t i=0; i<1000; i++) {
+        ptrs.push_back(heap_->malloc(1024));
+        ASSERT_NE(null_ptr, ptrs.back());
+    }
+    EXPECT_EQ(before.slab_bytes, heap_->stats().slab_bytes);
+
+    // large blocks are reserved as free space in leased zones
+    ASSERT_EQ(0, heap_->reserve(512*1024, 20, MemAttrib(0)));
+    before = heap_->stats();
+    EXPECT_EQ(2U, before.zones_owned);
+    for (size_t i=0; i<20; i++) {
+        ptrs.push_back(heap_->malloc(512*1024, MemAttrib(0)));
+        ASSERT_NE(null_ptr, ptrs.back());
+    }
+    EXPECT_EQ(before.zones_owned, heap_->stats().zones_owned);
+
+    // a reservation larger than the heap fails
+    EXPECT_EQ(-1, heap_->reserve(512*1024, 1000));
+
+    for (size_t i=0; i<ptrs.size(); i++) {
+        heap_->free(ptrs[i]);
+    }
+}
+
+static const LockSiteStats* find_lock_site(const LockProfile& profile, const std::string& name)
+{
+    for (size_t i = 0; i < profile.sites.size(); i++) {
+        if (profile.sites[i].name == name) {
+            return &profile.sites[i];
+        }
+    }
+    return NULL;
+}
+
+TEST_F(AutoGlobalHeapTest, lock_profile)
+{
+    set_lock_profile(true);
+    reset_lock_profile();
+    RRegion::TPtr<void> p1 = heap_->malloc(1024);
+    RRegion::TPtr<void> p2 = heap_->malloc(256*1024);
+    EXPECT_NE(null_ptr, p1);
+    EXPECT_NE(null_ptr, p2);
+    heap_->free(p1);
+    heap_->free(p2);
+    set_lock_profile(false);
+
+    LockProfile profile;
+    get_lock_profile(&profile);
+    EXPECT_FALSE(profile.enabled);
+    const LockSiteStats* thread_slab_heap = find_lock_site(profile, "thread_slab_heap");
+    const LockSiteStats* extent_heap = find_lock_site(profile, "extent_heap");
+    const LockSiteStats* slab_owner = find_lock_site(profile, "slab_owner");
+    ASSERT_TRUE(thread_slab_heap != NULL);
+    ASSERT_TRUE(extent_heap != NULL);
+    ASSERT_TRUE(slab_owner != NULL);
+    // the malloc of the small block locks the thread slab heap and its
+    // free tries the owner of the slab, which is idle
+    EXPECT_LE(1U, thread_slab_heap->acquisitions);
+    EXPECT_LE(1U, extent_heap->acquisitions);
+    EXPECT_EQ(1U, slab_owner->acquisitions);
+    EXPECT_EQ(0U, slab_owner->contended);
+
+    // nothing is counted while profiling is off
+    p1 = heap_->malloc(1024);
+    heap_->free(p1);
+    LockProfile after;
+    get_lock_profile(&after);
+    EXPECT_EQ(thread_slab_heap->acquisitions, find_lock_site(after, "thread_slab_heap")->acquisitions);
+}
+
+TEST_F(GlobalHeapTest, stats_export)
+{
+    GlobalHeapInternal* heap;  
+    EXPECT_EQ(0, GlobalHeapInternal::create(test_path("globalheap0").c_str(), global_heap_size, global_metazone_size, &heap));
+    ASSERT_EQ(0, heap->close());
+
+    StatsOptions options;
+    options.export_heap_stats = true;
+    options.export_interval_ms = 3600*1000;
+    init_stats_export(options);
+    EXPECT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    init_stats_export(StatsOptions());
+
+    StatsPublisher* publisher = heap->stats_publisher();
+    ASSERT_TRUE(publisher != NULL);
+    std::string name = publisher->segment_name();
+    std::vector<std::string> names;
+    ASSERT_EQ(0, list_stats_segments(&names));
+    EXPECT_NE(names.end(), std::find(names.begin(), names.end(), name));
+
+    RRegion::TPtr<void> p1 = heap->malloc(1024);
+    EXPECT_NE(null_ptr, p1);
+    publisher->publish();
+
+    StatsSample sample;
+    ASSERT_EQ(0, read_stats_segment(name, &sample));
+    EXPECT_EQ(getpid(), sample.pid);
+    EXPECT_EQ(heap->instance(), sample.generation);
+    EXPECT_EQ(boost::filesystem::absolute(test_path("globalheap0")).string(), std::string(sample.heap_path));
+    EXPECT_LE(1U, sample.zones_owned);
+    EXPECT_LT(sample.slab_bytes_free, sample.slab_bytes);
+    if (sample.enabled) {
+        EXPECT_EQ(1U, sample.mallocs[sizeclass(1024)]);
+    }
+    EXPECT_TRUE(stats_publisher_alive(sample));
+
+    ASSERT_EQ(0, heap->close());
+    EXPECT_NE(0, read_stats_segment(name, &sample));
+}
+
+TEST_F(GlobalHeapTest, trace)
+{
+    GlobalHeapInternal* heap;  
+    EXPECT_EQ(0, GlobalHeapInternal::create(test_path("globalheap0").c_str(), global_heap_size, global_metazone_size, &heap));
+    ASSERT_EQ(0, heap->close());
+
+    StatsOptions options;
+    options.trace_dir = boost::filesystem::temp_directory_path().string();
+    init_stats_export(options);
+    EXPECT_EQ(0, GlobalHeapInternal::open(test_path("globalheap0").c_str(), &heap));
+    init_stats_export(StatsOptions());
+
+    TraceRecorder* recorder = heap->trace_recorder();
+    ASSERT_TRUE(recorder != NULL);
+    std::string filename = recorder->filename();
+
+    RRegion::TPtr<void> p1 = heap->malloc(1024);
+    RRegion::TPtr<void> p2 = heap->malloc(64, MemAttrib(0));
+    RRegion::TPtr<void> p3 = heap->realloc(p2, 128);
+    heap->free(p1);
+    heap->free(p3);
+    uint64_t generation = heap->instance();
+    ASSERT_EQ(0, heap->close());
+
+    TraceHeader header;
+    std::vector<TraceRecord> records;
+    ASSERT_EQ(0, read_trace(filename, &header, &records));
+    EXPECT_EQ(generation, header.generation);
+    EXPECT_EQ(global_heap_size, header.heap_size);
+    ASSERT_EQ(6U, records.size());
+    uint16_t ops[] = {TraceRecord::kOpMalloc, TraceRecord::kOpMalloc, TraceRecord::kOpMalloc, 
+                      TraceRecord::kOpFree, TraceRecord::kOpFree, TraceRecord::kOpFree};
+    uint64_t offsets[] = {p1.offset(), p2.offset(), p3.offset(), p2.offset(), p1.offset(), p3.offset()};
+    for (size_t i = 0; i < records.size(); i++) {
+        EXPECT_EQ(ops[i], records[i].op);
+        EXPECT_EQ(offsets[i], records[i].offset);
+        EXPECT_EQ(records[0].thread, records[i].thread);
+        if (i > 0) {
+            EXPECT_LE(records[i-1].timestamp_ns, records[i].timestamp_ns);
+        }
+    }
+    EXPECT_EQ(1024U, records[0].size);
+    EXPECT_EQ(TraceRecord::kAnyIg, records[0].ig);
+    EXPECT_EQ(0U, records[1].ig);
+    EXPECT_EQ(128U, records[2].size);
+    boost::filesystem::remove(filename);
+}
+
 TEST_F(AutoGlobalHeapTest, alloc_reload)
 {
 #ifdef BASE_RELATIVE_POINTERS
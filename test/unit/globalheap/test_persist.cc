@@ -0,0 +1,143 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "alps/common/assorted_func.hh"
+
+#include "globalheap/layout.hh"
+#include "globalheap/nvslab.hh"
+#include "globalheap/persist.hh"
+#include "globalheap/size_class.hh"
+#include "test_common.hh"
+
+using namespace alps;
+
+class PersistTest: public RegionTest { 
+public:
+    void SetUp() {
+        RegionTest::SetUp();
+        persist_counters().reset();
+    }
+};
+
+TEST_F(PersistTest, coalesce_lines)
+{
+    alignas(kCacheLineSize) char buf[4*kCacheLineSize];
+
+    PersistContext ctx;
+    ctx.add(&buf[0], 8);
+    ctx.add(&buf[8], 8);
+    ctx.add(&buf[0], kCacheLineSize);
+    EXPECT_EQ(1U, ctx.pending());
+    ctx.add(&buf[kCacheLineSize-1], 2);
+    EXPECT_EQ(2U, ctx.pending());
+    ctx.commit();
+
+    EXPECT_EQ(2U, persist_counters().flushes);
+    EXPECT_EQ(1U, persist_counters().fences);
+    EXPECT_EQ(1U, persist_counters().ops);
+}
+
+TEST_F(PersistTest, elide_empty_commit)
+{
+    PersistContext ctx;
+    ctx.commit();
+    ctx.commit();
+    EXPECT_EQ(0U, persist_counters().fences);
+}
+
+TEST_F(PersistTest, overflow_single_fence)
+{
+    size_t nlines = 2*PersistContext::kMaxLines + 1;
+    char* buf = new char[(nlines+1)*kCacheLineSize];
+
+    PersistContext ctx;
+    for (size_t i=0; i<nlines; i++) {
+        ctx.add(&buf[i*kCacheLineSize], 1);
+    }
+    ctx.commit();
+    EXPECT_EQ(nlines, persist_counters().flushes);
+    EXPECT_EQ(1U, persist_counters().fences);
+
+    delete [] buf;
+}
+
+TEST_F(PersistTest, mark_alloc)
+{
+    const uint32_t nblocks = 32;
+    alignas(kCacheLineSize) nvBlockHeader headers[nblocks];
+    memset(headers, 0, sizeof(headers));
+
+    nvExtentHeader* exheader = static_cast<nvExtentHeader*>(&headers[0]);
+    exheader->mark_alloc(nblocks);
+
+    EXPECT_EQ(nvBlockHeader::kBlockTypeExtentFirst, headers[0].primary_type);
+    for (uint32_t i=1; i<nblocks; i++) {
+        EXPECT_EQ(nvBlockHeader::kBlockTypeExtentRun, headers[i].primary_type);
+    }
+
+    // run headers are flushed one cache line at a time and ordered before
+    // the linearization point
+    size_t header_lines = nblocks * sizeof(nvBlockHeader) / kCacheLineSize;
+    EXPECT_EQ(header_lines + 1, persist_counters().flushes);
+    EXPECT_EQ(2U, persist_counters().fences);
+}
+
+TEST_F(PersistTest, slab_header_single_fence)
+{
+    RRegion::TPtr<nvSlab> nvslab = alloc(256*1024);
+
+    nvSlab::make(nvslab, sizeclass(8));
+    EXPECT_EQ(1U, persist_counters().fences);
+    EXPECT_EQ(nvslab->header.size() / kCacheLineSize, persist_counters().flushes);
+}
+
+TEST_F(PersistTest, durability_modes)
+{
+    DurabilityMode saved_mode = durability_mode;
+    const char* modes[] = { "none", "clflush", "clflushopt", "clwb", "msync" };
+
+    RRegion::TPtr<char> buf = alloc(16*4096);
+    for (auto m: modes) {
+        DurabilityMode mode;
+        ASSERT_EQ(0, durability_mode_from_string(m, &mode));
+        set_durability_mode(mode);
+
+        persist_counters().reset();
+        PersistContext ctx;
+        for (int i=0; i<16; i++) {
+            buf[i*4096] = i;
+            ctx.add(&buf[i*4096], 1);
+        }
+        ctx.commit();
+        EXPECT_EQ(16U, persist_counters().flushes);
+        EXPECT_EQ(1U, persist_counters().fences);
+    }
+
+    DurabilityMode mode;
+    EXPECT_EQ(-1, durability_mode_from_string("bogus", &mode));
+
+    set_durability_mode(saved_mode);
+}
+
+int main(int argc, char** argv)
+{
+    ::alps::init_test_env<::alps::TestEnvironment>(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "globalheap/rwlock.hh"
+
+using namespace alps;
+
+TEST(ReaderWriterLock, readers_share)
+{
+    ReaderWriterLock rwlock(kLockSiteZoneHeapRead, kLockSiteZoneHeapWrite);
+    std::atomic<int> inside(0);
+    std::atomic<bool> all_inside(false);
+    const int nthreads = 4;
+    std::vector<std::thread> threads;
+
+    // every reader waits inside the critical section until all are in
+    for (int t = 0; t < nthreads; t++) {
+        threads.push_back(std::thread([&]() {
+            rwlock.lock_read();
+            if (++inside == nthreads) {
+                all_inside = true;
+            }
+            while (!all_inside) {
+                std::this_thread::yield();
+            }
+            rwlock.unlock_read();
+        }));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    EXPECT_TRUE(all_inside);
+}
+
+TEST(ReaderWriterLock, writer_excludes)
+{
+    ReaderWriterLock rwlock(kLockSiteZoneHeapRead, kLockSiteZoneHeapWrite);
+    const int nthreads = 8;
+    const int nops = 20000;
+    // a writer leaves both values equal; readers must never see them differ
+    volatile uint64_t a = 0;
+    volatile uint64_t b = 0;
+    std::atomic<int> torn(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < nthreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            unsigned int seed = t + 1;
+            for (int i = 0; i < nops; i++) {
+                if (rand_r(&seed) % 10 == 0) {
+                    rwlock.lock_write();
+                    a = a + 1;
+                    std::this_thread::yield();
+                    b = b + 1;
+                    rwlock.unlock_write();
+                } else {
+                    rwlock.lock_read();
+                    if (a != b) {
+                        torn++;
+                    }
+                    rwlock.unlock_read();
+                }
+            }
+        }));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    EXPECT_EQ(0, torn);
+    EXPECT_EQ(a, b);
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
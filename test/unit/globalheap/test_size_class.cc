@@ -0,0 +1,93 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <map>
+#include <vector>
+#include "gtest/gtest.h"
+#include "globalheap/size_class_table.hh"
+
+using namespace alps;
+
+TEST(SizeClassTable, default_classes)
+{
+    SizeClassTable table;
+    EXPECT_TRUE(table.is_default());
+    EXPECT_EQ(kSizeClasses, table.nclasses());
+    for (size_t size = 1; size <= SizeClassTable::kMaxSmallSize; size += 7) {
+        EXPECT_EQ(sizeclass(size), table.sizeclass(size));
+    }
+}
+
+TEST(SizeClassTable, set)
+{
+    SizeClassTable table;
+    std::vector<size_t> sizes{24, 100*8, 128*1024};
+    ASSERT_EQ(0, table.set(sizes));
+    EXPECT_FALSE(table.is_default());
+    EXPECT_EQ(3, table.nclasses());
+    EXPECT_EQ(0, table.sizeclass(1));
+    EXPECT_EQ(0, table.sizeclass(24));
+    EXPECT_EQ(1, table.sizeclass(25));
+    EXPECT_EQ(2, table.sizeclass(128*1024));
+    EXPECT_EQ(sizes, table.sizes());
+
+    // rejected tables leave the table unchanged
+    EXPECT_NE(0, table.set(std::vector<size_t>()));
+    EXPECT_NE(0, table.set(std::vector<size_t>{12, 128*1024}));
+    EXPECT_NE(0, table.set(std::vector<size_t>{64, 32, 128*1024}));
+    EXPECT_NE(0, table.set(std::vector<size_t>{64, 64*1024}));
+    EXPECT_NE(0, table.set(std::vector<size_t>{64, 256*1024}));
+    EXPECT_NE(0, table.set(std::vector<size_t>(kSizeClasses+1, 128*1024)));
+    EXPECT_EQ(sizes, table.sizes());
+}
+
+TEST(SizeClassTable, profile)
+{
+    std::map<size_t, uint64_t> histogram;
+    histogram[100] = 1000;
+    histogram[200] = 500;
+    histogram[3000] = 10;
+    histogram[1024*1024] = 10; // allocated as an extent
+
+    std::vector<size_t> sizes;
+    ASSERT_EQ(0, profile_size_classes(histogram, kSizeClasses, &sizes));
+    SizeClassTable table;
+    ASSERT_EQ(0, table.set(sizes));
+    // every profiled size gets a class of its own; 100 rounds up to 104
+    EXPECT_EQ(4000U, table.rounding_waste(histogram));
+    EXPECT_EQ(104U, table.size_from_class(table.sizeclass(100)));
+    EXPECT_EQ(200U, table.size_from_class(table.sizeclass(200)));
+    EXPECT_EQ(3000U, table.size_from_class(table.sizeclass(3000)));
+    EXPECT_LT(table.rounding_waste(histogram), default_size_classes.rounding_waste(histogram));
+
+    // a single spare class goes to the size that saves the most: 
+    // 500 * (256 - 200) bytes beats 1000 * (128 - 104)
+    ASSERT_EQ(0, profile_size_classes(histogram, 16, &sizes));
+    ASSERT_EQ(16U, sizes.size());
+    ASSERT_EQ(0, table.set(sizes));
+    EXPECT_EQ(200U, table.size_from_class(table.sizeclass(200)));
+    EXPECT_EQ(128U, table.size_from_class(table.sizeclass(100)));
+
+    // too few classes for the power-of-two backbone
+    EXPECT_NE(0, profile_size_classes(histogram, 8, &sizes));
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
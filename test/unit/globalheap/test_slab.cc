@@ -62,6 +62,50 @@ TEST_F(SlabTest, nvslab)
     EXPECT_EQ(nvslab->nblocks()-1, nvslab->block_id(nvslab->block(nvslab->nblocks()-1)));
 }
 
+TEST_F(SlabTest, nvslab_multiblock)
+{
+    // small classes fit in a single block 
+    EXPECT_EQ(256*1024U, nvSlab::size_for(256*1024, 1024));
+    EXPECT_EQ(64*1024U, nvSlab::size_for(64*1024, 1024));
+    // large ones span enough blocks for nvSlab::kMinBlocks blocks
+    EXPECT_EQ(512*1024U, nvSlab::size_for(256*1024, 32*1024));
+    EXPECT_EQ(2*1024*1024U, nvSlab::size_for(256*1024, 128*1024));
+    EXPECT_EQ(2*1024*1024U, nvSlab::size_for(64*1024, 240*1024));
+    EXPECT_EQ(4*1024*1024U, nvSlab::size_for(4*1024*1024, 240*1024));
+
+    RRegion::TPtr<nvSlab> nvslab = alloc(1024*1024);
+    int szcl_128K = sizeclass(128*1024);   
+    nvSlab::make(nvslab, 1024*1024, szcl_128K);
+    EXPECT_EQ(1024*1024U, nvslab->size());
+    EXPECT_EQ(7U, nvslab->nblocks());
+    EXPECT_LE(nvslab->block_offset(nvslab->nblocks()), nvslab->size());
+
+    // reformatting keeps the size of the slab
+    nvSlab::remake(nvslab, sizeclass(1024), default_size_classes);
+    EXPECT_EQ(1024*1024U, nvslab->size());
+    EXPECT_LT(1000U, nvslab->nblocks());
+}
+
+TEST_F(SlabTest, nvslab_coloring)
+{
+    int szcl_1K = sizeclass(1024);   
+    RRegion::TPtr<nvSlab> s0 = alloc(256*1024);
+    RRegion::TPtr<nvSlab> s1 = alloc(256*1024);
+
+    // neighbouring slabs start their blocks at different cache lines 
+    // without losing blocks
+    nvSlab::make(s0, szcl_1K);
+    nvSlab::make(s1, szcl_1K);
+    EXPECT_EQ(s0->nblocks(), s1->nblocks());
+    EXPECT_EQ(s0->block_offset(0) + kCacheLineSize, s1->block_offset(0));
+    EXPECT_LE(s1->block_offset(s1->nblocks()), s1->size());
+
+    slab_coloring = false;
+    nvSlab::make(s1, szcl_1K);
+    slab_coloring = true;
+    EXPECT_EQ(s0->block_offset(0), s1->block_offset(0));
+}
+
 TEST_F(SlabTest, nvslab_alloc_block_130)
 {
     char pattern[1024];
@@ -141,6 +185,8 @@ TEST_F(SlabTest, slab_alloc_block)
     slab.alloc_block();
     EXPECT_EQ(slab.nblocks() - 3, slab.nblocks_free());
 
+    // the durable bitmap is exact once reserved blocks are returned
+    slab.flush();
     Slab shadow_slab(nvslab);
     EXPECT_EQ(slab.nblocks_free(), shadow_slab.nblocks_free());
 }
@@ -157,7 +203,7 @@ TEST_F(ExtentHeapTest, load_nvslab)
 
     close_heap();
     open_heap(test_path("globalheap0"));
-    SlabHeap slabheap(extentheap());
+    SlabHeap slabheap(extentheap(), kLockSiteProcessSlabHeap);
     InsertSlabFunctor functor(&slabheap);
     extentheap()->more_space(1, functor);
 }
@@ -50,7 +50,7 @@ public:
 
 TEST_F(SlabHeapTest, insert)
 {
-    SlabHeap slabheap(NULL);
+    SlabHeap slabheap(NULL, kLockSiteProcessSlabHeap);
 
     Slab* slab0 = slabheap.insert_slab(alloc_nvslab(71, 0));
     Slab* slab1 = slabheap.insert_slab(alloc_nvslab(71, 1));
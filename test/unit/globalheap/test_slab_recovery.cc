@@ -0,0 +1,216 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/debug.hh"
+#include "common/persist.hh"
+#include "globalheap/nvslab.hh"
+#include "globalheap/slab.hh"
+#include "globalheap/size_class.hh"
+#include "test_common.hh"
+
+using namespace alps;
+
+class SlabRecoveryTest: public RegionTest { 
+public:
+    void SetUp() {
+        RegionTest::SetUp();
+        saved_batch_size_ = slab_batch_size;
+        slab_batch_size = 8;
+    }
+
+    void TearDown() {
+        slab_batch_size = saved_batch_size_;
+        RegionTest::TearDown();
+    }
+
+    // Runs func in a child process that crashes (exits without flushing or
+    // tearing down) when func returns or an armed crash point is reached. 
+    // Block ids the child reports as allocated are returned through live.
+    template<typename Func>
+    void run_and_crash(Func func, std::vector<size_t>* live)
+    {
+        int fds[2];
+        ASSERT_EQ(0, pipe(fds));
+        pid_t pid = fork();
+        ASSERT_LE(0, pid);
+        if (pid == 0) {
+            close(fds[0]);
+            func(fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        size_t bid;
+        while (read(fds[0], &bid, sizeof(bid)) == sizeof(bid)) {
+            live->push_back(bid);
+        }
+        close(fds[0]);
+        int status;
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+    }
+
+    static void report(int fd, RRegion::TPtr<nvSlab> nvslab, RRegion::TPtr<void> ptr)
+    {
+        size_t bid = nvslab->block_id(ptr);
+        ASSERT_EQ(sizeof(bid), write(fd, &bid, sizeof(bid)));
+    }
+
+    size_t saved_batch_size_;
+};
+
+TEST_F(SlabRecoveryTest, clean_after_flush)
+{
+    RRegion::TPtr<nvSlab> nvslab = alloc(slab_size);
+    nvSlab::make(nvslab, sizeclass(64));
+
+    Slab slab(nvslab);
+    std::vector<RRegion::TPtr<void> > ptrs;
+    for (int i=0; i<20; i++) {
+        ptrs.push_back(slab.alloc_block());
+    }
+    for (int i=0; i<5; i++) {
+        slab.free_block(ptrs[i]);
+    }
+    EXPECT_EQ(nvSlabHeader::kSlabStateDirty, nvslab->state());
+
+    slab.flush();
+    EXPECT_EQ(nvSlabHeader::kSlabStateClean, nvslab->state());
+    EXPECT_EQ(slab.nblocks_free(), nvslab->nblocks_free());
+    EXPECT_EQ(nvslab->nblocks() - 15, nvslab->nblocks_free());
+}
+
+TEST_F(SlabRecoveryTest, batched_fences)
+{
+    RRegion::TPtr<nvSlab> nvslab = alloc(slab_size);
+    nvSlab::make(nvslab, sizeclass(64));
+
+    Slab slab(nvslab);
+    persist_counters().reset();
+    for (size_t i=0; i<8*slab_batch_size; i++) {
+        slab.alloc_block();
+    }
+    // one fence to mark the slab dirty plus one per reservation
+    EXPECT_EQ(1U + 8, persist_counters().fences);
+}
+
+TEST_F(SlabRecoveryTest, crash_with_outstanding_reservation)
+{
+    RRegion::TPtr<nvSlab> nvslab = alloc(slab_size);
+    nvSlab::make(nvslab, sizeclass(64));
+
+    std::vector<size_t> live;
+    run_and_crash([&](int fd) {
+        Slab slab(nvslab);
+        std::vector<RRegion::TPtr<void> > ptrs;
+        for (int i=0; i<21; i++) {
+            ptrs.push_back(slab.alloc_block());
+        }
+        for (int i=0; i<3; i++) {
+            slab.free_block(ptrs[i]);
+        }
+        for (size_t i=3; i<ptrs.size(); i++) {
+            report(fd, nvslab, ptrs[i]);
+        }
+    }, &live);
+
+    ASSERT_EQ(18U, live.size());
+    EXPECT_EQ(nvSlabHeader::kSlabStateDirty, nvslab->state());
+
+    Slab slab(nvslab);
+    EXPECT_EQ(nvSlabHeader::kSlabStateClean, nvslab->state());
+    for (size_t i=0; i<live.size(); i++) {
+        EXPECT_FALSE(nvslab->is_free(live[i]));
+    }
+    // leaked blocks are bounded by the outstanding reservation and pending frees
+    size_t nallocated = slab.nblocks() - slab.nblocks_free();
+    EXPECT_LE(live.size(), nallocated);
+    EXPECT_GE(live.size() + 2*slab_batch_size, nallocated);
+
+    // recovered slab hands out only blocks that are not live
+    for (size_t i=0; i<slab.nblocks_free(); i++) {
+        RRegion::TPtr<void> ptr = slab.alloc_block();
+        ASSERT_NE(null_ptr, ptr);
+        size_t bid = nvslab->block_id(ptr);
+        EXPECT_EQ(live.end(), std::find(live.begin(), live.end(), bid));
+    }
+}
+
+TEST_F(SlabRecoveryTest, crash_during_reserve)
+{
+    RRegion::TPtr<nvSlab> nvslab = alloc(slab_size);
+    nvSlab::make(nvslab, sizeclass(128));
+
+    std::vector<size_t> live;
+    run_and_crash([&](int fd) {
+        arm_crash_point("slab_reserve", 2);
+        Slab slab(nvslab);
+        for (size_t i=0; i<slab_batch_size+1; i++) {
+            RRegion::TPtr<void> ptr = slab.alloc_block();
+            report(fd, nvslab, ptr);
+        }
+    }, &live);
+
+    ASSERT_EQ(slab_batch_size, live.size());
+
+    Slab slab(nvslab);
+    EXPECT_EQ(nvSlabHeader::kSlabStateClean, nvslab->state());
+    for (size_t i=0; i<live.size(); i++) {
+        EXPECT_FALSE(nvslab->is_free(live[i]));
+    }
+}
+
+TEST_F(SlabRecoveryTest, crash_during_remake)
+{
+    RRegion::TPtr<nvSlab> nvslab = alloc(slab_size);
+    int szclass = sizeclass(64);
+    nvSlab::make(nvslab, szclass);
+
+    std::vector<size_t> live;
+    run_and_crash([&](int fd) {
+        Slab slab(nvslab);
+        RRegion::TPtr<void> ptr = slab.alloc_block();
+        slab.free_block(ptr);
+        // scribble over the bitmap as a partially written format would
+        memset(&nvslab->header.block_map, 0xff, 16);
+        arm_crash_point("slab_remake");
+        slab.init(sizeclass(1024));
+    }, &live);
+
+    EXPECT_EQ(nvSlabHeader::kSlabStateFormatting, nvslab->state());
+
+    Slab slab(nvslab);
+    EXPECT_EQ(nvSlabHeader::kSlabStateClean, nvslab->state());
+    EXPECT_EQ(szclass, slab.sizeclass());
+    EXPECT_TRUE(slab.empty());
+    EXPECT_EQ(nvslab->nblocks(), nvslab->nblocks_free());
+    EXPECT_LE(nvslab->block_offset(nvslab->nblocks()), slab_size);
+}
+
+int main(int argc, char** argv)
+{
+    ::alps::init_test_env<::alps::TestEnvironment>(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
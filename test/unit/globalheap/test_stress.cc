@@ -21,16 +21,6 @@
 #include <thread>
 
 #include <boost/interprocess/offset_ptr.hpp>
-#include <boost/icl/discrete_interval.hpp>
-#include <boost/icl/continuous_interval.hpp>
-#include <boost/icl/right_open_interval.hpp>
-#include <boost/icl/left_open_interval.hpp>
-#include <boost/icl/closed_interval.hpp>
-#include <boost/icl/open_interval.hpp>
-#include <boost/icl/rational.hpp>
-#include <boost/icl/interval.hpp>
-#include <boost/icl/interval_map.hpp>
-#include <boost/icl/separate_interval_set.hpp>
 
 #include "gtest/gtest.h"
 #include "alps/globalheap/globalheap.hh"
@@ -38,151 +28,11 @@
 #include "globalheap/globalheap_internal.hh"
 #include "test_common.hh"
 #include "test_heap_fixture.hh"
+#include "test_workload.hh"
 
 using namespace alps;
 
 
-// keep track of live allocated blocks
-// to be able to randomly pick a live block, we maintain a vector of live blocks from which we draw a block 
-// the position of the block in the vector is also stored in the interval tree so that we can locate the 
-// block in the vector upon removal from the interval tree
-class LiveBlocks
-{
-public:
-    typedef boost::icl::interval_map<uint64_t, uint64_t>::iterator iterator;
-
-public:
-    void insert_block(uint64_t base, size_t sz)
-    {
-        size_t pos = vec_.size();
-        vec_.push_back(base);
-        map_ += std::make_pair(boost::icl::discrete_interval<uint64_t>(base, base + sz - 1, boost::icl::interval_bounds::closed()), pos+1);
-    }
-
-    void insert_block(void* base, size_t sz)
-    {
-        insert_block((uint64_t) base, sz);
-    }
-
-    int remove_block(uint64_t base)
-    {
-        // remove the interval entry corresponding to the block from both the interval map and the vector
-        boost::icl::interval_map<uint64_t, uint64_t>::const_iterator iter = map_.find(base);
-        if (iter == map_.end()) {
-            return -1;
-        }
-        if (base != iter->first.lower()) {
-            return -1;
-        }
-        uint64_t pos = iter->second;
-        uint64_t sz = iter->first.upper() - iter->first.lower() + 1;
-        map_ -= std::make_pair(boost::icl::discrete_interval<uint64_t>(base, base + sz - 1, boost::icl::interval_bounds::closed()), pos);
-        assert(vec_[pos-1] == base);
-        if (pos == vec_.size()) {
-            vec_.pop_back();
-        } else {
-        // swap the last entry in the vector with the removed one and reset the 
-        // interval map entry to point to the new position in the vector
-        uint64_t last_base = vec_.back();
-        iter = map_.find(last_base);
-        base = iter->first.lower();
-        sz = iter->first.upper() - iter->first.lower() + 1;
-        map_.set(std::make_pair(boost::icl::discrete_interval<uint64_t>(base, base + sz - 1, boost::icl::interval_bounds::closed()), pos));
-        vec_[pos-1] = base;
-        vec_.pop_back();
-        }
-        return 0; 
-    }
-
-    int remove_block(void* base)
-    {
-        return remove_block((uint64_t) base);
-    }
-
-    uint64_t pick_block_random(unsigned int *seedp)
-    {
-        unsigned int idx = rand_r(seedp) % vec_.size();
-        return vec_[idx];
-    }
-
-    bool overlaps(uint64_t base, uint64_t sz)
-    {
-        boost::icl::interval_map<uint64_t, uint64_t>::const_iterator iter = map_.find(boost::icl::discrete_interval<uint64_t>(base, base+sz-1, boost::icl::interval_bounds::closed()));
-        if (iter == map_.end()) {
-            return false;
-        }
-        return true;
-    }
-
-    uint64_t size()
-    {
-        return vec_.size();
-    }
-
-    iterator begin()
-    {
-        return map_.begin();
-    }
-
-    iterator end()
-    {
-        return map_.end();
-    }
-
-    void print()
-    {
-        for (boost::icl::interval_map<uint64_t, uint64_t>::iterator iter = map_.begin(); iter != map_.end(); iter++) {
-            printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", iter->first.lower(), iter->first.upper(), iter->second);
-        }
-
-    }
-
-private:
-    boost::icl::interval_map<uint64_t, uint64_t> map_; // interval map of live blocks
-    std::vector<uint64_t> vec_; // vector of live blocks that enables picking a block at random
-};
-
-class UniformDistribution
-{
-public:
-    const int granularity = 1000; // 1000 sample points per block size
-public:
-    UniformDistribution(size_t min, size_t max, size_t incr)
-    {
-        for (size_t blk_sz = min; blk_sz<=max; blk_sz += incr)
-        {
-            for (int i=0; i<granularity; i++) {
-                inverse_cdf_.push_back(blk_sz);
-            }
-        }
-     
-    }
-
-    UniformDistribution(std::vector<size_t> block_sizes)
-    {
-        for (std::vector<size_t>::iterator iter = block_sizes.begin();
-             iter != block_sizes.end();
-             iter++)
-        {
-            for (int i=0; i<granularity; i++) {
-                size_t blk_sz = *iter;
-                inverse_cdf_.push_back(blk_sz);
-            }
-        }
-    }
-
-    size_t random(unsigned int *seedp)
-    {
-        unsigned int idx = rand_r(seedp) % inverse_cdf_.size();
-        return inverse_cdf_[idx];
-    }
-
-
-private:
-    std::vector<size_t> inverse_cdf_;
-};
-
-
 void write_pattern(void* ptr, size_t size, uint64_t pattern)
 {
     for (size_t i=0; i<size/sizeof(pattern); i++) {
@@ -63,6 +63,52 @@ TEST_F(ThreadSlabHeapTest, test1)
     std::cout << shadow_thread_slab_heap << std::endl;
 }
 
+static size_t slab_bytes_free(const SlabHeap& slabheap)
+{
+    HeapStats stats;
+    slabheap.stats(&stats);
+    return stats.slab_bytes_free;
+}
+
+TEST_F(ThreadSlabHeapTest, deferred_free)
+{
+    ProcessSlabHeap process_slab_heap(extentheap());
+    ThreadSlabHeap thread_slab_heap(&process_slab_heap);
+
+    RRegion::TPtr<void> p1 = thread_slab_heap.malloc(1024);
+    RRegion::TPtr<void> p2 = thread_slab_heap.malloc(1024);
+    ASSERT_NE(null_ptr, p1);
+    ASSERT_NE(null_ptr, p2);
+    size_t bytes_free = slab_bytes_free(thread_slab_heap);
+
+    // a free of a block of a busy heap is left to the heap
+    thread_slab_heap.lock();
+    process_slab_heap.free(p1);
+    EXPECT_EQ(bytes_free, slab_bytes_free(thread_slab_heap));
+    thread_slab_heap.unlock();
+
+    // ...which applies it on its next allocation
+    EXPECT_NE(null_ptr, thread_slab_heap.malloc(1024));
+    EXPECT_EQ(bytes_free, slab_bytes_free(thread_slab_heap));
+
+    // ...or when it flushes
+    thread_slab_heap.lock();
+    process_slab_heap.free(p2);
+    thread_slab_heap.flush();
+    EXPECT_EQ(bytes_free + 1024, slab_bytes_free(thread_slab_heap));
+    thread_slab_heap.unlock();
+
+    // a free of a block of an idle heap is immediate
+    process_slab_heap.free(thread_slab_heap.malloc(1024));
+    EXPECT_EQ(bytes_free + 1024, slab_bytes_free(thread_slab_heap));
+
+    HeapStats stats;
+    thread_slab_heap.stats(&stats);
+    if (stats.enabled) {
+        EXPECT_EQ(2U, stats.deferred_frees);
+    }
+}
+
 int main(int argc, char** argv)
 {
     ::alps::init_test_env<::alps::TestEnvironment>(argc, argv);
@@ -0,0 +1,220 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_TEST_WORKLOAD_HH_
+#define _ALPS_TEST_WORKLOAD_HH_
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/icl/discrete_interval.hpp>
+#include <boost/icl/interval.hpp>
+#include <boost/icl/interval_map.hpp>
+
+#include "alps/common/assorted_func.hh"
+
+namespace alps {
+
+// keep track of live allocated blocks
+// to be able to randomly pick a live block, we maintain a vector of live blocks from which we draw a block 
+// the position of the block in the vector is also stored in the interval tree so that we can locate the 
+// block in the vector upon removal from the interval tree
+class LiveBlocks
+{
+public:
+    typedef boost::icl::interval_map<uint64_t, uint64_t>::iterator iterator;
+
+public:
+    void insert_block(uint64_t base, size_t sz)
+    {
+        size_t pos = vec_.size();
+        vec_.push_back(base);
+        map_ += std::make_pair(boost::icl::discrete_interval<uint64_t>(base, base + sz - 1, boost::icl::interval_bounds::closed()), pos+1);
+    }
+
+    void insert_block(void* base, size_t sz)
+    {
+        insert_block((uint64_t) base, sz);
+    }
+
+    int remove_block(uint64_t base)
+    {
+        // remove the interval entry corresponding to the block from both the interval map and the vector
+        boost::icl::interval_map<uint64_t, uint64_t>::const_iterator iter = map_.find(base);
+        if (iter == map_.end()) {
+            return -1;
+        }
+        if (base != iter->first.lower()) {
+            return -1;
+        }
+        uint64_t pos = iter->second;
+        uint64_t sz = iter->first.upper() - iter->first.lower() + 1;
+        map_ -= std::make_pair(boost::icl::discrete_interval<uint64_t>(base, base + sz - 1, boost::icl::interval_bounds::closed()), pos);
+        assert(vec_[pos-1] == base);
+        if (pos == vec_.size()) {
+            vec_.pop_back();
+        } else {
+        // swap the last entry in the vector with the removed one and reset the 
+        // interval map entry to point to the new position in the vector
+        uint64_t last_base = vec_.back();
+        iter = map_.find(last_base);
+        base = iter->first.lower();
+        sz = iter->first.upper() - iter->first.lower() + 1;
+        map_.set(std::make_pair(boost::icl::discrete_interval<uint64_t>(base, base + sz - 1, boost::icl::interval_bounds::closed()), pos));
+        vec_[pos-1] = base;
+        vec_.pop_back();
+        }
+        return 0; 
+    }
+
+    int remove_block(void* base)
+    {
+        return remove_block((uint64_t) base);
+    }
+
+    uint64_t pick_block_random(unsigned int *seedp)
+    {
+        unsigned int idx = rand_r(seedp) % vec_.size();
+        return vec_[idx];
+    }
+
+    bool overlaps(uint64_t base, uint64_t sz)
+    {
+        boost::icl::interval_map<uint64_t, uint64_t>::const_iterator iter = map_.find(boost::icl::discrete_interval<uint64_t>(base, base+sz-1, boost::icl::interval_bounds::closed()));
+        if (iter == map_.end()) {
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t size()
+    {
+        return vec_.size();
+    }
+
+    iterator begin()
+    {
+        return map_.begin();
+    }
+
+    iterator end()
+    {
+        return map_.end();
+    }
+
+    void print()
+    {
+        for (boost::icl::interval_map<uint64_t, uint64_t>::iterator iter = map_.begin(); iter != map_.end(); iter++) {
+            printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", iter->first.lower(), iter->first.upper(), iter->second);
+        }
+
+    }
+
+private:
+    boost::icl::interval_map<uint64_t, uint64_t> map_; // interval map of live blocks
+    std::vector<uint64_t> vec_; // vector of live blocks that enables picking a block at random
+};
+
+class UniformDistribution
+{
+public:
+    const int granularity = 1000; // 1000 sample points per block size
+public:
+    UniformDistribution(size_t min, size_t max, size_t incr)
+    {
+        for (size_t blk_sz = min; blk_sz<=max; blk_sz += incr)
+        {
+            for (int i=0; i<granularity; i++) {
+                inverse_cdf_.push_back(blk_sz);
+            }
+        }
+     
+    }
+
+    UniformDistribution(std::vector<size_t> block_sizes)
+    {
+        for (std::vector<size_t>::iterator iter = block_sizes.begin();
+             iter != block_sizes.end();
+             iter++)
+        {
+            for (int i=0; i<granularity; i++) {
+                size_t blk_sz = *iter;
+                inverse_cdf_.push_back(blk_sz);
+            }
+        }
+    }
+
+    size_t random(unsigned int *seedp)
+    {
+        unsigned int idx = rand_r(seedp) % inverse_cdf_.size();
+        return inverse_cdf_[idx];
+    }
+
+
+private:
+    std::vector<size_t> inverse_cdf_;
+};
+
+/**
+ * @brief Parse a block size distribution: either a single size (e.g. 64),
+ * a min-max range in increments of min (e.g. 64K-512K), or a range with an
+ * explicit increment (e.g. 8-4096:8)
+ */
+inline UniformDistribution* parse_distribution(const std::string& spec)
+{
+    std::vector<std::string> range;
+    std::vector<std::string> parts;
+    boost::split(parts, spec, boost::is_any_of(":"));
+    boost::split(range, parts[0], boost::is_any_of("-"));
+    if (parts.size() > 2 || range.size() > 2) {
+        return NULL;
+    }
+    size_t min = string_to_size(range[0]);
+    size_t max = range.size() > 1 ? string_to_size(range[1]) : min;
+    size_t incr = parts.size() > 1 ? string_to_size(parts[1]) : min;
+    if (min == 0 || max < min || incr == 0) {
+        return NULL;
+    }
+    return new UniformDistribution(min, max, incr);
+}
+
+/**
+ * @brief Parse a comma separated list of positive numbers
+ */
+template<typename T>
+int parse_list(const std::string& str, std::vector<T>* list)
+{
+    std::vector<std::string> items;
+    boost::split(items, str, boost::is_any_of(","));
+    for (auto& item: items) {
+        T val = static_cast<T>(std::stol(item));
+        if (val <= 0) {
+            return -1;
+        }
+        list->push_back(val);
+    }
+    return 0;
+}
+
+} // namespace alps
+
+#endif // _ALPS_TEST_WORKLOAD_HH_